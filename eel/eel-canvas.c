@@ -1389,12 +1389,52 @@ eel_canvas_group_update (EelCanvasItem *item, double i2w_dx, double i2w_dy, int
 	GList *list;
 	EelCanvasItem *i;
 	double bbox_x0, bbox_y0, bbox_x1, bbox_y1;
+	double old_x1, old_y1, old_x2, old_y2;
 	gboolean first = TRUE;
 
 	group = EEL_CANVAS_GROUP (item);
 
 	(* group_parent_class->update) (item, i2w_dx, i2w_dy, flags);
 
+	/* Unless the whole group is updated, only visit the children that
+	 * requested an update, and grow the bounding box with them. A full
+	 * pass is only needed when a child on the edge of the box changed. */
+	if (!(flags & EEL_CANVAS_UPDATE_DEEP) && !group->need_bounds_update) {
+		for (list = group->item_list; list; list = list->next) {
+			i = list->data;
+
+			if (!(i->flags & (EEL_CANVAS_ITEM_NEED_UPDATE | EEL_CANVAS_ITEM_NEED_DEEP_UPDATE)))
+				continue;
+
+			old_x1 = i->x1;
+			old_y1 = i->y1;
+			old_x2 = i->x2;
+			old_y2 = i->y2;
+
+			eel_canvas_item_invoke_update (i, i2w_dx + group->xpos, i2w_dy + group->ypos, flags);
+
+			if (i->x1 == old_x1 && i->y1 == old_y1 &&
+			    i->x2 == old_x2 && i->y2 == old_y2)
+				continue;
+
+			if (old_x1 <= item->x1 || old_y1 <= item->y1 ||
+			    old_x2 >= item->x2 || old_y2 >= item->y2) {
+				group->need_bounds_update = TRUE;
+				continue;
+			}
+
+			item->x1 = MIN (item->x1, i->x1);
+			item->y1 = MIN (item->y1, i->y1);
+			item->x2 = MAX (item->x2, i->x2);
+			item->y2 = MAX (item->y2, i->y2);
+		}
+
+		if (!group->need_bounds_update)
+			return;
+	}
+
+	group->need_bounds_update = FALSE;
+
 	bbox_x0 = 0;
 	bbox_y0 = 0;
 	bbox_x1 = 0;
@@ -1502,9 +1542,12 @@ eel_canvas_group_draw (EelCanvasItem  *item,
 	EelCanvasGroup *group;
 	GList *list;
 	EelCanvasItem *child = NULL;
+	cairo_rectangle_int_t extents;
 
 	group = EEL_CANVAS_GROUP (item);
 
+	cairo_region_get_extents (region, &extents);
+
 	for (list = group->item_list; list; list = list->next) {
 		child = list->data;
 
@@ -1512,6 +1555,12 @@ eel_canvas_group_draw (EelCanvasItem  *item,
 		    (EEL_CANVAS_ITEM_GET_CLASS (child)->draw)) {
 			GdkRectangle child_rect;
 
+			/* Most children are far from the drawn area, reject
+			 * them on its extents before looking at the region */
+			if (child->x2 < extents.x || child->x1 >= extents.x + extents.width ||
+			    child->y2 < extents.y || child->y1 >= extents.y + extents.height)
+				continue;
+
 			child_rect.x = child->x1;
 			child_rect.y = child->y1;
 			child_rect.width = child->x2 - child->x1 + 1;
@@ -1677,6 +1726,8 @@ group_add (EelCanvasGroup *group, EelCanvasItem *item)
 	} else
 		group->item_list_end = g_list_append (group->item_list_end, item)->next;
 
+	group->need_bounds_update = TRUE;
+
 	if (item->flags & EEL_CANVAS_ITEM_VISIBLE &&
 	    group->item.flags & EEL_CANVAS_ITEM_MAPPED) {
 		if (!(item->flags & EEL_CANVAS_ITEM_REALIZED))
@@ -1724,6 +1775,8 @@ group_remove (EelCanvasGroup *group, EelCanvasItem *item)
 
 			group->item_list = g_list_remove_link (group->item_list, children);
 			g_list_free (children);
+
+			group->need_bounds_update = TRUE;
 			break;
 		}
 }
@@ -2038,6 +2091,11 @@ shutdown_transients (EelCanvas *canvas)
 		canvas->need_redraw = FALSE;
 	}
 
+	if (canvas->damage != NULL) {
+		cairo_region_destroy (canvas->damage);
+		canvas->damage = NULL;
+	}
+
 	if (canvas->grabbed_item) {
 		eel_canvas_item_ungrab (canvas->grabbed_item);
 	}
@@ -2794,6 +2852,21 @@ eel_cairo_get_clip_region (cairo_t *cr)
         return region;
 }
 
+/* Invalidates the area accumulated by eel_canvas_request_redraw() */
+static void
+flush_damage (EelCanvas *canvas)
+{
+	if (canvas->damage == NULL)
+		return;
+
+	if (gtk_widget_is_drawable (GTK_WIDGET (canvas)))
+		gdk_window_invalidate_region (gtk_layout_get_bin_window (GTK_LAYOUT (canvas)),
+					      canvas->damage, FALSE);
+
+	cairo_region_destroy (canvas->damage);
+	canvas->damage = NULL;
+}
+
 /* Expose handler for the canvas */
 static gboolean
 eel_canvas_draw (GtkWidget *widget, cairo_t *cr)
@@ -2841,6 +2914,8 @@ eel_canvas_draw (GtkWidget *widget, cairo_t *cr)
 		canvas->need_update = FALSE;
 	}
 
+	flush_damage (canvas);
+
 	if (canvas->root->flags & EEL_CANVAS_ITEM_MAPPED)
 		EEL_CANVAS_ITEM_GET_CLASS (canvas->root)->draw (canvas->root, cr, region);
 
@@ -2888,6 +2963,8 @@ update_again:
 	if (canvas->need_update) {
 		goto update_again;
 	}
+
+	flush_damage (canvas);
 }
 
 /* Idle handler for the canvas.  It deals with pending updates and redraws. */
@@ -3252,6 +3329,9 @@ eel_canvas_request_update_real (EelCanvas *canvas)
  * Convenience function that informs a canvas that the specified rectangle needs
  * to be repainted.  The rectangle includes @x1 and @y1, but not @x2 and @y2.
  * To be used only by item implementations.
+ *
+ * The rectangles requested by all the items are merged and invalidated at
+ * once at the next idle loop iteration.
  **/
 void
 eel_canvas_request_redraw (EelCanvas *canvas, int x1, int y1, int x2, int y2)
@@ -3268,8 +3348,12 @@ eel_canvas_request_redraw (EelCanvas *canvas, int x1, int y1, int x2, int y2)
 	bbox.width = x2 - x1;
 	bbox.height = y2 - y1;
 
-	gdk_window_invalidate_rect (gtk_layout_get_bin_window (GTK_LAYOUT (canvas)),
-				    &bbox, FALSE);
+	if (canvas->damage == NULL)
+		canvas->damage = cairo_region_create_rectangle (&bbox);
+	else
+		cairo_region_union_rectangle (canvas->damage, &bbox);
+
+	add_idle (canvas);
 }
 
 /**
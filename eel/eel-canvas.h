@@ -327,6 +327,10 @@ struct _EelCanvasGroup {
 	/* Children of the group */
 	GList *item_list;
 	GList *item_list_end;
+
+	/* Whether the bounding box must be computed again from all the
+	 * children, rather than from the ones that got updated */
+	unsigned int need_bounds_update : 1;
 };
 
 struct _EelCanvasGroupClass {
@@ -380,6 +384,10 @@ struct _EelCanvas {
 	/* Idle handler ID */
 	guint idle_id;
 
+	/* Area that needs to be repainted, invalidated at once at the next
+	 * idle loop iteration */
+	cairo_region_t *damage;
+
 	/* Signal handler ID for destruction of the root item */
 	guint root_destroy_id;
 
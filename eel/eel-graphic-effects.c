@@ -30,6 +30,19 @@
 #include <math.h>
 #include <string.h>
 
+#if !defined (EEL_OMIT_SELF_CHECK)
+#include "eel-lib-self-check-functions.h"
+#endif
+
+/* Number of colorized variants remembered per source pixbuf; the
+ * selection colour only changes with the focus of the window. */
+#define MAX_COLORIZED_PER_PIXBUF 2
+
+typedef struct {
+	GdkRGBA color;
+	GdkPixbuf *pixbuf;
+} ColorizedPixbuf;
+
 /* shared utility to create a new pixbuf from the passed-in one */
 
 static GdkPixbuf *
@@ -48,57 +61,151 @@ create_new_pixbuf (GdkPixbuf *src)
 			       gdk_pixbuf_get_height (src));
 }
 
-/* utility routine to bump the level of a color component with pinning */
-
-static guchar
-lighten_component (guchar cur_value)
-{
-	int new_value = cur_value;
-	new_value += 24 + (new_value >> 3);
-	if (new_value > 255) {
-		new_value = 255;
-	}
-	return (guchar) new_value;
-}
-
-GdkPixbuf *
-eel_create_spotlight_pixbuf (GdkPixbuf* src)
+/* Applies the per-component tables to every pixel of src, copying alpha
+ * unchanged. Rows are walked with the channel count known at the loop,
+ * so there is no per-pixel test for alpha, and the whole image is one
+ * row when neither pixbuf has padding at the end of its rows.
+ */
+static void
+map_pixbuf_components (GdkPixbuf    *src,
+		       GdkPixbuf    *dest,
+		       const guchar *red_table,
+		       const guchar *green_table,
+		       const guchar *blue_table)
 {
-	GdkPixbuf *dest;
 	int i, j;
-	int width, height, has_alpha, src_row_stride, dst_row_stride;
-	guchar *target_pixels, *original_pixels;
-	guchar *pixsrc, *pixdest;
-
-	g_return_val_if_fail (gdk_pixbuf_get_colorspace (src) == GDK_COLORSPACE_RGB, NULL);
-	g_return_val_if_fail ((!gdk_pixbuf_get_has_alpha (src)
-			       && gdk_pixbuf_get_n_channels (src) == 3)
-			      || (gdk_pixbuf_get_has_alpha (src)
-				  && gdk_pixbuf_get_n_channels (src) == 4), NULL);
-	g_return_val_if_fail (gdk_pixbuf_get_bits_per_sample (src) == 8, NULL);
+	int width, height, n_channels, src_row_stride, dst_row_stride;
+	const guchar *original_pixels, *pixsrc;
+	guchar *target_pixels, *pixdest;
 
-	dest = create_new_pixbuf (src);
-	
-	has_alpha = gdk_pixbuf_get_has_alpha (src);
+	n_channels = gdk_pixbuf_get_n_channels (src);
 	width = gdk_pixbuf_get_width (src);
 	height = gdk_pixbuf_get_height (src);
-	dst_row_stride = gdk_pixbuf_get_rowstride (dest);
 	src_row_stride = gdk_pixbuf_get_rowstride (src);
-	target_pixels = gdk_pixbuf_get_pixels (dest);
+	dst_row_stride = gdk_pixbuf_get_rowstride (dest);
 	original_pixels = gdk_pixbuf_get_pixels (src);
+	target_pixels = gdk_pixbuf_get_pixels (dest);
+
+	if (src_row_stride == width * n_channels &&
+	    dst_row_stride == width * n_channels) {
+		width *= height;
+		height = 1;
+	}
 
 	for (i = 0; i < height; i++) {
 		pixdest = target_pixels + i * dst_row_stride;
 		pixsrc = original_pixels + i * src_row_stride;
-		for (j = 0; j < width; j++) {		
-			*pixdest++ = lighten_component (*pixsrc++);
-			*pixdest++ = lighten_component (*pixsrc++);
-			*pixdest++ = lighten_component (*pixsrc++);
-			if (has_alpha) {
-				*pixdest++ = *pixsrc++;
+
+		if (n_channels == 4) {
+			for (j = 0; j < width; j++, pixsrc += 4, pixdest += 4) {
+				pixdest[0] = red_table[pixsrc[0]];
+				pixdest[1] = green_table[pixsrc[1]];
+				pixdest[2] = blue_table[pixsrc[2]];
+				pixdest[3] = pixsrc[3];
+			}
+		} else {
+			for (j = 0; j < width; j++, pixsrc += 3, pixdest += 3) {
+				pixdest[0] = red_table[pixsrc[0]];
+				pixdest[1] = green_table[pixsrc[1]];
+				pixdest[2] = blue_table[pixsrc[2]];
 			}
 		}
 	}
+}
+
+/* table to bump the level of a color component with pinning */
+
+static const guchar *
+get_spotlight_table (void)
+{
+	static guchar table[256];
+	static gsize initialized = 0;
+	int new_value, i;
+
+	if (g_once_init_enter (&initialized)) {
+		for (i = 0; i < 256; i++) {
+			new_value = i + 24 + (i >> 3);
+			table[i] = MIN (new_value, 255);
+		}
+		g_once_init_leave (&initialized, 1);
+	}
+
+	return table;
+}
+
+static gboolean
+check_pixbuf_format (GdkPixbuf *src)
+{
+	g_return_val_if_fail (gdk_pixbuf_get_colorspace (src) == GDK_COLORSPACE_RGB, FALSE);
+	g_return_val_if_fail ((!gdk_pixbuf_get_has_alpha (src)
+			       && gdk_pixbuf_get_n_channels (src) == 3)
+			      || (gdk_pixbuf_get_has_alpha (src)
+				  && gdk_pixbuf_get_n_channels (src) == 4), FALSE);
+	g_return_val_if_fail (gdk_pixbuf_get_bits_per_sample (src) == 8, FALSE);
+
+	return TRUE;
+}
+
+static GQuark
+spotlight_quark (void)
+{
+	static GQuark quark = 0;
+
+	if (quark == 0) {
+		quark = g_quark_from_static_string ("eel-spotlight-pixbuf");
+	}
+	return quark;
+}
+
+static GQuark
+colorized_quark (void)
+{
+	static GQuark quark = 0;
+
+	if (quark == 0) {
+		quark = g_quark_from_static_string ("eel-colorized-pixbufs");
+	}
+	return quark;
+}
+
+static void
+colorized_pixbuf_list_free (GList *list)
+{
+	GList *l;
+	ColorizedPixbuf *colorized;
+
+	for (l = list; l != NULL; l = l->next) {
+		colorized = l->data;
+		g_object_unref (colorized->pixbuf);
+		g_slice_free (ColorizedPixbuf, colorized);
+	}
+	g_list_free (list);
+}
+
+/* The result is remembered on src and shared by every caller asking for
+ * the spotlight of the same pixbuf, so it must not be modified. */
+GdkPixbuf *
+eel_create_spotlight_pixbuf (GdkPixbuf* src)
+{
+	GdkPixbuf *dest;
+	const guchar *table;
+
+	if (!check_pixbuf_format (src)) {
+		return NULL;
+	}
+
+	dest = g_object_get_qdata (G_OBJECT (src), spotlight_quark ());
+	if (dest != NULL) {
+		return g_object_ref (dest);
+	}
+
+	dest = create_new_pixbuf (src);
+	table = get_spotlight_table ();
+	map_pixbuf_components (src, dest, table, table, table);
+
+	g_object_set_qdata_full (G_OBJECT (src), spotlight_quark (),
+				 g_object_ref (dest), g_object_unref);
+
 	return dest;
 }
 
@@ -108,47 +215,188 @@ GdkPixbuf *
 eel_create_colorized_pixbuf (GdkPixbuf *src,
 			     GdkRGBA *color)
 {
-	int i, j;
-	int width, height, has_alpha, src_row_stride, dst_row_stride;
-	guchar *target_pixels;
-	guchar *original_pixels;
-	guchar *pixsrc;
-	guchar *pixdest;
 	GdkPixbuf *dest;
+	GList *cached, *l, *last;
+	ColorizedPixbuf *colorized;
+	guchar red_table[256], green_table[256], blue_table[256];
 	gint red_value, green_value, blue_value;
+	int i;
 
-	g_return_val_if_fail (gdk_pixbuf_get_colorspace (src) == GDK_COLORSPACE_RGB, NULL);
-	g_return_val_if_fail ((!gdk_pixbuf_get_has_alpha (src)
-			       && gdk_pixbuf_get_n_channels (src) == 3)
-			      || (gdk_pixbuf_get_has_alpha (src)
-				  && gdk_pixbuf_get_n_channels (src) == 4), NULL);
-	g_return_val_if_fail (gdk_pixbuf_get_bits_per_sample (src) == 8, NULL);
+	if (!check_pixbuf_format (src)) {
+		return NULL;
+	}
 
-	red_value = (gint) floor (color->red * 255);
-	green_value = (gint) floor (color->green * 255);
-	blue_value = (gint) floor (color->blue * 255);	
+	cached = g_object_steal_qdata (G_OBJECT (src), colorized_quark ());
+	for (l = cached; l != NULL; l = l->next) {
+		colorized = l->data;
+		if (gdk_rgba_equal (&colorized->color, color)) {
+			break;
+		}
+	}
 
-	dest = create_new_pixbuf (src);
-	
-	has_alpha = gdk_pixbuf_get_has_alpha (src);
-	width = gdk_pixbuf_get_width (src);
-	height = gdk_pixbuf_get_height (src);
-	src_row_stride = gdk_pixbuf_get_rowstride (src);
-	dst_row_stride = gdk_pixbuf_get_rowstride (dest);
-	target_pixels = gdk_pixbuf_get_pixels (dest);
-	original_pixels = gdk_pixbuf_get_pixels (src);
+	if (l != NULL) {
+		/* keep the most recently used first */
+		cached = g_list_remove_link (cached, l);
+		cached = g_list_concat (l, cached);
+		colorized = l->data;
+		dest = g_object_ref (colorized->pixbuf);
+	} else {
+		red_value = (gint) floor (color->red * 255);
+		green_value = (gint) floor (color->green * 255);
+		blue_value = (gint) floor (color->blue * 255);
 
-	for (i = 0; i < height; i++) {
-		pixdest = target_pixels + i*dst_row_stride;
-		pixsrc = original_pixels + i*src_row_stride;
-		for (j = 0; j < width; j++) {		
-			*pixdest++ = (*pixsrc++ * red_value) >> 8;
-			*pixdest++ = (*pixsrc++ * green_value) >> 8;
-			*pixdest++ = (*pixsrc++ * blue_value) >> 8;
-			if (has_alpha) {
-				*pixdest++ = *pixsrc++;
-			}
+		for (i = 0; i < 256; i++) {
+			red_table[i] = (i * red_value) >> 8;
+			green_table[i] = (i * green_value) >> 8;
+			blue_table[i] = (i * blue_value) >> 8;
+		}
+
+		dest = create_new_pixbuf (src);
+		map_pixbuf_components (src, dest, red_table, green_table, blue_table);
+
+		colorized = g_slice_new (ColorizedPixbuf);
+		colorized->color = *color;
+		colorized->pixbuf = g_object_ref (dest);
+		cached = g_list_prepend (cached, colorized);
+
+		if (g_list_length (cached) > MAX_COLORIZED_PER_PIXBUF) {
+			last = g_list_last (cached);
+			cached = g_list_remove_link (cached, last);
+			colorized_pixbuf_list_free (last);
 		}
 	}
+
+	g_object_set_qdata_full (G_OBJECT (src), colorized_quark (),
+				 cached, (GDestroyNotify) colorized_pixbuf_list_free);
+
 	return dest;
 }
+
+#if !defined (EEL_OMIT_SELF_CHECK)
+
+static GdkPixbuf *
+create_test_pixbuf (gboolean has_alpha, int width, int height)
+{
+	GdkPixbuf *pixbuf;
+	guchar *pixels;
+	int i, j, n_channels, row_stride;
+
+	pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, has_alpha, 8, width, height);
+	pixels = gdk_pixbuf_get_pixels (pixbuf);
+	n_channels = gdk_pixbuf_get_n_channels (pixbuf);
+	row_stride = gdk_pixbuf_get_rowstride (pixbuf);
+
+	for (i = 0; i < height; i++) {
+		for (j = 0; j < width * n_channels; j++) {
+			pixels[i * row_stride + j] = (i * 7 + j * 13) & 0xff;
+		}
+	}
+
+	return pixbuf;
+}
+
+static int
+get_component (GdkPixbuf *pixbuf, int x, int y, int component)
+{
+	return gdk_pixbuf_get_pixels (pixbuf)[y * gdk_pixbuf_get_rowstride (pixbuf)
+					       + x * gdk_pixbuf_get_n_channels (pixbuf)
+					       + component];
+}
+
+/* Set EEL_TIME_SELF_CHECKS to also time the effects; too noisy to be
+ * worth running by default. */
+static void
+time_effects (GdkPixbuf *src, const GdkRGBA *color)
+{
+	GdkPixbuf *pixbuf, *copy;
+	GdkRGBA rgba;
+	gint64 start, spotlight_time, colorize_time;
+	int i;
+
+	if (g_getenv ("EEL_TIME_SELF_CHECKS") == NULL) {
+		return;
+	}
+
+	/* work on copies so that nothing is served from the caches */
+	rgba = *color;
+
+	start = g_get_monotonic_time ();
+	for (i = 0; i < 100; i++) {
+		copy = gdk_pixbuf_copy (src);
+		pixbuf = eel_create_spotlight_pixbuf (copy);
+		g_object_unref (pixbuf);
+		g_object_unref (copy);
+	}
+	spotlight_time = g_get_monotonic_time () - start;
+
+	start = g_get_monotonic_time ();
+	for (i = 0; i < 100; i++) {
+		copy = gdk_pixbuf_copy (src);
+		pixbuf = eel_create_colorized_pixbuf (copy, &rgba);
+		g_object_unref (pixbuf);
+		g_object_unref (copy);
+	}
+	colorize_time = g_get_monotonic_time () - start;
+
+	g_print ("%dx%d %s: spotlight %" G_GINT64_FORMAT "us, colorize %" G_GINT64_FORMAT "us per 100\n",
+		 gdk_pixbuf_get_width (src), gdk_pixbuf_get_height (src),
+		 gdk_pixbuf_get_has_alpha (src) ? "RGBA" : "RGB",
+		 spotlight_time, colorize_time);
+}
+
+void
+eel_self_check_graphic_effects (void)
+{
+	GdkPixbuf *src, *spotlight, *colorized, *again;
+	GdkRGBA color = { 0.5, 1.0, 0.25, 1.0 };
+	GdkRGBA other_color = { 1.0, 1.0, 1.0, 1.0 };
+	gboolean has_alpha;
+
+	for (has_alpha = FALSE; has_alpha <= TRUE; has_alpha++) {
+		/* odd width, so that RGB rows are padded */
+		src = create_test_pixbuf (has_alpha, 33, 17);
+
+		spotlight = eel_create_spotlight_pixbuf (src);
+		EEL_CHECK_INTEGER_RESULT (get_component (spotlight, 0, 0, 0), 24);
+		EEL_CHECK_INTEGER_RESULT (get_component (spotlight, 3, 2, 1),
+					  MIN (get_component (src, 3, 2, 1) + 24 + (get_component (src, 3, 2, 1) >> 3), 255));
+		EEL_CHECK_INTEGER_RESULT (get_component (spotlight, 32, 16, 2),
+					  MIN (get_component (src, 32, 16, 2) + 24 + (get_component (src, 32, 16, 2) >> 3), 255));
+		if (has_alpha) {
+			EEL_CHECK_INTEGER_RESULT (get_component (spotlight, 5, 9, 3),
+						  get_component (src, 5, 9, 3));
+		}
+
+		again = eel_create_spotlight_pixbuf (src);
+		EEL_CHECK_BOOLEAN_RESULT (again == spotlight, TRUE);
+		g_object_unref (again);
+
+		colorized = eel_create_colorized_pixbuf (src, &color);
+		EEL_CHECK_INTEGER_RESULT (get_component (colorized, 7, 4, 0),
+					  (get_component (src, 7, 4, 0) * 127) >> 8);
+		EEL_CHECK_INTEGER_RESULT (get_component (colorized, 7, 4, 1),
+					  (get_component (src, 7, 4, 1) * 255) >> 8);
+		EEL_CHECK_INTEGER_RESULT (get_component (colorized, 32, 16, 2),
+					  (get_component (src, 32, 16, 2) * 63) >> 8);
+
+		again = eel_create_colorized_pixbuf (src, &color);
+		EEL_CHECK_BOOLEAN_RESULT (again == colorized, TRUE);
+		g_object_unref (again);
+
+		again = eel_create_colorized_pixbuf (src, &other_color);
+		EEL_CHECK_BOOLEAN_RESULT (again == colorized, FALSE);
+		g_object_unref (again);
+
+		time_effects (src, &color);
+
+		g_object_unref (colorized);
+		g_object_unref (spotlight);
+		g_object_unref (src);
+
+		src = create_test_pixbuf (has_alpha, 256, 256);
+		time_effects (src, &color);
+		g_object_unref (src);
+	}
+}
+
+#endif /* !EEL_OMIT_SELF_CHECK */
@@ -25,6 +25,9 @@
 #include <gdk-pixbuf/gdk-pixbuf.h>
 #include <gdk/gdk.h>
 
+/* The returned pixbufs are cached on the source pixbuf and shared,
+ * callers must not modify them. */
+
 /* return a lightened pixbuf for pre-lighting */
 GdkPixbuf *eel_create_spotlight_pixbuf (GdkPixbuf *source_pixbuf);
 
@@ -37,6 +37,7 @@ void eel_run_lib_self_checks (void);
 
 #define EEL_LIB_FOR_EACH_SELF_CHECK_FUNCTION(macro) \
 	macro (eel_self_check_string) \
+	macro (eel_self_check_graphic_effects) \
 /* Add new self-check functions to the list above this line. */
 
 /* Generate prototypes for all the functions. */
@@ -671,6 +671,7 @@ nautilus_desktop_canvas_view_init (NautilusDesktopCanvasView *desktop_canvas_vie
 
 	nautilus_canvas_container_set_is_fixed_size (canvas_container, TRUE);
 	nautilus_canvas_container_set_is_desktop (canvas_container, TRUE);
+	nautilus_canvas_container_set_is_virtualized (canvas_container, FALSE);
 	nautilus_canvas_container_set_store_layout_timestamps (canvas_container, TRUE);
 
 	/* Set allocation to be at 0, 0 */
@@ -1203,12 +1203,123 @@ resort (NautilusCanvasContainer *container)
 	cache_icon_positions (container);
 }
 
-typedef struct {
-	double width;
-	double height;
-	double x_offset;
-	double y_offset;
-} IconPositions;
+/* Fetch the grid layout metrics of an icon, measuring the item only when
+ * they changed since the last layout.
+ */
+static void
+icon_get_layout_metrics (NautilusCanvasContainer *container,
+			 NautilusCanvasIcon *icon,
+			 double grid_width,
+			 int icon_size)
+{
+	EelDRect bounds;
+	EelDRect icon_bounds;
+	int icon_width;
+
+	if (icon->layout_metrics_valid) {
+		return;
+	}
+
+	/* Assume it's only one level hierarchy to avoid costly affine calculations */
+	nautilus_canvas_item_get_bounds_for_layout (icon->item,
+						    &bounds.x0, &bounds.y0,
+						    &bounds.x1, &bounds.y1);
+
+	/* Normalize the icon width to the grid unit.
+	 * Use the icon size for this zoom level too in the calculation, since
+	 * the actual bounds might be smaller - e.g. because we have a very
+	 * narrow thumbnail.
+	 */
+	icon_width = ceil (MAX ((bounds.x1 - bounds.x0), icon_size) / grid_width) * grid_width;
+
+	/* Calculate size above/below baseline */
+	icon_bounds = nautilus_canvas_item_get_icon_rectangle (icon->item);
+	icon->layout_height_above = icon_bounds.y1 - bounds.y0;
+	icon->layout_height_below = bounds.y1 - icon_bounds.y1;
+
+	icon->layout_width = icon_width;
+	icon->layout_x_offset = (icon_width - (icon_bounds.x1 - icon_bounds.x0)) / 2;
+	icon->layout_y_offset = icon_bounds.y0 - icon_bounds.y1;
+
+	icon->layout_metrics_valid = TRUE;
+}
+
+static void
+invalidate_layout_rows (NautilusCanvasContainer *container)
+{
+	if (container->details->layout_rows != NULL) {
+		g_array_free (container->details->layout_rows, TRUE);
+		container->details->layout_rows = NULL;
+	}
+}
+
+/* Find the row of @rows the icon at @position was laid down in. */
+static guint
+layout_rows_find (GArray *rows,
+		  int     position)
+{
+	NautilusCanvasLayoutRow *row;
+	guint low, high, mid;
+
+	low = 0;
+	high = rows->len;
+	while (high - low > 1) {
+		mid = (low + high) / 2;
+		row = &g_array_index (rows, NautilusCanvasLayoutRow, mid);
+		if (row->first <= position) {
+			low = mid;
+		} else {
+			high = mid;
+		}
+	}
+
+	return low;
+}
+
+/* Position of the first icon that is new, moved in the sort order or
+ * changed its size since the last layout of all the icons.
+ */
+static int
+get_first_changed_icon_position (NautilusCanvasContainer *container)
+{
+	GList *p;
+	NautilusCanvasIcon *icon;
+	int position;
+
+	for (p = container->details->icons, position = 0; p != NULL; p = p->next, position++) {
+		icon = p->data;
+
+		if (!icon->layout_metrics_valid ||
+		    icon->layout_position != position ||
+		    !icon_is_positioned (icon)) {
+			return position;
+		}
+	}
+
+	/* Icons were only removed from the end: the new last row has to
+	 * show its entire text.
+	 */
+	return position - 1;
+}
+
+static gboolean
+layout_row_is_unchanged (GArray                  *old_rows,
+			 guint                    index,
+			 NautilusCanvasLayoutRow *row)
+{
+	NautilusCanvasLayoutRow *old_row;
+
+	/* The last row of the old layout was laid down showing its entire text. */
+	if (old_rows == NULL || index + 1 >= old_rows->len) {
+		return FALSE;
+	}
+
+	old_row = &g_array_index (old_rows, NautilusCanvasLayoutRow, index);
+
+	return old_row->first == row->first &&
+		old_row->n_icons == row->n_icons &&
+		old_row->y == row->y;
+}
 
 static void
 lay_down_one_line (NautilusCanvasContainer *container,
@@ -1216,147 +1327,199 @@ lay_down_one_line (NautilusCanvasContainer *container,
 		   GList *line_end,
 		   double y,
 		   double max_height,
-		   GArray *positions,
 		   gboolean whole_text)
 {
 	GList *p;
 	NautilusCanvasIcon *icon;
-	double x, y_offset;
-	IconPositions *position;
-	int i;
+	double x;
 	gboolean is_rtl;
 
 	is_rtl = nautilus_canvas_container_is_layout_rtl (container);
 
 	/* Lay out the icons along the baseline. */
 	x = ICON_PAD_LEFT;
-	i = 0;
 	for (p = line_start; p != line_end; p = p->next) {
 		icon = p->data;
 
-		position = &g_array_index (positions, IconPositions, i++);
-		y_offset = position->y_offset;
-
 		icon_set_position
 			(icon,
-			 is_rtl ? get_mirror_x_position (container, icon, x + position->x_offset) : x + position->x_offset,
-			 y + y_offset);
+			 is_rtl ? get_mirror_x_position (container, icon, x + icon->layout_x_offset) : x + icon->layout_x_offset,
+			 y + icon->layout_y_offset);
 		nautilus_canvas_item_set_entire_text (icon->item, whole_text);
 
 		icon->saved_ltr_x = is_rtl ? get_mirror_x_position (container, icon, icon->x) : icon->x;
 
-		x += position->width;
+		x += icon->layout_width;
 	}
 }
 
+/* Lays out @icons a line at a time. When laying out all the icons of the
+ * container the rows are remembered, so that the next layout can start at
+ * the row of the first changed icon and leave alone the rows that keep
+ * the same icons at the same place, e.g. on a resize that doesn't change
+ * the number of icons per row.
+ */
 static void
 lay_down_icons_horizontal (NautilusCanvasContainer *container,
 			     GList *icons,
 			     double start_y)
 {
+	NautilusCanvasContainerDetails *details;
 	GList *p, *line_start;
 	NautilusCanvasIcon *icon;
+	NautilusCanvasLayoutRow row, *old_row;
+	GArray *old_rows, *rows;
 	double canvas_width, y;
-	GArray *positions;
-	IconPositions *position;
-	EelDRect bounds;
-	EelDRect icon_bounds;
 	double max_height_above, max_height_below;
-	double height_above, height_below;
 	double line_width;
 	double grid_width;
-	int icon_width, icon_size;
-	int i;
+	int icon_size;
+	int position;
+	gboolean icon_changed, row_changed;
 	GtkAllocation allocation;
 
 	g_assert (NAUTILUS_IS_CANVAS_CONTAINER (container));
 
+	details = container->details;
+
+	/* Only the layout of all the icons is remembered, subsets of them
+	 * are always laid out from scratch.
+	 */
+	old_rows = NULL;
+	rows = NULL;
+	if (icons == details->icons) {
+		old_rows = details->layout_rows;
+		details->layout_rows = NULL;
+	}
+
 	if (icons == NULL) {
+		if (old_rows != NULL) {
+			g_array_free (old_rows, TRUE);
+		}
 		return;
 	}
 
-	positions = g_array_new (FALSE, FALSE, sizeof (IconPositions));
 	gtk_widget_get_allocation (GTK_WIDGET (container), &allocation);
-	
+
 	/* Lay out icons a line at a time. */
 	canvas_width = CANVAS_WIDTH(container, allocation);
 
-	grid_width = nautilus_canvas_container_get_grid_size_for_zoom_level (container->details->zoom_level);
-	icon_size = nautilus_canvas_container_get_icon_size_for_zoom_level (container->details->zoom_level);
+	grid_width = nautilus_canvas_container_get_grid_size_for_zoom_level (details->zoom_level);
+	icon_size = nautilus_canvas_container_get_icon_size_for_zoom_level (details->zoom_level);
 
-	line_width = 0;
 	line_start = icons;
 	y = start_y + CONTAINER_PAD_TOP;
-	i = 0;
-	
+	position = 0;
+
+	if (icons == details->icons) {
+		rows = g_array_new (FALSE, FALSE, sizeof (NautilusCanvasLayoutRow));
+
+		/* Mirrored positions depend on the canvas width. */
+		if (old_rows != NULL &&
+		    canvas_width != details->layout_canvas_width &&
+		    nautilus_canvas_container_is_layout_rtl (container)) {
+			g_array_free (old_rows, TRUE);
+			old_rows = NULL;
+		}
+
+		/* The rows before the first changed icon stay as they are,
+		 * unless the line breaks move with the canvas width.
+		 */
+		if (old_rows != NULL &&
+		    canvas_width == details->layout_canvas_width) {
+			guint first_row;
+
+			first_row = layout_rows_find (old_rows,
+						      get_first_changed_icon_position (container));
+			old_row = &g_array_index (old_rows, NautilusCanvasLayoutRow, first_row);
+
+			g_array_append_vals (rows, old_rows->data, first_row);
+			line_start = g_list_nth (icons, old_row->first);
+			y = old_row->y;
+			position = old_row->first;
+		}
+	}
+
+	row.first = position;
+	row_changed = FALSE;
+	line_width = 0;
 	max_height_above = 0;
 	max_height_below = 0;
-	for (p = icons; p != NULL; p = p->next) {
+	for (p = line_start; p != NULL; p = p->next, position++) {
 		icon = p->data;
 
-		/* Assume it's only one level hierarchy to avoid costly affine calculations */
-		nautilus_canvas_item_get_bounds_for_layout (icon->item,
-							    &bounds.x0, &bounds.y0,
-							    &bounds.x1, &bounds.y1);
+		icon_changed = !icon->layout_metrics_valid ||
+			icon->layout_position != position ||
+			!icon_is_positioned (icon);
+		icon->layout_position = position;
 
-		/* Normalize the icon width to the grid unit.
-		 * Use the icon size for this zoom level too in the calculation, since
-		 * the actual bounds might be smaller - e.g. because we have a very
-		 * narrow thumbnail.
-		 */
-		icon_width = ceil (MAX ((bounds.x1 - bounds.x0), icon_size) / grid_width) * grid_width;
-
-		/* Calculate size above/below baseline */
-		icon_bounds = nautilus_canvas_item_get_icon_rectangle (icon->item);
-		height_above = icon_bounds.y1 - bounds.y0;
-		height_below = bounds.y1 - icon_bounds.y1;
+		icon_get_layout_metrics (container, icon, grid_width, icon_size);
 
 		/* If this icon doesn't fit, it's time to lay out the line that's queued up. */
-		if (line_start != p && line_width + icon_width >= canvas_width ) {
+		if (line_start != p && line_width + icon->layout_width >= canvas_width ) {
+			row.n_icons = position - row.first;
+			row.y = y;
+
 			/* Advance to the baseline. */
 			y += ICON_PAD_TOP + max_height_above;
 
-			lay_down_one_line (container, line_start, p, y, max_height_above, positions, FALSE);
+			if (row_changed || rows == NULL ||
+			    !layout_row_is_unchanged (old_rows, rows->len, &row)) {
+				lay_down_one_line (container, line_start, p, y, max_height_above, FALSE);
+			}
 
 			/* Advance to next line. */
 			y += max_height_below + ICON_PAD_BOTTOM;
 
+			if (rows != NULL) {
+				g_array_append_val (rows, row);
+			}
+
 			line_width = 0;
 			line_start = p;
-			i = 0;
-			
-			max_height_above = height_above;
-			max_height_below = height_below;
+			row.first = position;
+			row_changed = icon_changed;
+
+			max_height_above = icon->layout_height_above;
+			max_height_below = icon->layout_height_below;
 		} else {
-			if (height_above > max_height_above) {
-				max_height_above = height_above;
+			row_changed |= icon_changed;
+
+			if (icon->layout_height_above > max_height_above) {
+				max_height_above = icon->layout_height_above;
 			}
-			if (height_below > max_height_below) {
-				max_height_below = height_below;
+			if (icon->layout_height_below > max_height_below) {
+				max_height_below = icon->layout_height_below;
 			}
 		}
-		
-		g_array_set_size (positions, i + 1);
-		position = &g_array_index (positions, IconPositions, i++);
-		position->width = icon_width;
-		position->height = icon_bounds.y1 - icon_bounds.y0;
-
-		position->x_offset = (icon_width - (icon_bounds.x1 - icon_bounds.x0)) / 2;
-		position->y_offset = icon_bounds.y0 - icon_bounds.y1;
 
 		/* Add this icon. */
-		line_width += icon_width;
+		line_width += icon->layout_width;
 	}
 
 	/* Lay down that last line of icons. */
 	if (line_start != NULL) {
+		row.n_icons = position - row.first;
+		row.y = y;
+
 		/* Advance to the baseline. */
 		y += ICON_PAD_TOP + max_height_above;
 
-		lay_down_one_line (container, line_start, NULL, y, max_height_above, positions, TRUE);
+		lay_down_one_line (container, line_start, NULL, y, max_height_above, TRUE);
+
+		if (rows != NULL) {
+			g_array_append_val (rows, row);
+		}
+	}
+
+	if (old_rows != NULL) {
+		g_array_free (old_rows, TRUE);
 	}
 
-	g_array_free (positions, TRUE);
+	if (rows != NULL) {
+		details->layout_rows = rows;
+		details->layout_canvas_width = canvas_width;
+	}
 }
 
 static void
@@ -1953,8 +2116,8 @@ redo_layout_callback (gpointer callback_data)
 	NautilusCanvasContainer *container;
 
 	container = NAUTILUS_CANVAS_CONTAINER (callback_data);
-	redo_layout_internal (container);
 	container->details->idle_id = 0;
+	redo_layout_internal (container);
 
 	return FALSE;
 }
@@ -2055,11 +2218,15 @@ invalidate_label_sizes (NautilusCanvasContainer *container)
 {
 	GList *p;
 	NautilusCanvasIcon *icon;
-	
+
+	g_hash_table_remove_all (container->details->label_size_cache);
+	invalidate_layout_rows (container);
+
 	for (p = container->details->icons; p != NULL; p = p->next) {
 		icon = p->data;
 
-		nautilus_canvas_item_invalidate_label_size (icon->item);		
+		nautilus_canvas_item_invalidate_label_size (icon->item);
+		icon->layout_metrics_valid = FALSE;
 	}
 }
 
@@ -3756,6 +3923,9 @@ finalize (GObject *object)
 	g_hash_table_destroy (details->icon_set);
 	details->icon_set = NULL;
 
+	g_hash_table_destroy (details->label_size_cache);
+	invalidate_layout_rows (NAUTILUS_CANVAS_CONTAINER (object));
+
 	g_free (details->font);
 
 	if (details->a11y_item_action_queue != NULL) {
@@ -3945,6 +4115,11 @@ nautilus_canvas_container_request_update_all_internal (NautilusCanvasContainer *
 
 	g_return_if_fail (NAUTILUS_IS_CANVAS_CONTAINER (container));
 
+	if (invalidate_labels) {
+		g_hash_table_remove_all (container->details->label_size_cache);
+		invalidate_layout_rows (container);
+	}
+
 	for (node = container->details->icons; node != NULL; node = node->next) {
 		icon = node->data;
 
@@ -5219,6 +5394,8 @@ nautilus_canvas_container_init (NautilusCanvasContainer *container)
 	details = g_new0 (NautilusCanvasContainerDetails, 1);
 
 	details->icon_set = g_hash_table_new (g_direct_hash, g_direct_equal);
+	details->label_size_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+							   g_free, g_free);
 	details->layout_timestamp = UNDEFINED_TIME;
 	details->zoom_level = NAUTILUS_CANVAS_ZOOM_LEVEL_STANDARD;
 
@@ -5476,6 +5653,9 @@ nautilus_canvas_container_clear (NautilusCanvasContainer *container)
 
  	g_hash_table_destroy (details->icon_set);
  	details->icon_set = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	g_hash_table_remove_all (details->label_size_cache);
+	invalidate_layout_rows (container);
  
 	nautilus_canvas_container_update_scroll_region (container);
 }
@@ -5814,16 +5994,56 @@ nautilus_canvas_container_prioritize_thumbnailing (NautilusCanvasContainer *cont
 	klass->prioritize_thumbnailing (container, icon->data);
 }
 
+/* Loads or unloads the image of an icon in a virtualized container.
+ * Returns whether the icon changed its size.
+ */
+static gboolean
+icon_set_loaded (NautilusCanvasContainer *container,
+		 NautilusCanvasIcon *icon,
+		 gboolean loaded)
+{
+	EelDRect old_bounds, new_bounds;
+	gboolean layout_metrics_valid;
+
+	if (icon->is_loaded == loaded) {
+		return FALSE;
+	}
+
+	icon->is_loaded = loaded;
+
+	if (!loaded) {
+		nautilus_canvas_item_unload (icon->item);
+		return FALSE;
+	}
+
+	layout_metrics_valid = icon->layout_metrics_valid;
+	old_bounds = nautilus_canvas_item_get_icon_rectangle (icon->item);
+
+	nautilus_canvas_container_update_icon (container, icon);
+
+	new_bounds = nautilus_canvas_item_get_icon_rectangle (icon->item);
+	if (new_bounds.x1 - new_bounds.x0 != old_bounds.x1 - old_bounds.x0 ||
+	    new_bounds.y1 - new_bounds.y0 != old_bounds.y1 - old_bounds.y0) {
+		return TRUE;
+	}
+
+	/* Same size, the icon doesn't need to be laid out again. */
+	icon->layout_metrics_valid = layout_metrics_valid;
+
+	return FALSE;
+}
+
 static void
 nautilus_canvas_container_update_visible_icons (NautilusCanvasContainer *container)
 {
 	GtkAdjustment *vadj, *hadj;
 	double min_y, max_y;
 	double min_x, max_x;
+	double margin_x, margin_y;
 	double x0, y0, x1, y1;
 	GList *node;
 	NautilusCanvasIcon *icon;
-	gboolean visible;
+	gboolean visible, near_visible, size_changed;
 	GtkAllocation allocation;
 
 	hadj = gtk_scrollable_get_hadjustment (GTK_SCROLLABLE (container));
@@ -5840,6 +6060,13 @@ nautilus_canvas_container_update_visible_icons (NautilusCanvasContainer *contain
 			min_x, min_y, &min_x, &min_y);
 	eel_canvas_c2w (EEL_CANVAS (container),
 			max_x, max_y, &max_x, &max_y);
+
+	/* Keep a page worth of icons loaded on each side, so that they
+	 * are ready when scrolled into view.
+	 */
+	margin_x = max_x - min_x;
+	margin_y = max_y - min_y;
+	size_changed = FALSE;
 	
 	/* Do the iteration in reverse to get the render-order from top to
 	 * bottom for the prioritized thumbnails.
@@ -5862,8 +6089,15 @@ nautilus_canvas_container_update_visible_icons (NautilusCanvasContainer *contain
 
 			if (nautilus_canvas_container_is_layout_vertical (container)) {
 				visible = x1 >= min_x && x0 <= max_x;
+				near_visible = x1 >= min_x - margin_x && x0 <= max_x + margin_x;
 			} else {
 				visible = y1 >= min_y && y0 <= max_y;
+				near_visible = y1 >= min_y - margin_y && y0 <= max_y + margin_y;
+			}
+
+			if (container->details->is_virtualized &&
+			    icon_set_loaded (container, icon, near_visible)) {
+				size_changed = TRUE;
 			}
 
 			if (visible) {
@@ -5875,6 +6109,11 @@ nautilus_canvas_container_update_visible_icons (NautilusCanvasContainer *contain
 			}
 		}
 	}
+
+	/* Loaded images can be smaller than the nominal size, e.g. thumbnails. */
+	if (size_changed) {
+		schedule_redo_layout (container);
+	}
 }
 
 static void
@@ -5923,14 +6162,24 @@ nautilus_canvas_container_update_icon (NautilusCanvasContainer *container,
 	icon_size = MAX (icon_size, min_image_size);
 	icon_size = MIN (icon_size, max_image_size);
 
-	DEBUG ("Icon size, getting for size %d", icon_size);
+	/* Lay out icons far from the visible area with the nominal size,
+	 * their images get loaded when they come close to it.
+	 */
+	pixbuf = NULL;
+	if (!details->is_virtualized) {
+		icon->is_loaded = TRUE;
+	}
 
-	/* Get the icons. */
-	icon_info = nautilus_canvas_container_get_icon_images (container, icon->data, icon_size,
-							       icon == details->drop_target);
+	if (icon->is_loaded) {
+		DEBUG ("Icon size, getting for size %d", icon_size);
 
-	pixbuf = nautilus_icon_info_get_pixbuf (icon_info);
-	g_object_unref (icon_info);
+		/* Get the icons. */
+		icon_info = nautilus_canvas_container_get_icon_images (container, icon->data, icon_size,
+								       icon == details->drop_target);
+
+		pixbuf = nautilus_icon_info_get_pixbuf (icon_info);
+		g_object_unref (icon_info);
+	}
  
 	nautilus_canvas_container_get_icon_text (container,
 						   icon->data,
@@ -5944,10 +6193,15 @@ nautilus_canvas_container_update_icon (NautilusCanvasContainer *container,
 			     "highlighted_for_drop", icon == details->drop_target,
 			     NULL);
 
-	nautilus_canvas_item_set_image (icon->item, pixbuf);
+	if (pixbuf != NULL) {
+		nautilus_canvas_item_set_image (icon->item, pixbuf);
 
-	/* Let the pixbufs go. */
-	g_object_unref (pixbuf);
+		/* Let the pixbufs go. */
+		g_object_unref (pixbuf);
+	} else {
+		nautilus_canvas_item_set_placeholder_size (icon->item, icon_size);
+	}
+	icon->layout_metrics_valid = FALSE;
 
 	g_free (editable_text);
 	g_free (additional_text);
@@ -6956,6 +7210,7 @@ nautilus_canvas_container_set_auto_layout (NautilusCanvasContainer *container,
 
 	reset_scroll_region_if_not_empty (container);
 	container->details->auto_layout = auto_layout;
+	invalidate_layout_rows (container);
 
 	if (!auto_layout) {
 		reload_icon_positions (container);
@@ -7112,6 +7367,47 @@ nautilus_canvas_container_get_is_desktop (NautilusCanvasContainer *container)
 	return container->details->is_desktop;
 }
 
+gboolean
+nautilus_canvas_container_get_is_virtualized (NautilusCanvasContainer *container)
+{
+	g_return_val_if_fail (NAUTILUS_IS_CANVAS_CONTAINER (container), FALSE);
+
+	return container->details->is_virtualized;
+}
+
+/**
+ * nautilus_canvas_container_set_is_virtualized:
+ * @container: A NautilusCanvasContainer.
+ * @is_virtualized: Whether to only load the icons close to the visible area.
+ *
+ * In a virtualized container the images and text layouts of the icons are
+ * only held while the icons are within a page of the visible area, so
+ * that memory use doesn't grow with the size of the directory.
+ **/
+void
+nautilus_canvas_container_set_is_virtualized (NautilusCanvasContainer *container,
+					      gboolean is_virtualized)
+{
+	GList *p;
+
+	g_return_if_fail (NAUTILUS_IS_CANVAS_CONTAINER (container));
+
+	is_virtualized = is_virtualized != FALSE;
+	if (container->details->is_virtualized == is_virtualized) {
+		return;
+	}
+
+	container->details->is_virtualized = is_virtualized;
+
+	if (!is_virtualized) {
+		for (p = container->details->icons; p != NULL; p = p->next) {
+			icon_set_loaded (container, p->data, TRUE);
+		}
+	}
+
+	schedule_redo_layout (container);
+}
+
 void
 nautilus_canvas_container_set_is_desktop (NautilusCanvasContainer *container,
 					  gboolean is_desktop)
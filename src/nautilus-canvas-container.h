@@ -289,6 +289,9 @@ void              nautilus_canvas_container_set_is_fixed_size             (Nauti
 gboolean          nautilus_canvas_container_get_is_desktop                (NautilusCanvasContainer  *container);
 void              nautilus_canvas_container_set_is_desktop                (NautilusCanvasContainer  *container,
 									   gboolean                is_desktop);
+gboolean          nautilus_canvas_container_get_is_virtualized            (NautilusCanvasContainer  *container);
+void              nautilus_canvas_container_set_is_virtualized            (NautilusCanvasContainer  *container,
+									   gboolean                is_virtualized);
 void              nautilus_canvas_container_reset_scroll_region           (NautilusCanvasContainer  *container);
 void              nautilus_canvas_container_set_font                      (NautilusCanvasContainer  *container,
 									   const char             *font); 
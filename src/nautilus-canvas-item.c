@@ -52,6 +52,10 @@
 #define TEXT_BACK_PADDING_X 4
 #define TEXT_BACK_PADDING_Y 1
 
+/* Room around the text rectangle in the rendered label surface, for
+ * frames and shadows drawn outside of it */
+#define LABEL_SURFACE_PADDING 4
+
 /* Width of the label, keep in sync with ICON_GRID_WIDTH at nautilus-canvas-container.c */
 #define MAX_TEXT_WIDTH_SMALL 116
 #define MAX_TEXT_WIDTH_STANDARD 104
@@ -80,6 +84,16 @@ struct NautilusCanvasItemDetails {
 	double x, y;
 	GdkPixbuf *pixbuf;
 	cairo_surface_t *rendered_surface;
+
+	/* Size of the image in device pixels while pixbuf is not loaded. */
+	int image_width;
+	int image_height;
+
+	/* Label as last drawn, and the state it was drawn for */
+	cairo_surface_t *rendered_label_surface;
+	GtkStateFlags rendered_label_state;
+	EelIRect rendered_label_rect;
+
 	char *editable_text;		/* Text that can be modified by a renaming function */
 	char *additional_text;		/* Text that cannot be modifed, such as file size, etc. */
 	
@@ -114,6 +128,9 @@ struct NautilusCanvasItemDetails {
 	guint rendered_is_highlighted_for_clipboard : 1;
 	guint rendered_is_prelit : 1;
 	guint rendered_is_focused : 1;
+
+	guint rendered_label_is_highlighted : 1;
+	guint rendered_label_is_prelit : 1;
 	
 	guint bounds_cached : 1;
 	
@@ -216,6 +233,10 @@ nautilus_canvas_item_finalize (GObject *object)
 		cairo_surface_destroy (details->rendered_surface);
 	}
 
+	if (details->rendered_label_surface != NULL) {
+		cairo_surface_destroy (details->rendered_label_surface);
+	}
+
 	if (details->editable_text_layout != NULL) {
 		g_object_unref (details->editable_text_layout);
 	}
@@ -258,6 +279,10 @@ nautilus_canvas_item_invalidate_label_size (NautilusCanvasItem *item)
 	if (item->details->additional_text_layout != NULL) {
 		pango_layout_context_changed (item->details->additional_text_layout);
 	}
+	if (item->details->rendered_label_surface != NULL) {
+		cairo_surface_destroy (item->details->rendered_label_surface);
+		item->details->rendered_label_surface = NULL;
+	}
 	nautilus_canvas_item_invalidate_bounds_cache (item);
 	item->details->text_width = -1;
 	item->details->text_height = -1;
@@ -414,18 +439,27 @@ get_scaled_icon_size (NautilusCanvasItem *item,
 {
 	EelCanvas *canvas;
 	GdkPixbuf *pixbuf = NULL;
-	gint scale;
+	gint image_width = 0;
+	gint image_height = 0;
+	gint scale = 1;
 
 	if (item != NULL) {
 		canvas = EEL_CANVAS_ITEM (item)->canvas;
 		scale = gtk_widget_get_scale_factor (GTK_WIDGET (canvas));
 		pixbuf = item->details->pixbuf;
+		image_width = item->details->image_width;
+		image_height = item->details->image_height;
+	}
+
+	if (pixbuf != NULL) {
+		image_width = gdk_pixbuf_get_width (pixbuf);
+		image_height = gdk_pixbuf_get_height (pixbuf);
 	}
 
 	if (width)
-		*width = (pixbuf == NULL) ? 0 : (gdk_pixbuf_get_width (pixbuf) / scale);
+		*width = image_width / scale;
 	if (height)
-		*height = (pixbuf == NULL) ? 0 : (gdk_pixbuf_get_height (pixbuf) / scale);
+		*height = image_height / scale;
 }
 
 void
@@ -454,11 +488,77 @@ nautilus_canvas_item_set_image (NautilusCanvasItem *item,
 	}
 
 	details->pixbuf = image;
+	details->image_width = 0;
+	details->image_height = 0;
 			
 	nautilus_canvas_item_invalidate_bounds_cache (item);
 	eel_canvas_item_request_update (EEL_CANVAS_ITEM (item));	
 }
 
+/* Makes an item without image take up the space of a square image of
+ * @size, so that it can be laid out before the image is loaded.
+ */
+void
+nautilus_canvas_item_set_placeholder_size (NautilusCanvasItem *item,
+					   guint size)
+{
+	NautilusCanvasItemDetails *details;
+	int image_size;
+
+	g_return_if_fail (NAUTILUS_IS_CANVAS_ITEM (item));
+
+	details = item->details;
+	image_size = size * gtk_widget_get_scale_factor (GTK_WIDGET (EEL_CANVAS_ITEM (item)->canvas));
+
+	if (details->pixbuf != NULL) {
+		g_object_unref (details->pixbuf);
+		details->pixbuf = NULL;
+	}
+	if (details->rendered_surface != NULL) {
+		cairo_surface_destroy (details->rendered_surface);
+		details->rendered_surface = NULL;
+	}
+
+	if (details->image_width == image_size &&
+	    details->image_height == image_size) {
+		return;
+	}
+
+	details->image_width = image_size;
+	details->image_height = image_size;
+
+	nautilus_canvas_item_invalidate_bounds_cache (item);
+	eel_canvas_item_request_update (EEL_CANVAS_ITEM (item));
+}
+
+/* Drops the image and the text layouts of an item far away from the
+ * visible area. The item keeps taking up the same space, until it gets
+ * a new image.
+ */
+void
+nautilus_canvas_item_unload (NautilusCanvasItem *item)
+{
+	NautilusCanvasItemDetails *details;
+
+	g_return_if_fail (NAUTILUS_IS_CANVAS_ITEM (item));
+
+	details = item->details;
+
+	if (details->pixbuf != NULL) {
+		details->image_width = gdk_pixbuf_get_width (details->pixbuf);
+		details->image_height = gdk_pixbuf_get_height (details->pixbuf);
+		g_object_unref (details->pixbuf);
+		details->pixbuf = NULL;
+	}
+
+	if (details->rendered_surface != NULL) {
+		cairo_surface_destroy (details->rendered_surface);
+		details->rendered_surface = NULL;
+	}
+
+	nautilus_canvas_item_invalidate_label (item);
+}
+
 /* Recomputes the bounding box of a canvas item.
  * This is a generic implementation that could be used for any canvas item
  * class, it has no assumptions about how the item is used.
@@ -720,24 +820,33 @@ prepare_pango_layout_for_measure_entire_text (NautilusCanvasItem *item,
 	pango_layout_set_height (layout, G_MININT);
 }
 
+/* Whether the displayed label is not limited to the layout lines. */
+static gboolean
+label_shows_entire_text (NautilusCanvasItem *item)
+{
+	NautilusCanvasItemDetails *details;
+	gboolean needs_highlight;
+
+	details = item->details;
+
+	needs_highlight = details->is_highlighted_for_selection || details->is_highlighted_for_drop;
+
+	return needs_highlight ||
+		details->is_highlighted_as_keyboard_focus ||
+		details->entire_text;
+}
+
 static void
 prepare_pango_layout_for_draw (NautilusCanvasItem *item,
 			       PangoLayout *layout)
 {
-	NautilusCanvasItemDetails *details;
 	NautilusCanvasContainer *container;
-	gboolean needs_highlight;
 
 	prepare_pango_layout_width (item, layout);
 
 	container = NAUTILUS_CANVAS_CONTAINER (EEL_CANVAS_ITEM (item)->canvas);
-	details = item->details;
-
-	needs_highlight = details->is_highlighted_for_selection || details->is_highlighted_for_drop;
 
-	if (needs_highlight ||
-	    details->is_highlighted_as_keyboard_focus ||
-	    details->entire_text) {
+	if (label_shows_entire_text (item)) {
 		/* VOODOO-TODO, cf. compute_text_rectangle() */
 		pango_layout_set_height (layout, G_MININT);
 	} else {
@@ -750,11 +859,76 @@ prepare_pango_layout_for_draw (NautilusCanvasItem *item,
 	}
 }
 
+/* The measured label size only depends on the texts, the zoom level,
+ * the available width and whether the whole text is displayed. The font
+ * and the layout line limit are the same for the whole container, which
+ * drops all the cached sizes when they change.
+ */
+static char *
+get_label_size_cache_key (NautilusCanvasItem *item)
+{
+	NautilusCanvasItemDetails *details;
+	NautilusCanvasContainer *container;
+	const char *editable_text;
+
+	details = item->details;
+	container = NAUTILUS_CANVAS_CONTAINER (EEL_CANVAS_ITEM (item)->canvas);
+	editable_text = details->editable_text != NULL ? details->editable_text : "";
+
+	return g_strdup_printf ("%d:%d:%d:%" G_GSIZE_FORMAT ":%s%s",
+				nautilus_canvas_container_get_zoom_level (container),
+				(int) floor (nautilus_canvas_item_get_max_text_width (item)),
+				label_shows_entire_text (item),
+				strlen (editable_text),
+				editable_text,
+				details->additional_text != NULL ? details->additional_text : "");
+}
+
+static void
+set_label_size (NautilusCanvasItemDetails     *details,
+		const NautilusCanvasLabelSize *size)
+{
+	details->text_width = size->text_width;
+	details->text_dx = size->text_dx;
+	details->text_height = size->text_height;
+	details->text_height_for_layout = size->text_height_for_layout;
+	details->text_height_for_entire_text = size->text_height_for_entire_text;
+	details->editable_text_height = size->editable_text_height;
+}
+
+static void
+cache_label_size (NautilusCanvasContainer   *container,
+		  char                      *key,
+		  NautilusCanvasItemDetails *details)
+{
+	GHashTable *cache;
+	NautilusCanvasLabelSize *size;
+
+	cache = container->details->label_size_cache;
+
+	/* Don't let sizes of renamed or removed files pile up. */
+	if (g_hash_table_size (cache) > 2 * g_hash_table_size (container->details->icon_set) + 256) {
+		g_hash_table_remove_all (cache);
+	}
+
+	size = g_new (NautilusCanvasLabelSize, 1);
+	size->text_width = details->text_width;
+	size->text_dx = details->text_dx;
+	size->text_height = details->text_height;
+	size->text_height_for_layout = details->text_height_for_layout;
+	size->text_height_for_entire_text = details->text_height_for_entire_text;
+	size->editable_text_height = details->editable_text_height;
+
+	g_hash_table_insert (cache, key, size);
+}
+
 static void
 measure_label_text (NautilusCanvasItem *item)
 {
 	NautilusCanvasItemDetails *details;
 	NautilusCanvasContainer *container;
+	const NautilusCanvasLabelSize *cached_size;
+	char *cache_key;
 	gint editable_height, editable_height_for_layout, editable_height_for_entire_text, editable_width, editable_dx;
 	gint additional_height, additional_width, additional_dx;
 	PangoLayout *editable_layout;
@@ -792,6 +966,19 @@ measure_label_text (NautilusCanvasItem *item)
 	return;
 #endif
 
+	container = NAUTILUS_CANVAS_CONTAINER (EEL_CANVAS_ITEM (item)->canvas);
+
+	/* Labels scrolled out of view lose their measured size, avoid
+	 * measuring them again with Pango when they come back.
+	 */
+	cache_key = get_label_size_cache_key (item);
+	cached_size = g_hash_table_lookup (container->details->label_size_cache, cache_key);
+	if (cached_size != NULL) {
+		set_label_size (details, cached_size);
+		g_free (cache_key);
+		return;
+	}
+
 	editable_width = 0;
 	editable_height = 0;
 	editable_height_for_layout = 0;
@@ -801,7 +988,6 @@ measure_label_text (NautilusCanvasItem *item)
 	additional_height = 0;
 	additional_dx = 0;
 
-	container = NAUTILUS_CANVAS_CONTAINER (EEL_CANVAS_ITEM (item)->canvas);	
 	editable_layout = NULL;
 	additional_layout = NULL;
 
@@ -867,6 +1053,8 @@ measure_label_text (NautilusCanvasItem *item)
 	/* extra to make it look nicer */
 	details->text_width += TEXT_BACK_PADDING_X*2;
 
+	cache_label_size (container, cache_key, details);
+
 	if (editable_layout) {
 		g_object_unref (editable_layout);
 	}
@@ -877,9 +1065,9 @@ measure_label_text (NautilusCanvasItem *item)
 }
 
 static void
-draw_label_text (NautilusCanvasItem *item,
-                 cairo_t *cr,
-		 EelIRect icon_rect)
+render_label_text (NautilusCanvasItem *item,
+		   cairo_t *cr,
+		   EelIRect icon_rect)
 {
 	NautilusCanvasItemDetails *details;
 	NautilusCanvasContainer *container;
@@ -1041,6 +1229,81 @@ draw_label_text (NautilusCanvasItem *item,
 	}
 }
 
+/* Draws the label from a surface rendered the last time it was drawn in
+ * the same state, so that repainting an item for a hover or selection
+ * change nearby doesn't lay out and render its text again.
+ */
+static void
+draw_label_text (NautilusCanvasItem *item,
+                 cairo_t *cr,
+		 EelIRect icon_rect)
+{
+	NautilusCanvasItemDetails *details;
+	GtkWidget *widget;
+	GtkStateFlags state;
+	gboolean needs_highlight;
+	EelIRect text_rect;
+	cairo_t *label_cr;
+	int width, height, scale;
+
+	details = item->details;
+
+	measure_label_text (item);
+	if (details->text_height == 0 ||
+	    details->text_width == 0) {
+		return;
+	}
+
+	/* Only one item has the focus, don't keep a surface around for it. */
+	if (details->is_highlighted_as_keyboard_focus) {
+		render_label_text (item, cr, icon_rect);
+		return;
+	}
+
+	widget = GTK_WIDGET (EEL_CANVAS_ITEM (item)->canvas);
+	state = gtk_widget_get_state_flags (widget);
+	needs_highlight = details->is_highlighted_for_selection || details->is_highlighted_for_drop;
+	text_rect = compute_text_rectangle (item, icon_rect, TRUE, BOUNDS_USAGE_FOR_DISPLAY);
+
+	if (details->rendered_label_surface == NULL ||
+	    details->rendered_label_state != state ||
+	    details->rendered_label_is_highlighted != needs_highlight ||
+	    details->rendered_label_is_prelit != details->is_prelit ||
+	    details->rendered_label_rect.x1 - details->rendered_label_rect.x0 != text_rect.x1 - text_rect.x0 ||
+	    details->rendered_label_rect.y1 - details->rendered_label_rect.y0 != text_rect.y1 - text_rect.y0) {
+		if (details->rendered_label_surface != NULL) {
+			cairo_surface_destroy (details->rendered_label_surface);
+		}
+
+		scale = gtk_widget_get_scale_factor (widget);
+		width = text_rect.x1 - text_rect.x0 + 2 * LABEL_SURFACE_PADDING;
+		height = text_rect.y1 - text_rect.y0 + 2 * LABEL_SURFACE_PADDING;
+
+		details->rendered_label_surface =
+			gdk_window_create_similar_image_surface (gtk_widget_get_window (widget),
+								 CAIRO_FORMAT_ARGB32,
+								 width * scale, height * scale,
+								 scale);
+
+		label_cr = cairo_create (details->rendered_label_surface);
+		cairo_translate (label_cr,
+				 LABEL_SURFACE_PADDING - text_rect.x0,
+				 LABEL_SURFACE_PADDING - text_rect.y0);
+		render_label_text (item, label_cr, icon_rect);
+		cairo_destroy (label_cr);
+
+		details->rendered_label_state = state;
+		details->rendered_label_is_highlighted = needs_highlight;
+		details->rendered_label_is_prelit = details->is_prelit;
+		details->rendered_label_rect = text_rect;
+	}
+
+	cairo_set_source_surface (cr, details->rendered_label_surface,
+				  text_rect.x0 - LABEL_SURFACE_PADDING,
+				  text_rect.y0 - LABEL_SURFACE_PADDING);
+	cairo_paint (cr);
+}
+
 void
 nautilus_canvas_item_set_is_visible (NautilusCanvasItem       *item,
 				     gboolean                      visible)
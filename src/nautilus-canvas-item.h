@@ -66,6 +66,9 @@ GType       nautilus_canvas_item_get_type                 (void);
 /* attributes */
 void        nautilus_canvas_item_set_image                (NautilusCanvasItem       *item,
 							   GdkPixbuf                *image);
+void        nautilus_canvas_item_set_placeholder_size     (NautilusCanvasItem       *item,
+							   guint                     size);
+void        nautilus_canvas_item_unload                   (NautilusCanvasItem       *item);
 cairo_surface_t* nautilus_canvas_item_get_drag_surface    (NautilusCanvasItem       *item);
 void        nautilus_canvas_item_set_emblems              (NautilusCanvasItem       *item,
 							   GList                    *emblem_pixbufs);
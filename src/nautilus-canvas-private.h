@@ -64,8 +64,50 @@ typedef struct {
 	eel_boolean_bit is_visible : 1;
 
 	eel_boolean_bit has_lazy_position : 1;
+
+	/* Whether the item holds its image. In a virtualized container
+	 * only the icons close to the visible area do.
+	 */
+	eel_boolean_bit is_loaded : 1;
+
+	/* Whether the layout metrics below are up to date. */
+	eel_boolean_bit layout_metrics_valid : 1;
+
+	/* Metrics used by the horizontal grid layout, cached so that
+	 * relayouts don't need to measure the item again.
+	 */
+	double layout_width;
+	double layout_height_above;
+	double layout_height_below;
+	double layout_x_offset;
+	double layout_y_offset;
+
+	/* Position in the view at the time of the last grid layout. */
+	int layout_position;
 } NautilusCanvasIcon;
 
+/* A row of the horizontal grid layout. */
+typedef struct {
+	/* Position of the first icon on the row. */
+	int first;
+	int n_icons;
+
+	/* Y coordinate the row starts at, before padding. */
+	double y;
+} NautilusCanvasLayoutRow;
+
+/* Label sizes measured by a canvas item, shared between all the items
+ * of a container that display the same text at the same zoom level.
+ */
+typedef struct {
+	int text_width;
+	int text_dx;
+	int text_height;
+	int text_height_for_layout;
+	int text_height_for_entire_text;
+	int editable_text_height;
+} NautilusCanvasLabelSize;
+
 
 /* Private NautilusCanvasContainer members. */
 
@@ -217,6 +259,9 @@ struct NautilusCanvasContainerDetails {
 	/* Is the container for a desktop window */
 	gboolean is_desktop;
 
+	/* Only load the icons close to the visible area */
+	gboolean is_virtualized;
+
 	/* Ignore the visible area the next time the scroll region is recomputed */
 	gboolean reset_scroll_region_trigger;
 	
@@ -230,6 +275,17 @@ struct NautilusCanvasContainerDetails {
 	int top_margin;
 	int bottom_margin;
 
+	/* Rows of the last horizontal layout of all the icons, and the canvas
+	 * width it was done for. Used to only relayout the rows that change.
+	 */
+	GArray *layout_rows;
+	double layout_canvas_width;
+
+	/* Label sizes keyed by text, zoom level and width; see
+	 * measure_label_text () in nautilus-canvas-item.c.
+	 */
+	GHashTable *label_size_cache;
+
 	/* a11y items used by canvas items */
 	guint a11y_item_action_idle_handler;
 	GQueue* a11y_item_action_queue;
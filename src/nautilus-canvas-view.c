@@ -1593,6 +1593,7 @@ initialize_canvas_container (NautilusCanvasView      *canvas_view,
 				   (gpointer *) &canvas_view->details->canvas_container);
 	
 	gtk_widget_set_can_focus (GTK_WIDGET (canvas_container), TRUE);
+	nautilus_canvas_container_set_is_virtualized (canvas_container, TRUE);
 	
 	g_signal_connect_object (canvas_container, "activate",	
 				 G_CALLBACK (canvas_container_activate_callback), canvas_view, 0);
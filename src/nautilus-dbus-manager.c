@@ -26,18 +26,36 @@
 #include "nautilus-generated.h"
 
 #include "nautilus-file-operations.h"
+#include "nautilus-progress-info.h"
+#include "nautilus-progress-info-manager.h"
 
 #define DEBUG_FLAG NAUTILUS_DEBUG_DBUS
 #include "nautilus-debug.h"
 
 #include <gio/gio.h>
 
+/* Minimum time between two OperationProgress signals for the same
+ * operation; the bus doesn't need every update the progress UI gets. */
+#define PROGRESS_SIGNAL_INTERVAL_USEC (500 * G_TIME_SPAN_MILLISECOND)
+
 struct _NautilusDBusManager {
   GObject parent;
 
   NautilusDBusFileOperations *file_operations;
+
+  /* handle -> Operation, for the operations started over the bus */
+  GHashTable *operations;
+  guint last_handle;
 };
 
+typedef struct {
+  NautilusDBusManager *self;
+  guint handle;
+
+  NautilusProgressInfo *info;
+  gint64 last_progress_time;
+} Operation;
+
 struct _NautilusDBusManagerClass {
   GObjectClass parent_class;
 };
@@ -54,9 +72,240 @@ nautilus_dbus_manager_dispose (GObject *object)
     self->file_operations = NULL;
   }
 
+  g_clear_pointer (&self->operations, g_hash_table_destroy);
+
   G_OBJECT_CLASS (nautilus_dbus_manager_parent_class)->dispose (object);
 }
 
+static void
+operation_free (Operation *op)
+{
+  g_signal_handlers_disconnect_by_data (op->info, op);
+  g_object_unref (op->info);
+
+  g_slice_free (Operation, op);
+}
+
+static void
+operation_emit_progress (Operation *op)
+{
+  guint64 files_done, files_total, bytes_done, bytes_total;
+  gdouble elapsed, files_per_second, bytes_per_second;
+
+  op->last_progress_time = g_get_monotonic_time ();
+
+  nautilus_progress_info_get_transferred (op->info,
+                                          &files_done, &files_total,
+                                          &bytes_done, &bytes_total);
+  elapsed = nautilus_progress_info_get_total_elapsed_time (op->info);
+
+  files_per_second = 0;
+  bytes_per_second = 0;
+  if (elapsed > 0) {
+    files_per_second = files_done / elapsed;
+    bytes_per_second = bytes_done / elapsed;
+  }
+
+  nautilus_dbus_file_operations_emit_operation_progress (op->self->file_operations,
+                                                         op->handle,
+                                                         files_done, files_total,
+                                                         bytes_done, bytes_total,
+                                                         files_per_second,
+                                                         bytes_per_second);
+}
+
+static void
+operation_progress_changed_cb (NautilusProgressInfo *info,
+                               Operation            *op)
+{
+  if (g_get_monotonic_time () - op->last_progress_time < PROGRESS_SIGNAL_INTERVAL_USEC)
+    return;
+
+  operation_emit_progress (op);
+}
+
+static void
+operation_finished_cb (NautilusProgressInfo *info,
+                       Operation            *op)
+{
+  DEBUG ("Operation %u finished", op->handle);
+
+  operation_emit_progress (op);
+  nautilus_dbus_file_operations_emit_operation_finished (op->self->file_operations,
+                                                         op->handle,
+                                                         nautilus_progress_info_get_is_cancelled (info));
+
+  /* frees op */
+  g_hash_table_remove (op->self->operations, GUINT_TO_POINTER (op->handle));
+}
+
+static void
+new_progress_info_cb (NautilusProgressInfoManager  *manager,
+                      NautilusProgressInfo         *info,
+                      NautilusProgressInfo        **info_out)
+{
+  if (*info_out == NULL)
+    *info_out = g_object_ref (info);
+}
+
+typedef enum {
+  OPERATION_MOVE,
+  OPERATION_LINK,
+  OPERATION_TRASH,
+  OPERATION_DELETE
+} OperationType;
+
+/* Starts the file operation and returns a handle for it, or 0 if no
+ * operation was started. The progress info of the job is created
+ * synchronously when the operation is started, which is how we find out
+ * which one it is.
+ */
+static guint
+start_operation (NautilusDBusManager  *self,
+                 OperationType         type,
+                 const gchar         **uris,
+                 const gchar          *destination)
+{
+  NautilusProgressInfoManager *manager;
+  NautilusProgressInfo *info = NULL;
+  GList *files = NULL;
+  GFile *dest_dir = NULL;
+  Operation *op;
+  gulong id;
+  gint idx;
+
+  for (idx = 0; uris[idx] != NULL; idx++)
+    files = g_list_prepend (files, g_file_new_for_uri (uris[idx]));
+  files = g_list_reverse (files);
+
+  if (files == NULL)
+    return 0;
+
+  if (destination != NULL)
+    dest_dir = g_file_new_for_uri (destination);
+
+  manager = nautilus_progress_info_manager_dup_singleton ();
+  id = g_signal_connect (manager, "new-progress-info",
+                         G_CALLBACK (new_progress_info_cb), &info);
+
+  switch (type) {
+  case OPERATION_MOVE:
+    nautilus_file_operations_move (files, NULL, dest_dir, NULL, NULL, NULL);
+    break;
+  case OPERATION_LINK:
+    nautilus_file_operations_link (files, NULL, dest_dir, NULL, NULL, NULL);
+    break;
+  case OPERATION_TRASH:
+    nautilus_file_operations_trash_or_delete (files, NULL, NULL, NULL);
+    break;
+  case OPERATION_DELETE:
+    nautilus_file_operations_delete (files, NULL, NULL, NULL);
+    break;
+  }
+
+  g_signal_handler_disconnect (manager, id);
+  g_object_unref (manager);
+  g_list_free_full (files, g_object_unref);
+  g_clear_object (&dest_dir);
+
+  if (info == NULL)
+    return 0;
+
+  op = g_slice_new0 (Operation);
+  op->self = self;
+  op->info = info;
+
+  /* 0 means no operation */
+  if (++self->last_handle == 0)
+    ++self->last_handle;
+  op->handle = self->last_handle;
+
+  g_signal_connect (info, "progress-changed",
+                    G_CALLBACK (operation_progress_changed_cb), op);
+  g_signal_connect (info, "finished",
+                    G_CALLBACK (operation_finished_cb), op);
+
+  g_hash_table_insert (self->operations, GUINT_TO_POINTER (op->handle), op);
+
+  DEBUG ("Operation %u started", op->handle);
+
+  return op->handle;
+}
+
+static gboolean
+handle_move_uris (NautilusDBusFileOperations *object,
+		  GDBusMethodInvocation *invocation,
+		  const gchar **sources,
+		  const gchar *destination,
+		  NautilusDBusManager *self)
+{
+  guint handle;
+
+  handle = start_operation (self, OPERATION_MOVE, sources, destination);
+
+  nautilus_dbus_file_operations_complete_move_uris (object, invocation, handle);
+  return TRUE; /* invocation was handled */
+}
+
+static gboolean
+handle_link_uris (NautilusDBusFileOperations *object,
+		  GDBusMethodInvocation *invocation,
+		  const gchar **sources,
+		  const gchar *destination,
+		  NautilusDBusManager *self)
+{
+  guint handle;
+
+  handle = start_operation (self, OPERATION_LINK, sources, destination);
+
+  nautilus_dbus_file_operations_complete_link_uris (object, invocation, handle);
+  return TRUE; /* invocation was handled */
+}
+
+static gboolean
+handle_trash_uris (NautilusDBusFileOperations *object,
+		   GDBusMethodInvocation *invocation,
+		   const gchar **uris,
+		   NautilusDBusManager *self)
+{
+  guint handle;
+
+  handle = start_operation (self, OPERATION_TRASH, uris, NULL);
+
+  nautilus_dbus_file_operations_complete_trash_uris (object, invocation, handle);
+  return TRUE; /* invocation was handled */
+}
+
+static gboolean
+handle_delete_uris (NautilusDBusFileOperations *object,
+		    GDBusMethodInvocation *invocation,
+		    const gchar **uris,
+		    NautilusDBusManager *self)
+{
+  guint handle;
+
+  handle = start_operation (self, OPERATION_DELETE, uris, NULL);
+
+  nautilus_dbus_file_operations_complete_delete_uris (object, invocation, handle);
+  return TRUE; /* invocation was handled */
+}
+
+static gboolean
+handle_cancel_operation (NautilusDBusFileOperations *object,
+			 GDBusMethodInvocation *invocation,
+			 guint handle,
+			 NautilusDBusManager *self)
+{
+  Operation *op;
+
+  op = g_hash_table_lookup (self->operations, GUINT_TO_POINTER (handle));
+  if (op != NULL)
+    nautilus_progress_info_cancel (op->info);
+
+  nautilus_dbus_file_operations_complete_cancel_operation (object, invocation);
+  return TRUE; /* invocation was handled */
+}
+
 static gboolean
 handle_copy_file (NautilusDBusFileOperations *object,
 		  GDBusMethodInvocation *invocation,
@@ -128,6 +377,8 @@ static void
 nautilus_dbus_manager_init (NautilusDBusManager *self)
 {
   self->file_operations = nautilus_dbus_file_operations_skeleton_new ();
+  self->operations = g_hash_table_new_full (NULL, NULL, NULL,
+                                            (GDestroyNotify) operation_free);
 
   g_signal_connect (self->file_operations,
 		    "handle-copy-uris",
@@ -141,6 +392,26 @@ nautilus_dbus_manager_init (NautilusDBusManager *self)
 		    "handle-empty-trash",
 		    G_CALLBACK (handle_empty_trash),
 		    self);
+  g_signal_connect (self->file_operations,
+		    "handle-move-uris",
+		    G_CALLBACK (handle_move_uris),
+		    self);
+  g_signal_connect (self->file_operations,
+		    "handle-link-uris",
+		    G_CALLBACK (handle_link_uris),
+		    self);
+  g_signal_connect (self->file_operations,
+		    "handle-trash-uris",
+		    G_CALLBACK (handle_trash_uris),
+		    self);
+  g_signal_connect (self->file_operations,
+		    "handle-delete-uris",
+		    G_CALLBACK (handle_delete_uris),
+		    self);
+  g_signal_connect (self->file_operations,
+		    "handle-cancel-operation",
+		    G_CALLBACK (handle_cancel_operation),
+		    self);
 }
 
 static void
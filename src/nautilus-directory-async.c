@@ -96,6 +96,7 @@ struct DirectoryLoadState {
 	GHashTable *load_mime_list_hash;
 	NautilusFile *load_directory_file;
 	int load_file_count;
+	gboolean load_in_thread;
 };
 
 struct MimeListState {
@@ -1931,6 +1932,69 @@ directory_load_state_free (DirectoryLoadState *state)
 	g_free (state);
 }
 
+static void
+file_info_list_free (gpointer list)
+{
+	g_list_free_full (list, g_object_unref);
+}
+
+static void
+load_more_files_thread (GTask *task,
+			gpointer source_object,
+			gpointer task_data,
+			GCancellable *cancellable)
+{
+	GFileEnumerator *enumerator;
+	GList *files, *l;
+	GError *error;
+
+	enumerator = source_object;
+
+	error = NULL;
+	files = g_file_enumerator_next_files (enumerator,
+					      DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
+					      cancellable, &error);
+	if (error != NULL) {
+		g_task_return_error (task, error);
+		return;
+	}
+
+	for (l = files; l != NULL; l = l->next) {
+		nautilus_file_precompute_info (l->data);
+	}
+
+	g_task_return_pointer (task, files, file_info_list_free);
+}
+
+static void more_files_callback (GObject *source_object,
+				 GAsyncResult *res,
+				 gpointer user_data);
+
+/* Local enumerators already read in a thread of their own, so for those
+ * we do it ourselves and get the CPU-heavy part of setting up the
+ * files done there as well.
+ */
+static void
+load_more_files (DirectoryLoadState *state)
+{
+	GTask *task;
+
+	if (!state->load_in_thread) {
+		g_file_enumerator_next_files_async (state->enumerator,
+						    DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
+						    G_PRIORITY_DEFAULT,
+						    state->cancellable,
+						    more_files_callback,
+						    state);
+		return;
+	}
+
+	task = g_task_new (state->enumerator, state->cancellable,
+			   more_files_callback, state);
+	g_task_run_in_thread (task, load_more_files_thread);
+	g_object_unref (task);
+}
+
 static void
 more_files_callback (GObject *source_object,
 		     GAsyncResult *res,
@@ -1956,8 +2020,12 @@ more_files_callback (GObject *source_object,
 	g_assert (directory->details->directory_load_in_progress == state);
 
 	error = NULL;
-	files = g_file_enumerator_next_files_finish (state->enumerator,
-						     res, &error);
+	if (state->load_in_thread) {
+		files = g_task_propagate_pointer (G_TASK (res), &error);
+	} else {
+		files = g_file_enumerator_next_files_finish (state->enumerator,
+							     res, &error);
+	}
 
 	for (l = files; l != NULL; l = l->next) {
 		info = l->data;
@@ -1969,12 +2037,7 @@ more_files_callback (GObject *source_object,
 		directory_load_done (directory, error);
 		directory_load_state_free (state);
 	} else {
-		g_file_enumerator_next_files_async (state->enumerator,
-						    DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
-						    G_PRIORITY_DEFAULT,
-						    state->cancellable,
-						    more_files_callback,
-						    state);
+		load_more_files (state);
 	}
 
 	nautilus_directory_unref (directory);
@@ -2014,12 +2077,7 @@ enumerate_children_callback (GObject *source_object,
 		return;
 	} else {
 		state->enumerator = enumerator;
-		g_file_enumerator_next_files_async (state->enumerator,
-						    DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
-						    G_PRIORITY_DEFAULT,
-						    state->cancellable,
-						    more_files_callback,
-						    state);
+		load_more_files (state);
 	}
 }
 
@@ -2054,6 +2112,7 @@ start_monitoring_file_list (NautilusDirectory *directory)
 	state->load_file_count = 0;
 	
 	g_assert (directory->details->location != NULL);
+	state->load_in_thread = g_file_is_native (directory->details->location);
         state->load_directory_file =
 		nautilus_directory_get_corresponding_file (directory);
 	state->load_directory_file->details->loading_directory = TRUE;
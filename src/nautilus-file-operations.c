@@ -31,7 +31,14 @@
 #include <math.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
 #include <stdlib.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 
 #include "nautilus-file-operations.h"
 
@@ -145,6 +152,13 @@ typedef struct {
 	guint32 file_mask;
 	guint32 dir_permissions;
 	guint32 dir_mask;
+
+	/* Local directories are handled in parallel, one directory per
+	 * task of the pool */
+	GThreadPool *pool;
+	GMutex mutex;
+	GCond cond;
+	guint n_pending_directories;
 } SetPermissionsJob;
 
 typedef enum {
@@ -1599,6 +1613,9 @@ report_delete_progress (CommonJob *job,
                                                          elapsed);
         }
 
+	nautilus_progress_info_set_transferred (job->progress,
+						transfer_info->num_files, source_info->num_files,
+						0, 0);
 	if (source_info->num_files != 0) {
 		nautilus_progress_info_set_progress (job->progress, transfer_info->num_files, source_info->num_files);
 	}
@@ -1995,6 +2012,9 @@ report_trash_progress (CommonJob    *job,
                                                          elapsed);
         }
 
+	nautilus_progress_info_set_transferred (job->progress,
+						transfer_info->num_files, source_info->num_files,
+						0, 0);
 	if (source_info->num_files != 0) {
 		nautilus_progress_info_set_progress (job->progress, transfer_info->num_files, source_info->num_files);
 	}
@@ -3391,6 +3411,9 @@ report_copy_progress (CopyMoveJob *copy_job,
                                                          elapsed);
         }
 
+	nautilus_progress_info_set_transferred (job->progress,
+						transfer_info->num_files, source_info->num_files,
+						transfer_info->num_bytes, total_size);
 	nautilus_progress_info_set_progress (job->progress, transfer_info->num_bytes, total_size);
 }
 
@@ -5207,6 +5230,9 @@ report_preparing_move_progress (CopyMoveJob *move_job, int total, int left)
 							  "Preparing to move %'d files",
 							  left), left));
 
+	nautilus_progress_info_set_transferred (job->progress,
+						total - left, total,
+						0, 0);
 	nautilus_progress_info_pulse_progress (job->progress);
 }
 
@@ -5251,6 +5277,35 @@ get_files_from_fallbacks (GList *fallbacks)
 	return g_list_reverse (res);
 }
 
+static void
+move_file_done (CopyMoveJob *move_job,
+		GFile *src,
+		GFile *dest,
+		GHashTable *debuting_files,
+		GdkPoint *position)
+{
+	CommonJob *job;
+
+	job = (CommonJob *)move_job;
+
+	if (debuting_files) {
+		g_hash_table_replace (debuting_files, g_object_ref (dest), GINT_TO_POINTER (TRUE));
+	}
+
+	nautilus_file_changes_queue_file_moved (src, dest);
+
+	if (position) {
+		nautilus_file_changes_queue_schedule_position_set (dest, *position, job->screen_num);
+	} else {
+		nautilus_file_changes_queue_schedule_position_remove (dest);
+	}
+
+	if (job->undo_info != NULL) {
+		nautilus_file_undo_info_ext_add_origin_target_pair (NAUTILUS_FILE_UNDO_INFO_EXT (job->undo_info),
+								    src, dest);
+	}
+}
+
 static void
 move_file_prepare (CopyMoveJob *move_job,
 		   GFile *src,
@@ -5328,24 +5383,8 @@ move_file_prepare (CopyMoveJob *move_job,
 			 NULL,
 			 NULL,
 			 &error)) {
-		
-		if (debuting_files) {
-			g_hash_table_replace (debuting_files, g_object_ref (dest), GINT_TO_POINTER (TRUE));
-		}
-
-		nautilus_file_changes_queue_file_moved (src, dest);
-
-		if (position) {
-			nautilus_file_changes_queue_schedule_position_set (dest, *position, job->screen_num);
-		} else {
-			nautilus_file_changes_queue_schedule_position_remove (dest);
-		}
-
-		if (job->undo_info != NULL) {
-			nautilus_file_undo_info_ext_add_origin_target_pair (NAUTILUS_FILE_UNDO_INFO_EXT (job->undo_info),
-									    src, dest);
-		}
-
+		move_file_done (move_job, src, dest, debuting_files, position);
+		g_object_unref (dest);
 		return;
 	}
 
@@ -5475,6 +5514,99 @@ move_file_prepare (CopyMoveJob *move_job,
 	g_object_unref (dest);
 }
 
+#define MOVE_PREPARE_PROGRESS_BATCH 100
+
+typedef struct {
+	GFile *src;
+	int index;
+} MovePrepareItem;
+
+static int
+rename_noreplace (int old_dir_fd,
+		  const char *old_name,
+		  int new_dir_fd,
+		  const char *new_name)
+{
+#ifdef SYS_renameat2
+	return syscall (SYS_renameat2, old_dir_fd, old_name,
+			new_dir_fd, new_name, 1 /* RENAME_NOREPLACE */);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/* Moves @src with a plain rename of a local file, when that's possible
+ * without any question to the user. Anything else, like a conflict or
+ * a move to another file system, is left to move_file_prepare(). */
+static gboolean
+move_file_prepare_native (CopyMoveJob *move_job,
+			  GFile *src,
+			  int dest_dir_fd,
+			  GHashTable *source_dir_fds,
+			  GdkPoint *position,
+			  gboolean *native_supported)
+{
+	GFile *dest;
+	char *path, *dir_path, *basename;
+	gpointer fd_data;
+	int dir_fd;
+	gboolean res;
+
+	path = g_file_get_path (src);
+	if (path == NULL) {
+		return FALSE;
+	}
+
+	/* Moving a folder into itself is an error to report */
+	if (test_dir_is_parent (move_job->destination, src)) {
+		g_free (path);
+		return FALSE;
+	}
+
+	dir_path = g_path_get_dirname (path);
+	basename = g_path_get_basename (path);
+	g_free (path);
+
+	if (g_hash_table_lookup_extended (source_dir_fds, dir_path, NULL, &fd_data)) {
+		dir_fd = GPOINTER_TO_INT (fd_data);
+		g_free (dir_path);
+	} else {
+		dir_fd = open (dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		g_hash_table_insert (source_dir_fds, dir_path, GINT_TO_POINTER (dir_fd));
+	}
+
+	res = FALSE;
+	if (dir_fd >= 0) {
+		if (rename_noreplace (dir_fd, basename, dest_dir_fd, basename) == 0) {
+			dest = g_file_get_child (move_job->destination, basename);
+			move_file_done (move_job, src, dest, move_job->debuting_files, position);
+			g_object_unref (dest);
+			res = TRUE;
+		} else if (errno == ENOSYS || errno == EINVAL) {
+			/* Not supported by the kernel or the file system */
+			*native_supported = FALSE;
+		}
+	}
+
+	g_free (basename);
+
+	return res;
+}
+
+static void
+close_source_dir_fd (gpointer key,
+		     gpointer value,
+		     gpointer user_data)
+{
+	int fd;
+
+	fd = GPOINTER_TO_INT (value);
+	if (fd >= 0) {
+		close (fd);
+	}
+}
+
 static void
 move_files_prepare (CopyMoveJob *job,
 		    const char *dest_fs_id,
@@ -5488,6 +5620,13 @@ move_files_prepare (CopyMoveJob *job,
 	int i;
 	GdkPoint *point;
 	int total, left;
+	GArray *items;
+	MovePrepareItem item;
+	GHashTable *source_dir_fds;
+	gboolean native_supported;
+	char *dest_path;
+	int dest_dir_fd;
+	guint n;
 
 	common = &job->common;
 
@@ -5495,6 +5634,20 @@ move_files_prepare (CopyMoveJob *job,
 
 	report_preparing_move_progress (job, total, left);
 
+	/* First rename all the local files that can be, with a directory fd
+	 * for each folder, so that only what needs more care is left */
+	items = g_array_new (FALSE, FALSE, sizeof (MovePrepareItem));
+	source_dir_fds = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	native_supported = *dest_fs_type == NULL;
+	dest_dir_fd = -1;
+	if (native_supported) {
+		dest_path = g_file_get_path (job->destination);
+		if (dest_path != NULL) {
+			dest_dir_fd = open (dest_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+			g_free (dest_path);
+		}
+	}
+
 	i = 0;
 	for (l = job->files;
 	     l != NULL && !job_aborted (common);
@@ -5507,6 +5660,41 @@ move_files_prepare (CopyMoveJob *job,
 			point = NULL;
 		}
 
+		if (dest_dir_fd >= 0 && native_supported &&
+		    move_file_prepare_native (job, src, dest_dir_fd, source_dir_fds,
+					      point, &native_supported)) {
+			left--;
+			if (left % MOVE_PREPARE_PROGRESS_BATCH == 0) {
+				report_preparing_move_progress (job, total, left);
+			}
+		} else {
+			item.src = src;
+			item.index = i;
+			g_array_append_val (items, item);
+		}
+		i++;
+	}
+
+	g_hash_table_foreach (source_dir_fds, close_source_dir_fd, NULL);
+	g_hash_table_destroy (source_dir_fds);
+	if (dest_dir_fd >= 0) {
+		close (dest_dir_fd);
+	}
+
+	report_preparing_move_progress (job, total, left);
+
+	/* Then the conflicts and everything else, asking about conflicts
+	 * one after the other, with a chance to apply the answer to all */
+	for (n = 0; n < items->len && !job_aborted (common); n++) {
+		item = g_array_index (items, MovePrepareItem, n);
+		src = item.src;
+
+		if (item.index < job->n_icon_positions) {
+			point = &job->icon_positions[item.index];
+		} else {
+			point = NULL;
+		}
+
 		
 		same_fs = FALSE;
 		if (dest_fs_id) {
@@ -5520,12 +5708,11 @@ move_files_prepare (CopyMoveJob *job,
 				   fallbacks,
 				   left);
 		report_preparing_move_progress (job, total, --left);
-		i++;
 	}
 
-	*fallbacks = g_list_reverse (*fallbacks);
+	g_array_free (items, TRUE);
 
-	
+	*fallbacks = g_list_reverse (*fallbacks);
 }
 
 static void
@@ -5749,6 +5936,9 @@ report_preparing_link_progress (CopyMoveJob *link_job, int total, int left)
 							  "Making links to %'d files",
 							  left), left));
 
+	nautilus_progress_info_set_transferred (job->progress,
+						total - left, total,
+						0, 0);
 	nautilus_progress_info_set_progress (job->progress, left, total);
 }
 
@@ -6202,6 +6392,177 @@ set_permissions_file (SetPermissionsJob *job,
 }
 
 
+/* Changes the mode of @name, relative to @dir_fd, and remembers the
+ * previous one for undo */
+static void
+set_permissions_native (SetPermissionsJob  *job,
+			int                 dir_fd,
+			const char         *dir_path,
+			const char         *name,
+			const struct stat  *statbuf,
+			GPtrArray          *undo_uris,
+			GArray             *undo_modes)
+{
+	guint32 current;
+	guint32 value;
+	char *path;
+
+	current = statbuf->st_mode;
+	if (S_ISDIR (statbuf->st_mode)) {
+		value = (current & ~job->dir_mask) | job->dir_permissions;
+	} else {
+		value = (current & ~job->file_mask) | job->file_permissions;
+	}
+
+	if (value == current ||
+	    fchmodat (dir_fd, name, value & 07777, 0) != 0) {
+		return;
+	}
+
+	if (job->common.undo_info != NULL) {
+		path = dir_path != NULL ? g_build_filename (dir_path, name, NULL) : g_strdup (name);
+		g_ptr_array_add (undo_uris, g_filename_to_uri (path, NULL, NULL));
+		g_array_append_val (undo_modes, current);
+		g_free (path);
+	}
+}
+
+static int
+open_directory_native (SetPermissionsJob *job,
+		       const char        *path,
+		       GPtrArray         *undo_uris,
+		       GArray            *undo_modes)
+{
+	struct stat statbuf;
+	int fd;
+
+	fd = open (path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd >= 0) {
+		if (fstat (fd, &statbuf) == 0) {
+			set_permissions_native (job, AT_FDCWD, NULL, path, &statbuf,
+						undo_uris, undo_modes);
+		}
+		return fd;
+	}
+
+	/* The directory might only be readable with its new permissions */
+	if (lstat (path, &statbuf) != 0 || !S_ISDIR (statbuf.st_mode)) {
+		return -1;
+	}
+	set_permissions_native (job, AT_FDCWD, NULL, path, &statbuf,
+				undo_uris, undo_modes);
+
+	return open (path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+}
+
+static void
+push_directory_native (SetPermissionsJob *job,
+		       char              *path)
+{
+	g_mutex_lock (&job->mutex);
+	job->n_pending_directories++;
+	g_mutex_unlock (&job->mutex);
+
+	g_thread_pool_push (job->pool, path, NULL);
+}
+
+static void
+set_permissions_directory_native (gpointer data,
+				  gpointer user_data)
+{
+	SetPermissionsJob *job;
+	CommonJob *common;
+	GPtrArray *undo_uris;
+	GArray *undo_modes;
+	struct dirent *entry;
+	struct stat statbuf;
+	DIR *dir;
+	char *path;
+	guint i;
+	int fd;
+
+	job = user_data;
+	common = (CommonJob *)job;
+	path = data;
+
+	undo_uris = g_ptr_array_new ();
+	undo_modes = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+	fd = -1;
+	if (!job_aborted (common)) {
+		fd = open_directory_native (job, path, undo_uris, undo_modes);
+	}
+
+	dir = fd >= 0 ? fdopendir (fd) : NULL;
+	if (dir == NULL && fd >= 0) {
+		close (fd);
+	}
+
+	while (dir != NULL && !job_aborted (common) &&
+	       (entry = readdir (dir)) != NULL) {
+		if (strcmp (entry->d_name, ".") == 0 ||
+		    strcmp (entry->d_name, "..") == 0) {
+			continue;
+		}
+
+		if (fstatat (fd, entry->d_name, &statbuf, AT_SYMLINK_NOFOLLOW) != 0) {
+			continue;
+		}
+
+		if (S_ISDIR (statbuf.st_mode)) {
+			/* Changed when it's opened by its own task */
+			push_directory_native (job, g_build_filename (path, entry->d_name, NULL));
+		} else if (!S_ISLNK (statbuf.st_mode)) {
+			set_permissions_native (job, fd, path, entry->d_name, &statbuf,
+						undo_uris, undo_modes);
+		}
+	}
+
+	if (dir != NULL) {
+		closedir (dir);
+	}
+
+	nautilus_progress_info_pulse_progress (common->progress);
+
+	g_mutex_lock (&job->mutex);
+	for (i = 0; i < undo_uris->len; i++) {
+		nautilus_file_undo_info_rec_permissions_add_uri (NAUTILUS_FILE_UNDO_INFO_REC_PERMISSIONS (common->undo_info),
+								 g_ptr_array_index (undo_uris, i),
+								 g_array_index (undo_modes, guint32, i));
+	}
+	if (--job->n_pending_directories == 0) {
+		g_cond_signal (&job->cond);
+	}
+	g_mutex_unlock (&job->mutex);
+
+	g_ptr_array_free (undo_uris, TRUE);
+	g_array_free (undo_modes, TRUE);
+	g_free (path);
+}
+
+static void
+set_permissions_recursive_native (SetPermissionsJob *job,
+				  char              *path)
+{
+	g_mutex_init (&job->mutex);
+	g_cond_init (&job->cond);
+	job->pool = g_thread_pool_new (set_permissions_directory_native, job,
+				       g_get_num_processors (), FALSE, NULL);
+
+	push_directory_native (job, path);
+
+	g_mutex_lock (&job->mutex);
+	while (job->n_pending_directories > 0) {
+		g_cond_wait (&job->cond, &job->mutex);
+	}
+	g_mutex_unlock (&job->mutex);
+
+	g_thread_pool_free (job->pool, FALSE, TRUE);
+	job->pool = NULL;
+	g_cond_clear (&job->cond);
+	g_mutex_clear (&job->mutex);
+}
+
 static void
 set_permissions_thread_func (GTask *task,
                              gpointer source_object,
@@ -6210,6 +6571,7 @@ set_permissions_thread_func (GTask *task,
 {
 	SetPermissionsJob *job = task_data;
 	CommonJob *common;
+	char *path;
 	
 	common = (CommonJob *)job;
 	
@@ -6218,7 +6580,21 @@ set_permissions_thread_func (GTask *task,
 
 	nautilus_progress_info_start (job->common.progress);
 
-	set_permissions_file (job, job->file, NULL);
+	/* Local trees are walked without GIO, and a directory at a time
+	 * in parallel. Not for remote locations that have a path through
+	 * the GVfs FUSE mount. */
+	path = NULL;
+	if (g_file_is_native (job->file) &&
+	    g_file_query_file_type (job->file, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+				    common->cancellable) == G_FILE_TYPE_DIRECTORY) {
+		path = g_file_get_path (job->file);
+	}
+
+	if (path != NULL) {
+		set_permissions_recursive_native (job, path);
+	} else {
+		set_permissions_file (job, job->file, NULL);
+	}
 }
 
 
@@ -41,6 +41,8 @@ typedef enum {
 	UNKNOWN
 } Knowledge;
 
+typedef struct NautilusFileMetadata NautilusFileMetadata;
+
 struct NautilusFileDetails
 {
 	NautilusDirectory *directory;
@@ -126,7 +128,7 @@ struct NautilusFileDetails
 	GHashTable *extension_attributes;
 	GHashTable *pending_extension_attributes;
 
-	GHashTable *metadata;
+	NautilusFileMetadata *metadata;
 
 	/* Mount for mountpoint or the references GMount for a "mountable" */
 	GMount *mount;
@@ -243,8 +245,13 @@ gboolean      nautilus_file_update_info                    (NautilusFile
 							    GFileInfo              *info);
 gboolean      nautilus_file_update_name                    (NautilusFile           *file,
 							    const char             *name);
+void          nautilus_file_precompute_info                (GFileInfo              *info);
 gboolean      nautilus_file_update_metadata_from_info      (NautilusFile           *file,
 							    GFileInfo              *info);
+gboolean      nautilus_file_update_metadata_key            (NautilusFile           *file,
+							    const char             *key,
+							    const char             *value,
+							    char                  **list_value);
 
 gboolean      nautilus_file_update_name_and_directory      (NautilusFile           *file,
 							    const char             *name,
@@ -24,6 +24,8 @@
 
 #include <config.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "nautilus-file-undo-operations.h"
 
@@ -324,28 +326,265 @@ file_undo_info_delete_callback (GHashTable *debuting_uris,
 				       user_cancel);
 }
 
+/* A list of uris kept as compact as possible, for operations on many files
+ * that can stay in the undo stack for a long time. Each uri is stored as the
+ * length of the prefix it shares with the previous one, followed by the rest
+ * of it. Once the journal grows big, it is moved to an unlinked temporary
+ * file and only read back when it's replayed. */
+#define UNDO_JOURNAL_SPILL_SIZE (4 * 1024 * 1024)
+
+typedef struct {
+	GByteArray *buffer;
+	GString *last_uri;
+	int spill_fd;
+	gsize spill_size;
+	gboolean spill_failed;
+} UndoJournal;
+
+typedef gboolean (* UndoJournalFunc) (const char *uri,
+				      gpointer    user_data);
+
+static void
+undo_journal_init (UndoJournal *journal)
+{
+	journal->buffer = g_byte_array_new ();
+	journal->last_uri = g_string_new (NULL);
+	journal->spill_fd = -1;
+	journal->spill_size = 0;
+	journal->spill_failed = FALSE;
+}
+
+static void
+undo_journal_clear (UndoJournal *journal)
+{
+	g_byte_array_free (journal->buffer, TRUE);
+	g_string_free (journal->last_uri, TRUE);
+	if (journal->spill_fd >= 0) {
+		close (journal->spill_fd);
+	}
+}
+
+static void
+append_varint (GByteArray *buffer,
+	       gsize       value)
+{
+	guint8 byte;
+
+	do {
+		byte = value & 0x7f;
+		value >>= 7;
+		if (value != 0) {
+			byte |= 0x80;
+		}
+		g_byte_array_append (buffer, &byte, 1);
+	} while (value != 0);
+}
+
+static gboolean
+read_varint (const guint8 **data,
+	     const guint8  *end,
+	     gsize         *value)
+{
+	guint8 byte;
+	guint shift;
+
+	*value = 0;
+	for (shift = 0; *data < end && shift < sizeof (gsize) * 8; shift += 7) {
+		byte = *(*data)++;
+		*value |= (gsize) (byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+static void
+undo_journal_spill (UndoJournal *journal)
+{
+	gsize written;
+	gssize res;
+
+	if (journal->spill_fd < 0) {
+		char *path;
+
+		journal->spill_fd = g_file_open_tmp ("nautilus-undo-XXXXXX", &path, NULL);
+		if (journal->spill_fd < 0) {
+			journal->spill_failed = TRUE;
+			return;
+		}
+
+		/* Only the fd is needed, and nothing is left behind on exit */
+		unlink (path);
+		g_free (path);
+	}
+
+	for (written = 0; written < journal->buffer->len; written += res) {
+		res = pwrite (journal->spill_fd,
+			      journal->buffer->data + written,
+			      journal->buffer->len - written,
+			      journal->spill_size + written);
+		if (res <= 0) {
+			/* Keep what's not fully in the file in memory */
+			journal->spill_failed = TRUE;
+			return;
+		}
+	}
+
+	journal->spill_size += journal->buffer->len;
+	g_byte_array_set_size (journal->buffer, 0);
+}
+
+static void
+undo_journal_add (UndoJournal *journal,
+		  GFile       *file)
+{
+	char *uri;
+	gsize len, prefix;
+
+	uri = g_file_get_uri (file);
+	len = strlen (uri);
+
+	for (prefix = 0; prefix < len && prefix < journal->last_uri->len; prefix++) {
+		if (uri[prefix] != journal->last_uri->str[prefix]) {
+			break;
+		}
+	}
+
+	append_varint (journal->buffer, prefix);
+	append_varint (journal->buffer, len - prefix);
+	g_byte_array_append (journal->buffer, (guint8 *) uri + prefix, len - prefix);
+
+	g_string_truncate (journal->last_uri, prefix);
+	g_string_append (journal->last_uri, uri + prefix);
+	g_free (uri);
+
+	if (journal->buffer->len >= UNDO_JOURNAL_SPILL_SIZE &&
+	    !journal->spill_failed) {
+		undo_journal_spill (journal);
+	}
+}
+
+/* Returns FALSE when @func stopped the iteration */
+static gboolean
+undo_journal_foreach_in_data (const guint8    *data,
+			      gsize            size,
+			      GString         *uri,
+			      UndoJournalFunc  func,
+			      gpointer         user_data)
+{
+	const guint8 *end;
+	gsize prefix, suffix;
+
+	end = data + size;
+	while (data < end) {
+		if (!read_varint (&data, end, &prefix) ||
+		    !read_varint (&data, end, &suffix) ||
+		    prefix > uri->len || suffix > (gsize) (end - data)) {
+			g_warning ("Corrupted undo journal");
+			return FALSE;
+		}
+
+		g_string_truncate (uri, prefix);
+		g_string_append_len (uri, (const char *) data, suffix);
+		data += suffix;
+
+		if (!func (uri->str, user_data)) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static void
+undo_journal_foreach (UndoJournal     *journal,
+		      UndoJournalFunc  func,
+		      gpointer         user_data)
+{
+	GMappedFile *spill;
+	GString *uri;
+	gboolean done;
+
+	uri = g_string_new (NULL);
+	done = FALSE;
+
+	if (journal->spill_size > 0) {
+		spill = g_mapped_file_new_from_fd (journal->spill_fd, FALSE, NULL);
+		if (spill == NULL ||
+		    g_mapped_file_get_length (spill) < journal->spill_size) {
+			g_warning ("Could not read the undo journal");
+			done = TRUE;
+		} else {
+			done = !undo_journal_foreach_in_data ((const guint8 *) g_mapped_file_get_contents (spill),
+							      journal->spill_size,
+							      uri, func, user_data);
+		}
+		g_clear_pointer (&spill, g_mapped_file_unref);
+	}
+
+	if (!done) {
+		undo_journal_foreach_in_data (journal->buffer->data, journal->buffer->len,
+					      uri, func, user_data);
+	}
+
+	g_string_free (uri, TRUE);
+}
+
+static gboolean
+prepend_file_for_uri (const char *uri,
+		      gpointer    user_data)
+{
+	GList **files = user_data;
+
+	*files = g_list_prepend (*files, g_file_new_for_uri (uri));
+
+	return TRUE;
+}
+
+/* The files are only created for the time of the operation replaying them */
+static GList *
+undo_journal_get_files (UndoJournal *journal)
+{
+	GList *files = NULL;
+
+	undo_journal_foreach (journal, prepend_file_for_uri, &files);
+
+	return g_list_reverse (files);
+}
+
+static gboolean
+get_basename_for_uri (const char *uri,
+		      gpointer    user_data)
+{
+	char **basename = user_data;
+	GFile *file;
+
+	file = g_file_new_for_uri (uri);
+	*basename = g_file_get_basename (file);
+	g_object_unref (file);
+
+	/* Only the first one */
+	return FALSE;
+}
+
 /* copy/move/duplicate/link/restore from trash */
 G_DEFINE_TYPE (NautilusFileUndoInfoExt, nautilus_file_undo_info_ext, NAUTILUS_TYPE_FILE_UNDO_INFO)
 
 struct _NautilusFileUndoInfoExtDetails {
 	GFile *src_dir;
 	GFile *dest_dir;
-	GList *sources;	     /* Relative to src_dir */
-	GList *destinations; /* Relative to dest_dir */
+	UndoJournal sources;
+	UndoJournal destinations;
 };
 
 static char *
 ext_get_first_target_short_name (NautilusFileUndoInfoExt *self)
 {
-	GList *targets_first;
 	char *file_name = NULL;
 
-	targets_first = g_list_first (self->priv->destinations);
-
-	if (targets_first != NULL &&
-	    targets_first->data != NULL) {
-		file_name = g_file_get_basename (targets_first->data);
-	}
+	undo_journal_foreach (&self->priv->destinations, get_basename_for_uri, &file_name);
 
 	return file_name;
 }
@@ -479,35 +718,51 @@ static void
 ext_create_link_redo_func (NautilusFileUndoInfoExt *self,
 			   GtkWindow *parent_window)
 {
-	nautilus_file_operations_link (self->priv->sources, NULL,
+	GList *files;
+
+	files = undo_journal_get_files (&self->priv->sources);
+	nautilus_file_operations_link (files, NULL,
 				       self->priv->dest_dir, parent_window,
 				       file_undo_info_transfer_callback, self);
+	g_list_free_full (files, g_object_unref);
 }
 
 static void
 ext_duplicate_redo_func (NautilusFileUndoInfoExt *self,
 			 GtkWindow *parent_window)
 {
-	nautilus_file_operations_duplicate (self->priv->sources, NULL, parent_window,
+	GList *files;
+
+	files = undo_journal_get_files (&self->priv->sources);
+	nautilus_file_operations_duplicate (files, NULL, parent_window,
 					    file_undo_info_transfer_callback, self);
+	g_list_free_full (files, g_object_unref);
 }
 
 static void
 ext_copy_redo_func (NautilusFileUndoInfoExt *self,
 		    GtkWindow *parent_window)
 {
-	nautilus_file_operations_copy (self->priv->sources, NULL,
+	GList *files;
+
+	files = undo_journal_get_files (&self->priv->sources);
+	nautilus_file_operations_copy (files, NULL,
 				       self->priv->dest_dir, parent_window,
 				       file_undo_info_transfer_callback, self);
+	g_list_free_full (files, g_object_unref);
 }
 
 static void
 ext_move_restore_redo_func (NautilusFileUndoInfoExt *self,
 			    GtkWindow *parent_window)
 {
-	nautilus_file_operations_move (self->priv->sources, NULL,
+	GList *files;
+
+	files = undo_journal_get_files (&self->priv->sources);
+	nautilus_file_operations_move (files, NULL,
 				       self->priv->dest_dir, parent_window,
 				       file_undo_info_transfer_callback, self);
+	g_list_free_full (files, g_object_unref);
 }
 
 static void
@@ -535,8 +790,12 @@ static void
 ext_restore_undo_func (NautilusFileUndoInfoExt *self,
 		       GtkWindow *parent_window)
 {
-	nautilus_file_operations_trash_or_delete (self->priv->destinations, parent_window,
+	GList *files;
+
+	files = undo_journal_get_files (&self->priv->destinations);
+	nautilus_file_operations_trash_or_delete (files, parent_window,
 						  file_undo_info_delete_callback, self);
+	g_list_free_full (files, g_object_unref);
 }
 
 
@@ -544,9 +803,13 @@ static void
 ext_move_undo_func (NautilusFileUndoInfoExt *self,
 		    GtkWindow *parent_window)
 {
-	nautilus_file_operations_move (self->priv->destinations, NULL,
+	GList *files;
+
+	files = undo_journal_get_files (&self->priv->destinations);
+	nautilus_file_operations_move (files, NULL,
 				       self->priv->src_dir, parent_window,
 				       file_undo_info_transfer_callback, self);
+	g_list_free_full (files, g_object_unref);
 }
 
 static void
@@ -555,13 +818,13 @@ ext_copy_duplicate_undo_func (NautilusFileUndoInfoExt *self,
 {
 	GList *files;
 
-	files = g_list_copy (self->priv->destinations);
+	files = undo_journal_get_files (&self->priv->destinations);
 	files = g_list_reverse (files); /* Deleting must be done in reverse */
 
 	nautilus_file_operations_delete (files, parent_window,
 					 file_undo_info_delete_callback, self);
 
-	g_list_free (files);
+	g_list_free_full (files, g_object_unref);
 }
 
 static void
@@ -589,6 +852,9 @@ nautilus_file_undo_info_ext_init (NautilusFileUndoInfoExt *self)
 {
 	self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self, nautilus_file_undo_info_ext_get_type (),
 						  NautilusFileUndoInfoExtDetails);
+
+	undo_journal_init (&self->priv->sources);
+	undo_journal_init (&self->priv->destinations);
 }
 
 static void
@@ -596,13 +862,8 @@ nautilus_file_undo_info_ext_finalize (GObject *obj)
 {
 	NautilusFileUndoInfoExt *self = NAUTILUS_FILE_UNDO_INFO_EXT (obj);
 
-	if (self->priv->sources) {
-		g_list_free_full (self->priv->sources, g_object_unref);
-	}
-
-	if (self->priv->destinations) {
-		g_list_free_full (self->priv->destinations, g_object_unref);
-	}
+	undo_journal_clear (&self->priv->sources);
+	undo_journal_clear (&self->priv->destinations);
 
 	g_clear_object (&self->priv->src_dir);
 	g_clear_object (&self->priv->dest_dir);
@@ -649,10 +910,8 @@ nautilus_file_undo_info_ext_add_origin_target_pair (NautilusFileUndoInfoExt *sel
 						    GFile                   *origin,
 						    GFile                   *target)
 {
-	self->priv->sources =
-		g_list_append (self->priv->sources, g_object_ref (origin));
-	self->priv->destinations =
-		g_list_append (self->priv->destinations, g_object_ref (target));
+	undo_journal_add (&self->priv->sources, origin);
+	undo_journal_add (&self->priv->destinations, target);
 }
 
 /* create new file/folder */
@@ -1433,6 +1692,15 @@ nautilus_file_undo_info_rec_permissions_add_file (NautilusFileUndoInfoRecPermiss
 	g_hash_table_insert (self->priv->original_permissions, original_uri, GUINT_TO_POINTER (permission));
 }
 
+/* Takes ownership of @uri */
+void
+nautilus_file_undo_info_rec_permissions_add_uri (NautilusFileUndoInfoRecPermissions *self,
+						 gchar                              *uri,
+						 guint32                             permission)
+{
+	g_hash_table_insert (self->priv->original_permissions, uri, GUINT_TO_POINTER (permission));
+}
+
 /* single file change permissions */
 G_DEFINE_TYPE (NautilusFileUndoInfoPermissions, nautilus_file_undo_info_permissions, NAUTILUS_TYPE_FILE_UNDO_INFO)
 
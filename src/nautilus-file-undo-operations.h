@@ -242,6 +242,9 @@ NautilusFileUndoInfo *nautilus_file_undo_info_rec_permissions_new (GFile   *dest
 void nautilus_file_undo_info_rec_permissions_add_file (NautilusFileUndoInfoRecPermissions *self,
 						       GFile                              *file,
 						       guint32                             permission);
+void nautilus_file_undo_info_rec_permissions_add_uri (NautilusFileUndoInfoRecPermissions *self,
+						      gchar                              *uri,
+						      guint32                             permission);
 
 /* single file change permissions */
 #define NAUTILUS_TYPE_FILE_UNDO_INFO_PERMISSIONS         (nautilus_file_undo_info_permissions_get_type ())
@@ -69,7 +69,7 @@
 #define DEBUG_FLAG NAUTILUS_DEBUG_FILE
 #include "nautilus-debug.h"
 
-/* Time in seconds to cache getpwuid results */
+/* Time in seconds to cache user and group lookups */
 #define GETPWUID_CACHE_TIME (5*60)
 
 #define ICON_NAME_THUMBNAIL_LOADING   "image-loading"
@@ -93,6 +93,23 @@
 
 #define METADATA_ID_IS_LIST_MASK (1<<31)
 
+typedef struct {
+	guint id;
+	/* a unique eel_ref_str, or for lists a NULL-terminated
+	 * array of them */
+	gpointer value;
+} MetadataEntry;
+
+/* Metadata of a file, sorted by id. Since values come from the unique
+ * string pool, equal values are the same pointer, and the hash is
+ * enough to tell most changes apart without looking at the strings.
+ */
+struct NautilusFileMetadata {
+	guint hash;
+	guint n_entries;
+	MetadataEntry entries[1];
+};
+
 typedef enum {
 	SHOW_HIDDEN = 1 << 0,
 } FilterOptions;
@@ -163,7 +180,7 @@ static gboolean update_info_and_name                         (NautilusFile
 static const char * nautilus_file_peek_display_name (NautilusFile *file);
 static const char * nautilus_file_peek_display_name_collation_key (NautilusFile *file);
 static void file_mount_unmounted (GMount *mount,  gpointer data);
-static void metadata_hash_free (GHashTable *hash);
+static void metadata_free (NautilusFileMetadata *metadata);
 static gboolean real_drag_can_accept_files (NautilusFile *drop_target_item);
 
 G_DEFINE_TYPE_WITH_CODE (NautilusFile, nautilus_file, G_TYPE_OBJECT,
@@ -203,11 +220,14 @@ nautilus_file_constructor (GType                  type,
   return object;
 }
 
-gboolean
-nautilus_file_set_display_name (NautilusFile *file,
-				const char *display_name,
-				const char *edit_name,
-				gboolean custom)
+/* collation_key is consumed, when not NULL it must be the key for
+ * display_name */
+static gboolean
+set_display_name_internal (NautilusFile *file,
+			   const char *display_name,
+			   const char *edit_name,
+			   gboolean custom,
+			   char *collation_key)
 {
 	gboolean changed;
 
@@ -219,14 +239,17 @@ nautilus_file_set_display_name (NautilusFile *file,
 			nautilus_file_invalidate_attributes (file,
 							     NAUTILUS_FILE_ATTRIBUTE_INFO);
 		}
+		g_free (collation_key);
 		return FALSE;
 	}
 	
 	if (display_name == NULL || *display_name == 0) {
+		g_free (collation_key);
 		return FALSE;
 	}
 	
 	if (!custom && file->details->got_custom_display_name) {
+		g_free (collation_key);
 		return FALSE;
 	}
 
@@ -248,8 +271,13 @@ nautilus_file_set_display_name (NautilusFile *file,
 		}
 		
 		g_free (file->details->display_name_collation_key);
-		file->details->display_name_collation_key = g_utf8_collate_key_for_filename (display_name, -1);
+		if (collation_key != NULL) {
+			file->details->display_name_collation_key = g_steal_pointer (&collation_key);
+		} else {
+			file->details->display_name_collation_key = g_utf8_collate_key_for_filename (display_name, -1);
+		}
 	}
+	g_free (collation_key);
 
 	if (g_strcmp0 (eel_ref_str_peek (file->details->edit_name), edit_name) != 0) {
 		changed = TRUE;
@@ -266,6 +294,15 @@ nautilus_file_set_display_name (NautilusFile *file,
 	return changed;
 }
 
+gboolean
+nautilus_file_set_display_name (NautilusFile *file,
+				const char *display_name,
+				const char *edit_name,
+				gboolean custom)
+{
+	return set_display_name_internal (file, display_name, edit_name, custom, NULL);
+}
+
 static void
 nautilus_file_clear_display_name (NautilusFile *file)
 {
@@ -277,97 +314,148 @@ nautilus_file_clear_display_name (NautilusFile *file)
 	file->details->edit_name = NULL;
 }
 
-static gboolean
-foreach_metadata_free (gpointer  key,
-		       gpointer  value,
-		       gpointer  user_data)
-{
-	guint id;
-
-	id = GPOINTER_TO_UINT (key);
-
-	if (id & METADATA_ID_IS_LIST_MASK) {
-		g_strfreev ((char **)value);
-	} else {
-		g_free ((char *)value);
-	}
-	return TRUE;
-}
-
-
 static void
-metadata_hash_free (GHashTable *hash)
+metadata_free (NautilusFileMetadata *metadata)
 {
-	g_hash_table_foreach_remove (hash,
-				     foreach_metadata_free,
-				     NULL);
-	g_hash_table_destroy (hash);
+	MetadataEntry *entry;
+	eel_ref_str *list;
+	guint i;
+	int j;
+
+	for (i = 0; i < metadata->n_entries; i++) {
+		entry = &metadata->entries[i];
+		if (entry->id & METADATA_ID_IS_LIST_MASK) {
+			list = entry->value;
+			for (j = 0; list[j] != NULL; j++) {
+				eel_ref_str_unref (list[j]);
+			}
+			g_free (list);
+		} else {
+			eel_ref_str_unref (entry->value);
+		}
+	}
+	g_free (metadata);
 }
 
 static gboolean
-metadata_hash_equal (GHashTable *hash1,
-		     GHashTable *hash2)
+metadata_equal (NautilusFileMetadata *metadata1,
+		NautilusFileMetadata *metadata2)
 {
-	GHashTableIter iter;
-	gpointer key1, value1, value2;
-	guint id;
+	MetadataEntry *entry1, *entry2;
+	eel_ref_str *list1, *list2;
+	guint i;
+	int j;
 
-	if (hash1 == NULL && hash2 == NULL) {
-		return TRUE;
+	if (metadata1 == NULL || metadata2 == NULL) {
+		return metadata1 == metadata2;
 	}
 
-	if (hash1 == NULL || hash2 == NULL) {
+	if (metadata1->hash != metadata2->hash ||
+	    metadata1->n_entries != metadata2->n_entries) {
 		return FALSE;
 	}
 
-	if (g_hash_table_size (hash1) !=
-	    g_hash_table_size (hash2)) {
-		return FALSE;
-	}
+	for (i = 0; i < metadata1->n_entries; i++) {
+		entry1 = &metadata1->entries[i];
+		entry2 = &metadata2->entries[i];
 
-	g_hash_table_iter_init (&iter, hash1);
-	while (g_hash_table_iter_next (&iter, &key1, &value1)) {
-		value2 = g_hash_table_lookup (hash2, key1);
-		if (value2 == NULL) {
+		if (entry1->id != entry2->id) {
 			return FALSE;
 		}
-		id = GPOINTER_TO_UINT (key1);
-		if (id & METADATA_ID_IS_LIST_MASK) {
-			if (!eel_g_strv_equal ((char **)value1, (char **)value2)) {
-				return FALSE;
+
+		if (entry1->id & METADATA_ID_IS_LIST_MASK) {
+			list1 = entry1->value;
+			list2 = entry2->value;
+			for (j = 0; list1[j] != NULL && list1[j] == list2[j]; j++) {
 			}
-		} else {
-			if (strcmp ((char *)value1, (char *)value2) != 0) {
+			if (list1[j] != list2[j]) {
 				return FALSE;
 			}
+		} else if (entry1->value != entry2->value) {
+			return FALSE;
 		}
 	}
 
 	return TRUE;
 }
 
+static gpointer
+metadata_lookup (NautilusFileMetadata *metadata,
+		 guint                 id)
+{
+	guint low, high, middle;
+
+	low = 0;
+	high = metadata->n_entries;
+	while (low < high) {
+		middle = (low + high) / 2;
+		if (metadata->entries[middle].id == id) {
+			return metadata->entries[middle].value;
+		} else if (metadata->entries[middle].id < id) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+
+	return NULL;
+}
+
+static void
+metadata_update_hash (NautilusFileMetadata *metadata)
+{
+	eel_ref_str *list;
+	guint hash, i;
+	int j;
+
+	hash = metadata->n_entries;
+	for (i = 0; i < metadata->n_entries; i++) {
+		hash = hash * 31 + metadata->entries[i].id;
+		if (metadata->entries[i].id & METADATA_ID_IS_LIST_MASK) {
+			list = metadata->entries[i].value;
+			for (j = 0; list[j] != NULL; j++) {
+				hash = hash * 31 + g_direct_hash (list[j]);
+			}
+		} else {
+			hash = hash * 31 + g_direct_hash (metadata->entries[i].value);
+		}
+	}
+
+	metadata->hash = hash;
+}
+
 static void
 clear_metadata (NautilusFile *file)
 {
 	if (file->details->metadata) {
-		metadata_hash_free (file->details->metadata);
+		metadata_free (file->details->metadata);
 		file->details->metadata = NULL;
 	}
 }
 
-static GHashTable *
+static NautilusFileMetadata *
 get_metadata_from_info (GFileInfo *info)
 {
-	GHashTable *metadata;
-	char **attrs;
-	guint id;
-	int i;
+	NautilusFileMetadata *metadata;
+	MetadataEntry entry;
+	char **attrs, **strv;
+	eel_ref_str *list;
+	guint id, n;
+	int i, j;
 	GFileAttributeType type;
 	gpointer value;
 
 	attrs = g_file_info_list_attributes (info, "metadata");
 
-	metadata = g_hash_table_new (NULL, NULL);
+	/* Most files don't have any */
+	if (attrs[0] == NULL) {
+		g_strfreev (attrs);
+		return NULL;
+	}
+
+	metadata = g_malloc (G_STRUCT_OFFSET (NautilusFileMetadata, entries) +
+			     g_strv_length (attrs) * sizeof (MetadataEntry));
+	n = 0;
 
 	for (i = 0; attrs[i] != NULL; i++) {
 		id = nautilus_metadata_get_id (attrs[i] + strlen ("metadata::"));
@@ -381,43 +469,280 @@ get_metadata_from_info (GFileInfo *info)
 		}
 
 		if (type == G_FILE_ATTRIBUTE_TYPE_STRING) {
-			g_hash_table_insert (metadata, GUINT_TO_POINTER (id),
-					     g_strdup ((char *)value));
+			entry.id = id;
+			entry.value = eel_ref_str_get_unique ((char *)value);
 		} else if (type == G_FILE_ATTRIBUTE_TYPE_STRINGV) {
-			id |= METADATA_ID_IS_LIST_MASK;
-			g_hash_table_insert (metadata, GUINT_TO_POINTER (id),
-					     g_strdupv ((char **)value));
+			strv = value;
+			list = g_new (eel_ref_str, g_strv_length (strv) + 1);
+			for (j = 0; strv[j] != NULL; j++) {
+				list[j] = eel_ref_str_get_unique (strv[j]);
+			}
+			list[j] = NULL;
+
+			entry.id = id | METADATA_ID_IS_LIST_MASK;
+			entry.value = list;
+		} else {
+			continue;
+		}
+
+		/* keep it sorted, there are only ever a handful */
+		for (j = n; j > 0 && metadata->entries[j - 1].id > entry.id; j--) {
+			metadata->entries[j] = metadata->entries[j - 1];
 		}
+		metadata->entries[j] = entry;
+		n++;
 	}
 
 	g_strfreev (attrs);
 
+	if (n == 0) {
+		g_free (metadata);
+		return NULL;
+	}
+
+	metadata->n_entries = n;
+	metadata_update_hash (metadata);
+
 	return metadata;
 }
 
+static MetadataEntry
+metadata_entry_copy (const MetadataEntry *entry)
+{
+	MetadataEntry copy;
+	eel_ref_str *list;
+	int i;
+
+	copy.id = entry->id;
+
+	if (entry->id & METADATA_ID_IS_LIST_MASK) {
+		list = entry->value;
+		for (i = 0; list[i] != NULL; i++) {
+		}
+		copy.value = g_memdup (list, (i + 1) * sizeof (eel_ref_str));
+		list = copy.value;
+		for (i = 0; list[i] != NULL; i++) {
+			eel_ref_str_ref (list[i]);
+		}
+	} else {
+		copy.value = eel_ref_str_ref (entry->value);
+	}
+
+	return copy;
+}
+
+/* Takes ownership of metadata */
+static gboolean
+set_metadata (NautilusFile *file,
+	      NautilusFileMetadata *metadata)
+{
+	if (metadata_equal (metadata, file->details->metadata)) {
+		if (metadata != NULL) {
+			metadata_free (metadata);
+		}
+		return FALSE;
+	}
+
+	clear_metadata (file);
+	file->details->metadata = metadata;
+
+	return TRUE;
+}
+
+/* Sets one key in the metadata we have for file, without waiting for it
+ * to be written and read back; the next info update replaces it with
+ * what was actually stored. Pass a NULL value and list to unset it.
+ */
+gboolean
+nautilus_file_update_metadata_key (NautilusFile *file,
+				   const char   *key,
+				   const char   *value,
+				   char        **list_value)
+{
+	NautilusFileMetadata *old, *metadata;
+	MetadataEntry entry;
+	eel_ref_str *list;
+	guint id, i, n, n_old;
+	gboolean inserted;
+	int j;
+
+	id = nautilus_metadata_get_id (key);
+	if (id == 0) {
+		return FALSE;
+	}
+
+	entry.id = id;
+	entry.value = NULL;
+	if (list_value != NULL) {
+		list = g_new (eel_ref_str, g_strv_length (list_value) + 1);
+		for (j = 0; list_value[j] != NULL; j++) {
+			list[j] = eel_ref_str_get_unique (list_value[j]);
+		}
+		list[j] = NULL;
+
+		entry.id |= METADATA_ID_IS_LIST_MASK;
+		entry.value = list;
+	} else if (value != NULL) {
+		entry.value = eel_ref_str_get_unique (value);
+	}
+
+	old = file->details->metadata;
+	n_old = old != NULL ? old->n_entries : 0;
+
+	metadata = g_malloc (G_STRUCT_OFFSET (NautilusFileMetadata, entries) +
+			     (n_old + 1) * sizeof (MetadataEntry));
+	n = 0;
+	inserted = entry.value == NULL;
+
+	for (i = 0; i < n_old; i++) {
+		/* replaces both the string and the list value of the key */
+		if ((old->entries[i].id & ~METADATA_ID_IS_LIST_MASK) == id) {
+			continue;
+		}
+		if (!inserted && old->entries[i].id > entry.id) {
+			metadata->entries[n++] = entry;
+			inserted = TRUE;
+		}
+		metadata->entries[n++] = metadata_entry_copy (&old->entries[i]);
+	}
+	if (!inserted) {
+		metadata->entries[n++] = entry;
+	}
+
+	metadata->n_entries = n;
+	metadata_update_hash (metadata);
+
+	if (n == 0) {
+		g_free (metadata);
+		metadata = NULL;
+	}
+
+	return set_metadata (file, metadata);
+}
+
 gboolean
 nautilus_file_update_metadata_from_info (NautilusFile *file,
 					 GFileInfo *info)
 {
-	gboolean changed = FALSE;
+	NautilusFileMetadata *metadata;
 
+	metadata = NULL;
 	if (g_file_info_has_namespace (info, "metadata")) {
-		GHashTable *metadata;
-
 		metadata = get_metadata_from_info (info);
-		if (!metadata_hash_equal (metadata,
-					  file->details->metadata)) {
-			changed = TRUE;
-			clear_metadata (file);
-			file->details->metadata = metadata;
-		} else {
-			metadata_hash_free (metadata);
-		}
-	} else if (file->details->metadata) {
-		changed = TRUE;
-		clear_metadata (file);
 	}
-	return changed;
+
+	return set_metadata (file, metadata);
+}
+
+/* Parts of update_info_internal() that only depend on the info, worked
+ * out by nautilus_file_precompute_info() before it gets to the main
+ * thread.
+ */
+typedef struct {
+	char *display_name;
+	char *display_name_collation_key;
+	gboolean has_metadata;
+	NautilusFileMetadata *metadata;
+} PrecomputedInfo;
+
+G_DEFINE_QUARK (nautilus-file-precomputed-info, precomputed_info)
+
+static void
+precomputed_info_free (PrecomputedInfo *precomputed)
+{
+	g_free (precomputed->display_name);
+	g_free (precomputed->display_name_collation_key);
+	if (precomputed->metadata != NULL) {
+		metadata_free (precomputed->metadata);
+	}
+	g_free (precomputed);
+}
+
+/* Detailed type descriptions, one per interned mime type and shared by
+ * all files, so they are worked out once per process.
+ */
+G_LOCK_DEFINE_STATIC (type_descriptions);
+static GHashTable *type_descriptions;
+
+static const char *
+get_type_description (eel_ref_str mime_type)
+{
+	const char *description;
+	char *new_description;
+
+	G_LOCK (type_descriptions);
+	if (type_descriptions == NULL) {
+		type_descriptions = g_hash_table_new (g_direct_hash, g_direct_equal);
+	}
+	description = g_hash_table_lookup (type_descriptions, mime_type);
+	G_UNLOCK (type_descriptions);
+
+	if (description != NULL) {
+		return description;
+	}
+
+	/* Look it up without the lock held; if another thread got there
+	 * first, keep its copy. */
+	new_description = g_content_type_get_description (eel_ref_str_peek (mime_type));
+	if (new_description == NULL) {
+		return NULL;
+	}
+
+	G_LOCK (type_descriptions);
+	description = g_hash_table_lookup (type_descriptions, mime_type);
+	if (description == NULL) {
+		g_hash_table_insert (type_descriptions,
+				     eel_ref_str_ref (mime_type), new_description);
+		description = new_description;
+	} else {
+		g_free (new_description);
+	}
+	G_UNLOCK (type_descriptions);
+
+	return description;
+}
+
+/**
+ * nautilus_file_precompute_info:
+ * @info: a #GFileInfo no other thread is using
+ *
+ * Does the expensive part of turning @info into file details, the
+ * collation key and metadata table, and keeps the results with @info
+ * for nautilus_file_update_info() and nautilus_file_new_from_info() to
+ * install. Also fills in the shared type description cache. Safe to
+ * call from any thread.
+ */
+void
+nautilus_file_precompute_info (GFileInfo *info)
+{
+	PrecomputedInfo *precomputed;
+	const char *display_name, *mime_type;
+
+	precomputed = g_new0 (PrecomputedInfo, 1);
+
+	display_name = g_file_info_get_display_name (info);
+	if (display_name != NULL && *display_name != 0) {
+		precomputed->display_name = g_strdup (display_name);
+		precomputed->display_name_collation_key = g_utf8_collate_key_for_filename (display_name, -1);
+	}
+
+	precomputed->has_metadata = g_file_info_has_namespace (info, "metadata");
+	if (precomputed->has_metadata) {
+		precomputed->metadata = get_metadata_from_info (info);
+	}
+
+	mime_type = g_file_info_get_content_type (info);
+	if (mime_type != NULL && !g_content_type_is_unknown (mime_type)) {
+		eel_ref_str unique_type;
+
+		/* Warm the shared cache for get_description() */
+		unique_type = eel_ref_str_get_unique (mime_type);
+		get_type_description (unique_type);
+		eel_ref_str_unref (unique_type);
+	}
+
+	g_object_set_qdata_full (G_OBJECT (info), precomputed_info_quark (),
+				 precomputed, (GDestroyNotify) precomputed_info_free);
 }
 
 void
@@ -830,7 +1155,7 @@ finalize (GObject *object)
 	}
 
 	if (file->details->metadata) {
-		metadata_hash_free (file->details->metadata);
+		metadata_free (file->details->metadata);
 	}
 
 	G_OBJECT_CLASS (nautilus_file_parent_class)->finalize (object);
@@ -2129,6 +2454,8 @@ update_info_internal (NautilusFile *file,
 	const char *trash_orig_path;
 	const char *group, *owner, *owner_real;
 	gboolean free_owner, free_group;
+	PrecomputedInfo *precomputed;
+	char *collation_key;
 	
 	if (file->details->is_gone) {
 		return FALSE;
@@ -2154,10 +2481,18 @@ update_info_internal (NautilusFile *file,
 	}
 	file->details->got_file_info = TRUE;
 
-	changed |= nautilus_file_set_display_name (file,
-						  g_file_info_get_display_name (info),
-						  g_file_info_get_edit_name (info),
-						  FALSE);
+	precomputed = g_object_steal_qdata (G_OBJECT (info), precomputed_info_quark ());
+
+	collation_key = NULL;
+	if (precomputed != NULL &&
+	    g_strcmp0 (precomputed->display_name, g_file_info_get_display_name (info)) == 0) {
+		collation_key = g_steal_pointer (&precomputed->display_name_collation_key);
+	}
+	changed |= set_display_name_internal (file,
+					      g_file_info_get_display_name (info),
+					      g_file_info_get_edit_name (info),
+					      FALSE,
+					      collation_key);
 
 	mime_type = g_file_info_get_content_type (info);
 	file_type = g_file_info_get_file_type (info);
@@ -2493,8 +2828,12 @@ update_info_internal (NautilusFile *file,
 		file->details->trash_orig_path = g_strdup (trash_orig_path);
 	}
 
-	changed |=
-		nautilus_file_update_metadata_from_info (file, info);
+	if (precomputed != NULL) {
+		changed |= set_metadata (file, g_steal_pointer (&precomputed->metadata));
+	} else {
+		changed |=
+			nautilus_file_update_metadata_from_info (file, info);
+	}
 
 	if (update_name) {
 		name = g_file_info_get_name (info);
@@ -2533,6 +2872,10 @@ update_info_internal (NautilusFile *file,
 		update_links_if_target (file);
 	}
 
+	if (precomputed != NULL) {
+		precomputed_info_free (precomputed);
+	}
+
 	return changed;
 }
 
@@ -3452,7 +3795,7 @@ nautilus_file_get_metadata (NautilusFile *file,
 			    const char *default_metadata)
 {
 	guint id;
-	char *value;
+	const char *value;
 
 	g_return_val_if_fail (key != NULL, g_strdup (default_metadata));
 	g_return_val_if_fail (key[0] != '\0', g_strdup (default_metadata));
@@ -3465,7 +3808,7 @@ nautilus_file_get_metadata (NautilusFile *file,
 	g_return_val_if_fail (NAUTILUS_IS_FILE (file), g_strdup (default_metadata));
 
 	id = nautilus_metadata_get_id (key);
-	value = g_hash_table_lookup (file->details->metadata, GUINT_TO_POINTER (id));
+	value = metadata_lookup (file->details->metadata, id);
 
 	if (value) {
 		return g_strdup (value);
@@ -3495,7 +3838,7 @@ nautilus_file_get_metadata_list (NautilusFile *file,
 	id = nautilus_metadata_get_id (key);
 	id |= METADATA_ID_IS_LIST_MASK;
 
-	value = g_hash_table_lookup (file->details->metadata, GUINT_TO_POINTER (id));
+	value = metadata_lookup (file->details->metadata, id);
 
 	if (value) {
 		res = NULL;
@@ -5378,20 +5721,370 @@ get_real_name (const char *name, const char *gecos)
 	return real_name;
 }
 
+/* User and group lookups go through NSS, which can take a while when
+ * it is backed by a directory service, so their answers, including
+ * the negative ones, are kept for GETPWUID_CACHE_TIME. The lists of all
+ * users and groups are read in a thread; an outdated list is handed
+ * out while a newer one is being read. Only used from the main thread.
+ */
+typedef struct {
+	char *name;
+	gboolean found;
+	guint32 id;
+	guint32 gid; /* primary group, for users */
+	gint64 time;
+} CachedId;
+
+typedef struct {
+	GList *user_names;
+	GList *group_names;
+	GPtrArray *users;
+	GPtrArray *groups;
+} UserAndGroupNames;
+
+static GHashTable *cached_users;      /* user name -> CachedId */
+static GHashTable *cached_groups;     /* group name -> CachedId */
+static GHashTable *cached_group_ids;  /* gid -> CachedId */
+static GList *cached_user_names;
+static GList *cached_group_names;
+static gint64 cached_names_time;
+static gboolean reading_names;
+/* Handed over by the reading thread, so the main thread can wait for
+ * it instead of walking the databases again. */
+static GMutex read_names_mutex;
+static GCond read_names_cond;
+static UserAndGroupNames *read_names;
+
+static CachedId *
+cached_id_new (const char *name,
+	       gboolean found,
+	       guint32 id,
+	       guint32 gid)
+{
+	CachedId *cached;
+
+	cached = g_new (CachedId, 1);
+	cached->name = g_strdup (name);
+	cached->found = found;
+	cached->id = id;
+	cached->gid = gid;
+	cached->time = g_get_monotonic_time ();
+
+	return cached;
+}
+
+static void
+cached_id_free (CachedId *cached)
+{
+	g_free (cached->name);
+	g_free (cached);
+}
+
 static gboolean
-get_group_id_from_group_name (const char *group_name, uid_t *gid)
+cache_time_is_fresh (gint64 time)
+{
+	return time != 0 &&
+		g_get_monotonic_time () - time < GETPWUID_CACHE_TIME * G_USEC_PER_SEC;
+}
+
+static void
+ensure_id_caches (void)
+{
+	if (cached_users != NULL) {
+		return;
+	}
+
+	cached_users = g_hash_table_new_full (g_str_hash, g_str_equal,
+					      NULL, (GDestroyNotify) cached_id_free);
+	cached_groups = g_hash_table_new_full (g_str_hash, g_str_equal,
+					       NULL, (GDestroyNotify) cached_id_free);
+	cached_group_ids = g_hash_table_new_full (NULL, NULL,
+						  NULL, (GDestroyNotify) cached_id_free);
+}
+
+static void
+cache_user (CachedId *cached)
+{
+	g_hash_table_replace (cached_users, cached->name, cached);
+}
+
+static void
+cache_group (CachedId *cached)
+{
+	g_hash_table_replace (cached_groups, cached->name, cached);
+	if (cached->found) {
+		g_hash_table_replace (cached_group_ids, GUINT_TO_POINTER (cached->id),
+				      cached_id_new (cached->name, TRUE, cached->id, cached->id));
+	}
+}
+
+static void
+user_and_group_names_free (UserAndGroupNames *names)
+{
+	g_list_free_full (names->user_names, g_free);
+	g_list_free_full (names->group_names, g_free);
+	g_ptr_array_unref (names->users);
+	g_ptr_array_unref (names->groups);
+	g_free (names);
+}
+
+/* Walks the whole user and group databases, may be called from any
+ * thread; the *pwent and *grent state is only ever used from here.
+ */
+static UserAndGroupNames *
+read_user_and_group_names (void)
 {
+	G_LOCK_DEFINE_STATIC (nss_enumeration);
+	UserAndGroupNames *names;
+	char *real_name, *name;
+	struct passwd *user;
 	struct group *group;
 
-	g_assert (gid != NULL);
+	names = g_new0 (UserAndGroupNames, 1);
+	names->users = g_ptr_array_new_with_free_func ((GDestroyNotify) cached_id_free);
+	names->groups = g_ptr_array_new_with_free_func ((GDestroyNotify) cached_id_free);
+
+	G_LOCK (nss_enumeration);
+
+	setpwent ();
+
+	while ((user = getpwent ()) != NULL) {
+		real_name = get_real_name (user->pw_name, user->pw_gecos);
+		if (real_name != NULL) {
+			name = g_strconcat (user->pw_name, "\n", real_name, NULL);
+		} else {
+			name = g_strdup (user->pw_name);
+		}
+		g_free (real_name);
+		names->user_names = g_list_prepend (names->user_names, name);
+		g_ptr_array_add (names->users,
+				 cached_id_new (user->pw_name, TRUE, user->pw_uid, user->pw_gid));
+	}
+
+	endpwent ();
+
+	setgrent ();
+
+	while ((group = getgrent ()) != NULL) {
+		names->group_names = g_list_prepend (names->group_names, g_strdup (group->gr_name));
+		g_ptr_array_add (names->groups,
+				 cached_id_new (group->gr_name, TRUE, group->gr_gid, group->gr_gid));
+	}
+
+	endgrent ();
+
+	G_UNLOCK (nss_enumeration);
+
+	names->user_names = g_list_sort (names->user_names, (GCompareFunc) g_utf8_collate);
+	names->group_names = g_list_sort (names->group_names, (GCompareFunc) g_utf8_collate);
+
+	return names;
+}
+
+static void
+install_user_and_group_names (UserAndGroupNames *names)
+{
+	guint i;
+
+	ensure_id_caches ();
+
+	g_list_free_full (cached_user_names, g_free);
+	cached_user_names = g_steal_pointer (&names->user_names);
+	g_list_free_full (cached_group_names, g_free);
+	cached_group_names = g_steal_pointer (&names->group_names);
+
+	/* the caches own the entries from here on */
+	g_ptr_array_set_free_func (names->users, NULL);
+	for (i = 0; i < names->users->len; i++) {
+		cache_user (g_ptr_array_index (names->users, i));
+	}
+	g_ptr_array_set_free_func (names->groups, NULL);
+	for (i = 0; i < names->groups->len; i++) {
+		cache_group (g_ptr_array_index (names->groups, i));
+	}
+
+	cached_names_time = g_get_monotonic_time ();
+
+	user_and_group_names_free (names);
+}
+
+static void
+read_user_and_group_names_thread (GTask *task,
+				  gpointer source_object,
+				  gpointer task_data,
+				  GCancellable *cancellable)
+{
+	UserAndGroupNames *names;
+
+	names = read_user_and_group_names ();
+
+	g_mutex_lock (&read_names_mutex);
+	read_names = names;
+	g_cond_signal (&read_names_cond);
+	g_mutex_unlock (&read_names_mutex);
+
+	g_task_return_boolean (task, TRUE);
+}
+
+static UserAndGroupNames *
+take_read_user_and_group_names (gboolean wait)
+{
+	UserAndGroupNames *names;
+
+	g_mutex_lock (&read_names_mutex);
+	while (wait && read_names == NULL) {
+		g_cond_wait (&read_names_cond, &read_names_mutex);
+	}
+	names = g_steal_pointer (&read_names);
+	g_mutex_unlock (&read_names_mutex);
+
+	return names;
+}
+
+static void
+read_user_and_group_names_done (GObject *source_object,
+				GAsyncResult *res,
+				gpointer user_data)
+{
+	UserAndGroupNames *names;
+
+	reading_names = FALSE;
+
+	/* NULL if ensure_user_and_group_names() already waited for them */
+	names = take_read_user_and_group_names (FALSE);
+	if (names != NULL) {
+		install_user_and_group_names (names);
+	}
+}
+
+static void
+start_reading_user_and_group_names (void)
+{
+	GTask *task;
+
+	if (reading_names) {
+		return;
+	}
+
+	reading_names = TRUE;
+	task = g_task_new (NULL, NULL, read_user_and_group_names_done, NULL);
+	g_task_run_in_thread (task, read_user_and_group_names_thread);
+	g_object_unref (task);
+}
+
+/* Starts reading the user and group lists in a thread the first time a
+ * file's owner or group is looked at, so they are usually in by the
+ * time the properties window asks for them.
+ */
+static void
+prefetch_user_and_group_names (void)
+{
+	if (cached_names_time == 0) {
+		start_reading_user_and_group_names ();
+	}
+}
+
+/* Makes sure there are user and group lists to hand out, only blocking
+ * if the first read hasn't finished yet.
+ */
+static void
+ensure_user_and_group_names (void)
+{
+	if (cached_names_time == 0) {
+		start_reading_user_and_group_names ();
+		install_user_and_group_names (take_read_user_and_group_names (TRUE));
+	} else if (!cache_time_is_fresh (cached_names_time)) {
+		start_reading_user_and_group_names ();
+	}
+}
+
+static CachedId *
+lookup_user (const char *user_name)
+{
+	struct passwd *password_info;
+	CachedId *cached;
+
+	ensure_id_caches ();
+
+	cached = g_hash_table_lookup (cached_users, user_name);
+	if (cached != NULL && cache_time_is_fresh (cached->time)) {
+		return cached;
+	}
+
+	password_info = getpwnam (user_name);
+	if (password_info != NULL) {
+		cached = cached_id_new (user_name, TRUE,
+					password_info->pw_uid, password_info->pw_gid);
+	} else {
+		cached = cached_id_new (user_name, FALSE, 0, 0);
+	}
+	cache_user (cached);
+
+	return cached;
+}
+
+static CachedId *
+lookup_group (const char *group_name)
+{
+	struct group *group;
+	CachedId *cached;
+
+	ensure_id_caches ();
+
+	cached = g_hash_table_lookup (cached_groups, group_name);
+	if (cached != NULL && cache_time_is_fresh (cached->time)) {
+		return cached;
+	}
 
 	group = getgrnam (group_name);
+	if (group != NULL) {
+		cached = cached_id_new (group_name, TRUE, group->gr_gid, group->gr_gid);
+	} else {
+		cached = cached_id_new (group_name, FALSE, 0, 0);
+	}
+	cache_group (cached);
+
+	return cached;
+}
+
+static CachedId *
+lookup_group_by_id (gid_t gid)
+{
+	struct group *group;
+	CachedId *cached;
+
+	ensure_id_caches ();
+
+	cached = g_hash_table_lookup (cached_group_ids, GUINT_TO_POINTER (gid));
+	if (cached != NULL && cache_time_is_fresh (cached->time)) {
+		return cached;
+	}
 
-	if (group == NULL) {
+	group = getgrgid (gid);
+	if (group != NULL) {
+		cache_group (cached_id_new (group->gr_name, TRUE, gid, gid));
+	} else {
+		g_hash_table_replace (cached_group_ids, GUINT_TO_POINTER (gid),
+				      cached_id_new (NULL, FALSE, gid, gid));
+	}
+
+	return g_hash_table_lookup (cached_group_ids, GUINT_TO_POINTER (gid));
+}
+
+static gboolean
+get_group_id_from_group_name (const char *group_name, uid_t *gid)
+{
+	CachedId *group;
+
+	g_assert (gid != NULL);
+
+	group = lookup_group (group_name);
+
+	if (!group->found) {
 		return FALSE;
 	}
 
-	*gid = group->gr_gid;
+	*gid = group->id;
 
 	return TRUE;
 }
@@ -5399,22 +6092,22 @@ get_group_id_from_group_name (const char *group_name, uid_t *gid)
 static gboolean
 get_ids_from_user_name (const char *user_name, uid_t *uid, uid_t *gid)
 {
-	struct passwd *password_info;
+	CachedId *user;
 
 	g_assert (uid != NULL || gid != NULL);
 
-	password_info = getpwnam (user_name);
+	user = lookup_user (user_name);
 
-	if (password_info == NULL) {
+	if (!user->found) {
 		return FALSE;
 	}
 
 	if (uid != NULL) {
-		*uid = password_info->pw_uid;
+		*uid = user->id;
 	}
 
 	if (gid != NULL) {
-		*gid = password_info->pw_gid;
+		*gid = user->gid;
 	}
 
 	return TRUE;
@@ -5475,6 +6168,8 @@ nautilus_file_can_get_owner (NautilusFile *file)
 char *
 nautilus_file_get_owner_name (NautilusFile *file)
 {
+	prefetch_user_and_group_names ();
+
 	return nautilus_file_get_owner_as_string (file, FALSE);
 }
 
@@ -5493,6 +6188,8 @@ nautilus_file_get_owner_name (NautilusFile *file)
 gboolean
 nautilus_file_can_set_owner (NautilusFile *file)
 {
+	prefetch_user_and_group_names ();
+
 	/* Not allowed to set the owner if we can't
 	 * even read it. This can happen on non-UNIX file
 	 * systems.
@@ -5602,28 +6299,9 @@ nautilus_file_set_owner (NautilusFile *file,
 GList *
 nautilus_get_user_names (void)
 {
-	GList *list;
-	char *real_name, *name;
-	struct passwd *user;
-
-	list = NULL;
-	
-	setpwent ();
+	ensure_user_and_group_names ();
 
-	while ((user = getpwent ()) != NULL) {
-		real_name = get_real_name (user->pw_name, user->pw_gecos);
-		if (real_name != NULL) {
-			name = g_strconcat (user->pw_name, "\n", real_name, NULL);
-		} else {
-			name = g_strdup (user->pw_name);
-		}
-		g_free (real_name);
-		list = g_list_prepend (list, name);
-	}
-
-	endpwent ();
-
-	return g_list_sort (list, (GCompareFunc) g_utf8_collate);
+	return g_list_copy_deep (cached_user_names, (GCopyFunc) g_strdup, NULL);
 }
 
 /**
@@ -5657,6 +6335,8 @@ nautilus_file_can_get_group (NautilusFile *file)
 char *
 nautilus_file_get_group_name (NautilusFile *file)
 {
+	prefetch_user_and_group_names ();
+
 	return g_strdup (eel_ref_str_peek (file->details->group));
 }
 
@@ -5677,6 +6357,8 @@ nautilus_file_can_set_group (NautilusFile *file)
 {
 	uid_t user_id;
 
+	prefetch_user_and_group_names ();
+
 	/* Not allowed to set the permissions if we can't
 	 * even read them. This can happen on non-UNIX file
 	 * systems.
@@ -5710,7 +6392,7 @@ static GList *
 nautilus_get_group_names_for_user (void)
 {
 	GList *list;
-	struct group *group;
+	CachedId *group;
 	int count, i;
 	gid_t gid_list[NGROUPS_MAX + 1];
 	
@@ -5719,11 +6401,11 @@ nautilus_get_group_names_for_user (void)
 
 	count = getgroups (NGROUPS_MAX + 1, gid_list);
 	for (i = 0; i < count; i++) {
-		group = getgrgid (gid_list[i]);
-		if (group == NULL)
+		group = lookup_group_by_id (gid_list[i]);
+		if (!group->found)
 			break;
 		
-		list = g_list_prepend (list, g_strdup (group->gr_name));
+		list = g_list_prepend (list, g_strdup (group->name));
 	}
 
 	return g_list_sort (list, (GCompareFunc) g_utf8_collate);
@@ -5737,19 +6419,9 @@ nautilus_get_group_names_for_user (void)
 GList *
 nautilus_get_all_group_names (void)
 {
-	GList *list;
-	struct group *group;
-	
-	list = NULL;
+	ensure_user_and_group_names ();
 
-	setgrent ();
-	
-	while ((group = getgrent ()) != NULL)
-		list = g_list_prepend (list, g_strdup (group->gr_name));
-	
-	endgrent ();
-	
-	return g_list_sort (list, (GCompareFunc) g_utf8_collate);
+	return g_list_copy_deep (cached_group_names, (GCopyFunc) g_strdup, NULL);
 }
 
 /**
@@ -6536,11 +7208,11 @@ get_description (NautilusFile *file,
 	}
 
 	if (detailed) {
-		char *description;
+		const char *description;
 
-		description = g_content_type_get_description (mime_type);
+		description = get_type_description (file->details->mime_type);
 		if (description != NULL) {
-			return description;
+			return g_strdup (description);
 		}
 	} else {
 		char *category;
@@ -115,6 +115,12 @@
 
 #define MAX_QUEUED_UPDATES 500
 
+/* Time the view spends handing pending files to the subclass before
+ * yielding to input and drawing, and how many files go between looks
+ * at the clock */
+#define PENDING_FILES_SLICE_BUDGET_USEC (8 * G_TIME_SPAN_MILLISECOND)
+#define PENDING_FILES_CLOCK_CHECK_INTERVAL 16
+
 #define MAX_MENU_LEVELS 5
 #define TEMPLATE_LIMIT 30
 
@@ -162,6 +168,14 @@ static int scripts_directory_uri_length;
 
 static GHashTable *script_accels = NULL;
 
+typedef enum {
+        PENDING_LIST_NEW,       /* queued since the view last looked */
+        PENDING_LIST_NOT_READY, /* waiting for the attributes for the icon */
+        PENDING_LIST_ADDED,     /* ready to be added to the view */
+        PENDING_LIST_CHANGED,   /* ready to be refreshed or removed */
+        N_PENDING_LISTS
+} PendingList;
+
 struct NautilusFilesViewDetails
 {
         /* Main components */
@@ -200,13 +214,16 @@ struct NautilusFilesViewDetails
         guint done_loading_handler_id;
         guint file_changed_handler_id;
 
-        GList *new_added_files;
-        GList *new_changed_files;
-
-        GHashTable *non_ready_files;
+        /* Changes the view has yet to be told about, one per file and
+         * directory, each of them on one of the pending lists */
+        GHashTable *pending_changes;
+        GQueue pending_lists[N_PENDING_LISTS];
 
-        GList *old_added_files;
-        GList *old_changed_files;
+        /* slices the pending files were displayed in, since the queue
+         * was last empty */
+        guint pending_slices;
+        gint64 pending_slices_time;
+        gint64 pending_slices_max_time;
 
         GList *pending_selection;
         GHashTable *pending_reveal;
@@ -278,6 +295,19 @@ typedef struct {
         NautilusDirectory *directory;
 } FileAndDirectory;
 
+typedef enum {
+        PENDING_CHANGE_ADDED = 1 << 0,   /* the view has not been given the file yet */
+        PENDING_CHANGE_CHANGED = 1 << 1,
+} PendingChangeFlags;
+
+typedef struct {
+        /* Must come first, it's the key in the pending_changes table */
+        FileAndDirectory fad;
+        PendingChangeFlags flags;
+        PendingList list;
+        GList link;
+} PendingChange;
+
 /* forward declarations */
 
 static gboolean display_selection_info_idle_callback           (gpointer              data);
@@ -842,59 +872,6 @@ typedef struct {
         NautilusFilesView *directory_view;
 } CreateTemplateParameters;
 
-static GList *
-file_and_directory_list_to_files (GList *fad_list)
-{
-        GList *res, *l;
-        FileAndDirectory *fad;
-
-        res = NULL;
-        for (l = fad_list; l != NULL; l = l->next) {
-                fad = l->data;
-                res = g_list_prepend (res, nautilus_file_ref (fad->file));
-        }
-        return g_list_reverse (res);
-}
-
-
-static GList *
-file_and_directory_list_from_files (NautilusDirectory *directory,
-                                    GList             *files)
-{
-        GList *res, *l;
-        FileAndDirectory *fad;
-
-        res = NULL;
-        for (l = files; l != NULL; l = l->next) {
-                fad = g_new0 (FileAndDirectory, 1);
-                fad->directory = nautilus_directory_ref (directory);
-                fad->file = nautilus_file_ref (l->data);
-                res = g_list_prepend (res, fad);
-        }
-        return g_list_reverse (res);
-}
-
-static void
-file_and_directory_free (FileAndDirectory *fad)
-{
-        nautilus_directory_unref (fad->directory);
-        nautilus_file_unref (fad->file);
-        g_free (fad);
-}
-
-
-static void
-file_and_directory_list_free (GList *list)
-{
-        GList *l;
-
-        for (l = list; l != NULL; l = l->next) {
-                file_and_directory_free (l->data);
-        }
-
-        g_list_free (list);
-}
-
 static gboolean
 file_and_directory_equal (gconstpointer v1,
                           gconstpointer v2)
@@ -2924,7 +2901,8 @@ nautilus_files_view_finalize (GObject *object)
                                              NULL);
         }
 
-        g_hash_table_destroy (view->details->non_ready_files);
+        pending_changes_clear (view);
+        g_hash_table_destroy (view->details->pending_changes);
         g_hash_table_destroy (view->details->pending_reveal);
 
         G_OBJECT_CLASS (nautilus_files_view_parent_class)->finalize (object);
@@ -3495,118 +3473,184 @@ ready_to_load (NautilusFile *file)
                                              NAUTILUS_FILE_ATTRIBUTES_FOR_ICON);
 }
 
+static PendingChange *
+pending_change_new (NautilusFile      *file,
+                    NautilusDirectory *directory)
+{
+        PendingChange *change;
+
+        change = g_new0 (PendingChange, 1);
+        change->fad.file = nautilus_file_ref (file);
+        change->fad.directory = nautilus_directory_ref (directory);
+        change->link.data = change;
+
+        return change;
+}
+
+static void
+pending_change_free (PendingChange *change)
+{
+        nautilus_directory_unref (change->fad.directory);
+        nautilus_file_unref (change->fad.file);
+        g_free (change);
+}
+
+static void
+pending_change_move (NautilusFilesView *view,
+                     PendingChange     *change,
+                     PendingList        list)
+{
+        g_queue_unlink (&view->details->pending_lists[change->list], &change->link);
+        change->list = list;
+        g_queue_push_tail_link (&view->details->pending_lists[list], &change->link);
+}
+
+/* Takes the change off its list and out of the table, the caller
+ * frees it. */
+static void
+pending_change_steal (NautilusFilesView *view,
+                      PendingChange     *change)
+{
+        g_queue_unlink (&view->details->pending_lists[change->list], &change->link);
+        g_hash_table_remove (view->details->pending_changes, change);
+}
+
+static void
+pending_changes_clear (NautilusFilesView *view)
+{
+        GList *link;
+        int i;
+
+        g_hash_table_remove_all (view->details->pending_changes);
+
+        for (i = 0; i < N_PENDING_LISTS; i++) {
+                while ((link = g_queue_pop_head_link (&view->details->pending_lists[i])) != NULL) {
+                        pending_change_free (link->data);
+                }
+        }
+}
+
 static int
-compare_files_cover (gconstpointer a,
-                     gconstpointer b,
-                     gpointer      callback_data)
+compare_pending_changes (gconstpointer a,
+                         gconstpointer b,
+                         gpointer      callback_data)
 {
-        const FileAndDirectory *fad1, *fad2;
+        const PendingChange *change1, *change2;
         NautilusFilesView *view;
 
         view = callback_data;
-        fad1 = a; fad2 = b;
+        change1 = a; change2 = b;
 
-        if (fad1->directory < fad2->directory) {
+        if (change1->fad.directory < change2->fad.directory) {
                 return -1;
-        } else if (fad1->directory > fad2->directory) {
+        } else if (change1->fad.directory > change2->fad.directory) {
                 return 1;
         } else {
-                return NAUTILUS_FILES_VIEW_CLASS (G_OBJECT_GET_CLASS (view))->compare_files (view, fad1->file, fad2->file);
+                return NAUTILUS_FILES_VIEW_CLASS (G_OBJECT_GET_CLASS (view))->compare_files (view, change1->fad.file, change2->fad.file);
         }
 }
-static void
-sort_files (NautilusFilesView  *view,
-            GList             **list)
-{
-        *list = g_list_sort_with_data (*list, compare_files_cover, view);
 
-}
+static gboolean slice_time_is_up (gint64 deadline,
+                                  guint  n_processed);
 
-/* Go through all the new added and changed files.
- * Put any that are not ready to load in the non_ready_files hash table.
- * Add all the rest to the old_added_files and old_changed_files lists.
- * Sort the old_*_files lists if anything was added to them.
- */
+/* Sorts the changes queued after @last, so that each slice appends a
+ * sorted run instead of sorting the whole list again */
 static void
-process_new_files (NautilusFilesView *view)
+sort_pending_list_tail (NautilusFilesView *view,
+                        GQueue            *queue,
+                        GList             *last)
 {
-        GList *new_added_files, *new_changed_files, *old_added_files, *old_changed_files;
-        GHashTable *non_ready_files;
-        GList *node, *next;
-        FileAndDirectory *pending;
-        gboolean in_non_ready;
+        GList *tail;
 
-        new_added_files = view->details->new_added_files;
-        view->details->new_added_files = NULL;
-        new_changed_files = view->details->new_changed_files;
-        view->details->new_changed_files = NULL;
+        if (last != NULL) {
+                tail = last->next;
+                if (tail == NULL) {
+                        return;
+                }
+                last->next = NULL;
+                tail->prev = NULL;
+        } else {
+                tail = queue->head;
+        }
 
-        non_ready_files = view->details->non_ready_files;
+        tail = g_list_sort_with_data (tail, compare_pending_changes, view);
 
-        old_added_files = view->details->old_added_files;
-        old_changed_files = view->details->old_changed_files;
+        if (last != NULL) {
+                last->next = tail;
+                tail->prev = last;
+        } else {
+                queue->head = tail;
+        }
+        queue->tail = g_list_last (tail);
+}
 
-        /* Newly added files go into the old_added_files list if they're
-         * ready, and into the hash table if they're not.
-         */
-        for (node = new_added_files; node != NULL; node = next) {
-                next = node->next;
-                pending = (FileAndDirectory *)node->data;
-                in_non_ready = g_hash_table_lookup (non_ready_files, pending) != NULL;
-                if (nautilus_files_view_should_show_file (view, pending->file)) {
-                        if (ready_to_load (pending->file)) {
-                                if (in_non_ready) {
-                                        g_hash_table_remove (non_ready_files, pending);
-                                }
-                                new_added_files = g_list_delete_link (new_added_files, node);
-                                old_added_files = g_list_prepend (old_added_files, pending);
+/* Go through the newly queued changes, until @deadline.
+ * Files the view has not been given yet go on the added list if they're
+ * ready, and on the not ready list if they're not. Changes to files the
+ * view already has go on the changed list. Files that were added and
+ * then went away before the view saw them are dropped altogether.
+ * What this slice put on the added and changed lists is sorted.
+ * Returns whether new changes are left for another slice.
+ */
+static gboolean
+process_new_files (NautilusFilesView *view,
+                   gint64             deadline)
+{
+        GQueue *new_changes, *added, *changed;
+        GList *added_last, *changed_last;
+        PendingChange *change;
+        gboolean should_show_file;
+        guint n_processed;
+
+        new_changes = &view->details->pending_lists[PENDING_LIST_NEW];
+        added = &view->details->pending_lists[PENDING_LIST_ADDED];
+        changed = &view->details->pending_lists[PENDING_LIST_CHANGED];
+        added_last = added->tail;
+        changed_last = changed->tail;
+        n_processed = 0;
+
+        while (!g_queue_is_empty (new_changes) &&
+               !slice_time_is_up (deadline, n_processed)) {
+                change = g_queue_peek_head (new_changes);
+                n_processed++;
+
+                if (change->flags & PENDING_CHANGE_ADDED) {
+                        /* Once the file changed, it may have left the directory too */
+                        if (change->flags & PENDING_CHANGE_CHANGED) {
+                                should_show_file = still_should_show_file (view,
+                                                                           change->fad.file,
+                                                                           change->fad.directory);
                         } else {
-                                if (!in_non_ready) {
-                                        new_added_files = g_list_delete_link (new_added_files, node);
-                                        g_hash_table_insert (non_ready_files, pending, pending);
-                                }
+                                should_show_file = nautilus_files_view_should_show_file (view,
+                                                                                         change->fad.file);
                         }
-                }
-        }
-        file_and_directory_list_free (new_added_files);
 
-        /* Newly changed files go into the old_added_files list if they're ready
-         * and were seen non-ready in the past, into the old_changed_files list
-         * if they are read and were not seen non-ready in the past, and into
-         * the hash table if they're not ready.
-         */
-        for (node = new_changed_files; node != NULL; node = next) {
-                next = node->next;
-                pending = (FileAndDirectory *)node->data;
-                if (!still_should_show_file (view, pending->file, pending->directory) || ready_to_load (pending->file)) {
-                        if (g_hash_table_lookup (non_ready_files, pending) != NULL) {
-                                g_hash_table_remove (non_ready_files, pending);
-                                if (still_should_show_file (view, pending->file, pending->directory)) {
-                                        new_changed_files = g_list_delete_link (new_changed_files, node);
-                                        old_added_files = g_list_prepend (old_added_files, pending);
-                                }
+                        if (!should_show_file) {
+                                pending_change_steal (view, change);
+                                pending_change_free (change);
+                        } else if (ready_to_load (change->fad.file)) {
+                                change->flags = PENDING_CHANGE_ADDED;
+                                pending_change_move (view, change, PENDING_LIST_ADDED);
                         } else {
-                                new_changed_files = g_list_delete_link (new_changed_files, node);
-                                old_changed_files = g_list_prepend (old_changed_files, pending);
+                                pending_change_move (view, change, PENDING_LIST_NOT_READY);
                         }
+                } else if (!still_should_show_file (view, change->fad.file, change->fad.directory) ||
+                           ready_to_load (change->fad.file)) {
+                        pending_change_move (view, change, PENDING_LIST_CHANGED);
+                } else {
+                        /* We'll hear about it again once it's ready */
+                        pending_change_steal (view, change);
+                        pending_change_free (change);
                 }
         }
-        file_and_directory_list_free (new_changed_files);
 
-        /* If any files were added to old_added_files, then resort it. */
-        if (old_added_files != view->details->old_added_files) {
-                view->details->old_added_files = old_added_files;
-                sort_files (view, &view->details->old_added_files);
-        }
-
-        /* Resort old_changed_files too, since file attributes
+        /* Sort the changed files too, since file attributes
          * relevant to sorting could have changed.
          */
-        if (old_changed_files != view->details->old_changed_files) {
-                view->details->old_changed_files = old_changed_files;
-                sort_files (view, &view->details->old_changed_files);
-        }
+        sort_pending_list_tail (view, added, added_last);
+        sort_pending_list_tail (view, changed, changed_last);
 
+        return !g_queue_is_empty (new_changes);
 }
 
 static void
@@ -3641,86 +3685,151 @@ on_end_file_changes (NautilusFilesView *view)
         }
 }
 
-static void
-process_old_files (NautilusFilesView *view)
+static gboolean
+slice_time_is_up (gint64 deadline,
+                  guint  n_processed)
 {
-        GList *files_added, *files_changed, *node;
-        FileAndDirectory *pending;
+        return n_processed % PENDING_FILES_CLOCK_CHECK_INTERVAL == 0 &&
+                g_get_monotonic_time () >= deadline;
+}
+
+/* Hands the ready files to the subclass, until @deadline. Returns
+ * whether files are left for another slice.
+ */
+static gboolean
+process_old_files (NautilusFilesView *view,
+                   gint64             deadline)
+{
+        GQueue *added, *changed;
+        PendingChange *change;
         GList *selection, *files;
+        gint64 start, elapsed;
+        guint n_processed;
+        gboolean send_selection_change;
+
+        added = &view->details->pending_lists[PENDING_LIST_ADDED];
+        changed = &view->details->pending_lists[PENDING_LIST_CHANGED];
+
+        if (g_queue_is_empty (added) && g_queue_is_empty (changed)) {
+                return FALSE;
+        }
 
-        files_added = view->details->old_added_files;
-        files_changed = view->details->old_changed_files;
+        start = g_get_monotonic_time ();
+        if (start >= deadline) {
+                /* Sorting out the new files took the whole slice */
+                return TRUE;
+        }
+        n_processed = 0;
 
+        files = NULL;
+        send_selection_change = FALSE;
 
-        if (files_added != NULL || files_changed != NULL) {
-                gboolean send_selection_change = FALSE;
+        g_signal_emit (view, signals[BEGIN_FILE_CHANGES], 0);
 
-                g_signal_emit (view, signals[BEGIN_FILE_CHANGES], 0);
+        while (!g_queue_is_empty (added) &&
+               !slice_time_is_up (deadline, n_processed)) {
+                change = g_queue_peek_head (added);
+                pending_change_steal (view, change);
+                n_processed++;
+
+                g_signal_emit (view,
+                               signals[ADD_FILE], 0, change->fad.file, change->fad.directory);
+                /* Acknowledge the files that were pending to be revealed */
+                if (g_hash_table_contains (view->details->pending_reveal, change->fad.file)) {
+                        g_hash_table_insert (view->details->pending_reveal,
+                                             change->fad.file,
+                                             GUINT_TO_POINTER (TRUE));
+                }
 
-                for (node = files_added; node != NULL; node = node->next) {
-                        pending = node->data;
-                        g_signal_emit (view,
-                                       signals[ADD_FILE], 0, pending->file, pending->directory);
-                        /* Acknowledge the files that were pending to be revealed */
-                        if (g_hash_table_contains (view->details->pending_reveal, pending->file)) {
+                pending_change_free (change);
+        }
+
+        while (g_queue_is_empty (added) &&
+               !g_queue_is_empty (changed) &&
+               !slice_time_is_up (deadline, n_processed)) {
+                gboolean should_show_file;
+
+                change = g_queue_peek_head (changed);
+                pending_change_steal (view, change);
+                n_processed++;
+
+                should_show_file = still_should_show_file (view, change->fad.file, change->fad.directory);
+                g_signal_emit (view,
+                               signals[should_show_file ? FILE_CHANGED : REMOVE_FILE], 0,
+                               change->fad.file, change->fad.directory);
+
+                /* Acknowledge the files that were pending to be revealed */
+                if (g_hash_table_contains (view->details->pending_reveal, change->fad.file)) {
+                        if (should_show_file) {
                                 g_hash_table_insert (view->details->pending_reveal,
-                                                     pending->file,
+                                                     change->fad.file,
                                                      GUINT_TO_POINTER (TRUE));
+                        } else {
+                                g_hash_table_remove (view->details->pending_reveal,
+                                                     change->fad.file);
                         }
                 }
 
-                for (node = files_changed; node != NULL; node = node->next) {
-                        gboolean should_show_file;
-                        pending = node->data;
-                        should_show_file = still_should_show_file (view, pending->file, pending->directory);
-                        g_signal_emit (view,
-                                       signals[should_show_file ? FILE_CHANGED : REMOVE_FILE], 0,
-                                       pending->file, pending->directory);
-
-                        /* Acknowledge the files that were pending to be revealed */
-                        if (g_hash_table_contains (view->details->pending_reveal, pending->file)) {
-                                if (should_show_file) {
-                                        g_hash_table_insert (view->details->pending_reveal,
-                                                             pending->file,
-                                                             GUINT_TO_POINTER (TRUE));
-                                } else {
-                                        g_hash_table_remove (view->details->pending_reveal,
-                                                             pending->file);
-                                }
-                        }
-                }
+                files = g_list_prepend (files, nautilus_file_ref (change->fad.file));
+                pending_change_free (change);
+        }
 
-                if (files_changed != NULL) {
-                        selection = nautilus_view_get_selection (NAUTILUS_VIEW (view));
-                        files = file_and_directory_list_to_files (files_changed);
-                        send_selection_change = eel_g_lists_sort_and_check_for_intersection
-                                (&files, &selection);
-                        nautilus_file_list_free (files);
-                        nautilus_file_list_free (selection);
-                }
+        if (files != NULL) {
+                selection = nautilus_view_get_selection (NAUTILUS_VIEW (view));
+                send_selection_change = eel_g_lists_sort_and_check_for_intersection
+                        (&files, &selection);
+                nautilus_file_list_free (files);
+                nautilus_file_list_free (selection);
+        }
 
-                file_and_directory_list_free (view->details->old_added_files);
-                view->details->old_added_files = NULL;
+        if (send_selection_change) {
+                /* Send a selection change since some file names could
+                 * have changed.
+                 */
+                nautilus_files_view_send_selection_change (view);
+        }
 
-                file_and_directory_list_free (view->details->old_changed_files);
-                view->details->old_changed_files = NULL;
+        g_signal_emit (view, signals[END_FILE_CHANGES], 0);
 
-                if (send_selection_change) {
-                        /* Send a selection change since some file names could
-                         * have changed.
-                         */
-                        nautilus_files_view_send_selection_change (view);
-                }
+        elapsed = g_get_monotonic_time () - start;
+        view->details->pending_slices++;
+        view->details->pending_slices_time += elapsed;
+        view->details->pending_slices_max_time = MAX (view->details->pending_slices_max_time, elapsed);
 
-                g_signal_emit (view, signals[END_FILE_CHANGES], 0);
-        }
+        DEBUG ("Displayed %u pending files in %" G_GINT64_FORMAT "us",
+               n_processed, elapsed);
+
+        return !g_queue_is_empty (added) || !g_queue_is_empty (changed);
 }
 
 static void
 display_pending_files (NautilusFilesView *view)
 {
-        process_new_files (view);
-        process_old_files (view);
+        gint64 deadline;
+        gboolean files_left;
+
+        /* Both sorting out the new files and displaying the ready ones
+         * share the slice budget */
+        deadline = g_get_monotonic_time () + PENDING_FILES_SLICE_BUDGET_USEC;
+        files_left = process_new_files (view, deadline);
+        files_left |= process_old_files (view, deadline);
+        if (files_left) {
+                /* Come back for the rest after the view had a chance to
+                 * handle input and draw */
+                schedule_idle_display_of_pending_files (view);
+                return;
+        }
+
+        if (view->details->pending_slices > 0) {
+                DEBUG ("Pending files displayed in %u slices, %" G_GINT64_FORMAT "us total, "
+                       "%" G_GINT64_FORMAT "us for the longest one",
+                       view->details->pending_slices,
+                       view->details->pending_slices_time,
+                       view->details->pending_slices_max_time);
+                view->details->pending_slices = 0;
+                view->details->pending_slices_time = 0;
+                view->details->pending_slices_max_time = 0;
+        }
 
         if (!nautilus_files_view_get_selection (NAUTILUS_VIEW (view)) &&
             !view->details->pending_selection &&
@@ -3731,7 +3840,7 @@ display_pending_files (NautilusFilesView *view)
 
         if (view->details->model != NULL
             && nautilus_directory_are_all_files_seen (view->details->model)
-            && g_hash_table_size (view->details->non_ready_files) == 0) {
+            && g_queue_is_empty (&view->details->pending_lists[PENDING_LIST_NOT_READY])) {
                 done_loading (view, TRUE);
         }
 }
@@ -3847,14 +3956,32 @@ static void
 queue_pending_files (NautilusFilesView  *view,
                      NautilusDirectory  *directory,
                      GList              *files,
-                     GList             **pending_list)
+                     PendingChangeFlags  flags)
 {
+        FileAndDirectory key;
+        PendingChange *change;
+        GList *l;
+
         if (files == NULL) {
                 return;
         }
 
-        *pending_list = g_list_concat (file_and_directory_list_from_files (directory, files),
-                                       *pending_list);
+        key.directory = directory;
+        for (l = files; l != NULL; l = l->next) {
+                key.file = l->data;
+                change = g_hash_table_lookup (view->details->pending_changes, &key);
+                if (change == NULL) {
+                        change = pending_change_new (key.file, directory);
+                        change->list = PENDING_LIST_NEW;
+                        g_queue_push_tail_link (&view->details->pending_lists[PENDING_LIST_NEW],
+                                                &change->link);
+                        g_hash_table_add (view->details->pending_changes, change);
+                } else if (change->list != PENDING_LIST_NEW) {
+                        pending_change_move (view, change, PENDING_LIST_NEW);
+                }
+                change->flags |= flags;
+        }
+
         /* Generally we don't want to show the files while the directory is loading
          * the files themselves, so we avoid jumping and oddities. However, for
          * search it can be a long wait, and we actually want to show files as
@@ -3957,7 +4084,7 @@ files_added_callback (NautilusDirectory *directory,
 
         schedule_changes (view);
 
-        queue_pending_files (view, directory, files, &view->details->new_added_files);
+        queue_pending_files (view, directory, files, PENDING_CHANGE_ADDED);
 
         /* The number of items could have changed */
         schedule_update_status (view);
@@ -3984,7 +4111,7 @@ files_changed_callback (NautilusDirectory *directory,
 
         schedule_changes (view);
 
-        queue_pending_files (view, directory, files, &view->details->new_changed_files);
+        queue_pending_files (view, directory, files, PENDING_CHANGE_CHANGED);
 
         /* The free space or the number of items could have changed */
         schedule_update_status (view);
@@ -4004,8 +4131,11 @@ done_loading_callback (NautilusDirectory *directory,
         view = NAUTILUS_FILES_VIEW (callback_data);
 
         nautilus_profile_start (NULL);
-        process_new_files (view);
-        if (g_hash_table_size (view->details->non_ready_files) == 0) {
+        if (process_new_files (view, g_get_monotonic_time () + PENDING_FILES_SLICE_BUDGET_USEC)) {
+                /* The display slices will sort out the rest */
+                unschedule_display_of_pending_files (view);
+                schedule_timeout_display_of_pending_files (view, UPDATE_INTERVAL_MIN);
+        } else if (g_queue_is_empty (&view->details->pending_lists[PENDING_LIST_NOT_READY])) {
                 /* Unschedule a pending update and schedule a new one with the minimal
                  * update interval. This gives the view a short chance at gathering the
                  * (cached) deep counts.
@@ -7373,14 +7503,6 @@ nautilus_files_view_select_file (NautilusFilesView *view,
         nautilus_files_view_call_set_selection (view, &file_list);
 }
 
-static gboolean
-remove_all (gpointer key,
-            gpointer value,
-            gpointer callback_data)
-{
-        return TRUE;
-}
-
 /**
  * nautilus_files_view_stop_loading:
  *
@@ -7397,19 +7519,11 @@ nautilus_files_view_stop_loading (NautilusFilesView *view)
         reset_update_interval (view);
 
         /* Free extra undisplayed files */
-        file_and_directory_list_free (view->details->new_added_files);
-        view->details->new_added_files = NULL;
-
-        file_and_directory_list_free (view->details->new_changed_files);
-        view->details->new_changed_files = NULL;
-
-        g_hash_table_foreach_remove (view->details->non_ready_files, remove_all, NULL);
+        pending_changes_clear (view);
 
-        file_and_directory_list_free (view->details->old_added_files);
-        view->details->old_added_files = NULL;
-
-        file_and_directory_list_free (view->details->old_changed_files);
-        view->details->old_changed_files = NULL;
+        view->details->pending_slices = 0;
+        view->details->pending_slices_time = 0;
+        view->details->pending_slices_max_time = 0;
 
         g_list_free_full (view->details->pending_selection, g_object_unref);
         view->details->pending_selection = NULL;
@@ -7755,6 +7869,18 @@ nautilus_files_view_scroll_event (GtkWidget      *widget,
         return FALSE;
 }
 
+static void
+on_scrolled_window_edge_reached (NautilusFilesView *view,
+                                 GtkPositionType    position)
+{
+        /* Searches only show the best ranked files at first, show some
+         * more when scrolled to the end of them */
+        if (position == GTK_POS_BOTTOM &&
+            nautilus_view_is_searching (NAUTILUS_VIEW (view))) {
+                nautilus_search_directory_load_more_files (NAUTILUS_SEARCH_DIRECTORY (view->details->model));
+        }
+}
+
 
 static void
 action_reload_enabled_changed (GActionGroup      *action_group,
@@ -7887,6 +8013,25 @@ set_search_query_internal (NautilusFilesView *files_view,
 
         if (!nautilus_query_is_empty (query)) {
                 if (nautilus_view_is_searching (NAUTILUS_VIEW (files_view))) {
+                        NautilusSearchDirectory *search;
+                        NautilusQuery *search_query;
+                        gboolean refined;
+
+                        search = NAUTILUS_SEARCH_DIRECTORY (files_view->details->model);
+                        search_query = nautilus_search_directory_get_query (search);
+
+                        /* When the query being typed only got narrower, the
+                         * files found so far are filtered instead of searching
+                         * everything again.
+                         */
+                        refined = search_query == query &&
+                                  nautilus_search_directory_refine_query (search, query);
+                        g_clear_object (&search_query);
+
+                        if (refined) {
+                                return;
+                        }
+
                         /*
                          * Reuse the search directory and reload it.
                          */
@@ -8119,6 +8264,7 @@ nautilus_files_view_init (NautilusFilesView *view)
         NautilusDirectory *templates_directory;
         gchar *templates_uri;
         GApplication *app;
+        int i;
         const gchar *open_accels[] = {
                 "<control>o",
                 "<alt>Down",
@@ -8188,6 +8334,10 @@ nautilus_files_view_init (NautilusFilesView *view)
                                   "scroll-event",
                                   G_CALLBACK (nautilus_files_view_scroll_event),
                                   view);
+        g_signal_connect_swapped (view->details->scrolled_window,
+                                  "edge-reached",
+                                  G_CALLBACK (on_scrolled_window_edge_reached),
+                                  view);
 
         gtk_container_add (GTK_CONTAINER (view->details->overlay), view->details->scrolled_window);
 
@@ -8222,11 +8372,12 @@ nautilus_files_view_init (NautilusFilesView *view)
         /* Default to true; desktop-icon-view sets to false */
         view->details->show_foreign_files = TRUE;
 
-        view->details->non_ready_files =
-                g_hash_table_new_full (file_and_directory_hash,
-                                       file_and_directory_equal,
-                                       (GDestroyNotify)file_and_directory_free,
-                                       NULL);
+        view->details->pending_changes =
+                g_hash_table_new (file_and_directory_hash,
+                                  file_and_directory_equal);
+        for (i = 0; i < N_PENDING_LISTS; i++) {
+                g_queue_init (&view->details->pending_lists[i]);
+        }
 
        view->details->pending_reveal = g_hash_table_new (NULL, NULL);
 
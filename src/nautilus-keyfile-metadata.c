@@ -32,25 +32,272 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+/* The metadata used to live in the keyfile itself; it is now kept in a
+ * binary snapshot next to it, "<keyfile>.db", plus an append-only journal
+ * of the changes made since the snapshot was written, "<keyfile>.db-journal".
+ * Both are sequences of records after a short header:
+ *
+ *   guint8 type, string name, string key, guint32 n_values, n_values strings
+ *
+ * where a string is a guint32 length followed by the bytes, all in host
+ * byte order. Records later in the journal override earlier ones. The
+ * journal is folded back into the snapshot once it gets larger than
+ * the snapshot itself.
+ *
+ * The keyfile is only read to import it, when there is no snapshot yet.
+ */
+
+#define STORE_MAGIC "NAUTMETA"
+#define STORE_BYTE_ORDER 0x01020304
+#define STORE_HEADER_SIZE (sizeof (STORE_MAGIC) - 1 + sizeof (guint32))
+
+#define JOURNAL_MIN_COMPACT_SIZE (64 * 1024)
+
+enum {
+	RECORD_STRING = 1,
+	RECORD_STRINGV = 2
+};
 
 typedef struct {
-	GKeyFile *keyfile;
+	/* a string is kept as a one element list with is_list unset */
+	gchar **values;
+	gboolean is_list;
+} MetadataValue;
+
+typedef struct {
+	gchar *store_filename;
+	gchar *journal_filename;
+
+	/* name -> (key -> MetadataValue) */
+	GHashTable *sections;
+
+	/* records that still have to be appended to the journal */
+	GString *pending;
+	gsize journal_size;
+	gsize store_size;
+	gboolean needs_compaction;
+
 	guint save_in_idle_id;
 } KeyfileMetadataData;
 
 static GHashTable *data_hash = NULL;
 
-static KeyfileMetadataData *
-keyfile_metadata_data_new (const char *keyfile_filename)
+static void
+metadata_value_free (MetadataValue *value)
 {
-	KeyfileMetadataData *data;
-	GKeyFile *retval;
+	g_strfreev (value->values);
+	g_slice_free (MetadataValue, value);
+}
+
+static GHashTable *
+get_section (KeyfileMetadataData *data,
+             const char          *name,
+             gboolean             create)
+{
+	GHashTable *section;
+
+	section = g_hash_table_lookup (data->sections, name);
+
+	if (section == NULL && create) {
+		section = g_hash_table_new_full (g_str_hash, g_str_equal,
+		                                 g_free, (GDestroyNotify) metadata_value_free);
+		g_hash_table_insert (data->sections, g_strdup (name), section);
+	}
+
+	return section;
+}
+
+/* takes ownership of values */
+static MetadataValue *
+set_value (KeyfileMetadataData *data,
+           const char          *name,
+           const char          *key,
+           gchar              **values,
+           gboolean             is_list)
+{
+	MetadataValue *value;
+
+	value = g_slice_new (MetadataValue);
+	value->values = values;
+	value->is_list = is_list;
+
+	g_hash_table_insert (get_section (data, name, TRUE),
+	                     g_strdup (key), value);
+
+	return value;
+}
+
+static void
+append_uint32 (GString *buffer,
+               guint32  value)
+{
+	g_string_append_len (buffer, (const gchar *) &value, sizeof (value));
+}
+
+static void
+append_string (GString    *buffer,
+               const char *string)
+{
+	guint32 length;
+
+	length = strlen (string);
+	append_uint32 (buffer, length);
+	g_string_append_len (buffer, string, length);
+}
+
+static void
+append_header (GString *buffer)
+{
+	g_string_append_len (buffer, STORE_MAGIC, sizeof (STORE_MAGIC) - 1);
+	append_uint32 (buffer, STORE_BYTE_ORDER);
+}
+
+static void
+append_record (GString             *buffer,
+               const char          *name,
+               const char          *key,
+               const MetadataValue *value)
+{
+	guint32 i;
+
+	g_string_append_c (buffer, value->is_list ? RECORD_STRINGV : RECORD_STRING);
+	append_string (buffer, name);
+	append_string (buffer, key);
+	append_uint32 (buffer, g_strv_length (value->values));
+	for (i = 0; value->values[i] != NULL; i++) {
+		append_string (buffer, value->values[i]);
+	}
+}
+
+static gboolean
+read_uint32 (const gchar **p,
+             const gchar  *end,
+             guint32      *value)
+{
+	if (end - *p < (gssize) sizeof (guint32)) {
+		return FALSE;
+	}
+
+	memcpy (value, *p, sizeof (guint32));
+	*p += sizeof (guint32);
+
+	return TRUE;
+}
+
+static gchar *
+read_string (const gchar **p,
+             const gchar  *end)
+{
+	guint32 length;
+	gchar *string;
+
+	if (!read_uint32 (p, end, &length) ||
+	    end - *p < (gssize) length) {
+		return NULL;
+	}
+
+	string = g_strndup (*p, length);
+	*p += length;
+
+	return string;
+}
+
+static gboolean
+check_header (const gchar *contents,
+              gsize        length)
+{
+	guint32 byte_order;
+
+	if (length < STORE_HEADER_SIZE ||
+	    memcmp (contents, STORE_MAGIC, sizeof (STORE_MAGIC) - 1) != 0) {
+		return FALSE;
+	}
+
+	memcpy (&byte_order, contents + sizeof (STORE_MAGIC) - 1, sizeof (guint32));
+
+	return byte_order == STORE_BYTE_ORDER;
+}
+
+/* Loads all the complete records, returning FALSE if anything after
+ * them couldn't be read, e.g. a journal cut short by a crash. Nothing
+ * must be appended after such a tail, or it would hide the new records
+ * on the next load. */
+static gboolean
+load_records (KeyfileMetadataData *data,
+              const gchar         *contents,
+              gsize                length)
+{
+	const gchar *p, *end;
+	gchar *name, *key;
+	gchar **values;
+	guint32 n_values, i;
+	guint8 type;
+
+	p = contents + STORE_HEADER_SIZE;
+	end = contents + length;
+
+	while (p < end) {
+		type = *p++;
+		if (type != RECORD_STRING && type != RECORD_STRINGV) {
+			return FALSE;
+		}
+
+		name = read_string (&p, end);
+		key = read_string (&p, end);
+
+		if (name == NULL || key == NULL ||
+		    !read_uint32 (&p, end, &n_values) ||
+		    n_values > (guint32) (end - p) / sizeof (guint32)) {
+			g_free (name);
+			g_free (key);
+			return FALSE;
+		}
+
+		values = g_new0 (gchar *, n_values + 1);
+		for (i = 0; i < n_values; i++) {
+			values[i] = read_string (&p, end);
+			if (values[i] == NULL) {
+				break;
+			}
+		}
+
+		if (i == n_values) {
+			set_value (data, name, key, values, type == RECORD_STRINGV);
+		} else {
+			g_strfreev (values);
+		}
+
+		g_free (name);
+		g_free (key);
+
+		if (i != n_values) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+#define STRV_TERMINATOR "@x-nautilus-desktop-metadata-term@"
+
+static void
+import_keyfile (KeyfileMetadataData *data,
+                const char          *keyfile_filename)
+{
+	GKeyFile *keyfile;
 	GError *error = NULL;
+	gchar **names, **keys, **values;
+	gsize n_names, n_keys, n_values;
+	gsize i, j;
 
-	retval = g_key_file_new ();
+	keyfile = g_key_file_new ();
 
-	g_key_file_load_from_file (retval,
+	g_key_file_load_from_file (keyfile,
 	                           keyfile_filename,
 	                           G_KEY_FILE_NONE,
 	                           &error);
@@ -64,10 +311,100 @@ keyfile_metadata_data_new (const char *keyfile_filename)
 		}
 
 		g_error_free (error);
+		g_key_file_unref (keyfile);
+		return;
 	}
 
+	names = g_key_file_get_groups (keyfile, &n_names);
+	for (i = 0; i < n_names; i++) {
+		keys = g_key_file_get_keys (keyfile, names[i], &n_keys, NULL);
+
+		for (j = 0; keys != NULL && j < n_keys; j++) {
+			values = g_key_file_get_string_list (keyfile,
+			                                     names[i],
+			                                     keys[j],
+			                                     &n_values,
+			                                     NULL);
+
+			if (values == NULL || n_values < 1) {
+				g_strfreev (values);
+				continue;
+			}
+
+			/* single-length strv are stored with an additional
+			 * terminator, to differentiate them from strings */
+			if (n_values == 2 && g_strcmp0 (values[1], STRV_TERMINATOR) == 0) {
+				g_free (values[1]);
+				values[1] = NULL;
+				set_value (data, names[i], keys[j], values, TRUE);
+			} else {
+				set_value (data, names[i], keys[j], values, n_values > 1);
+			}
+		}
+
+		g_strfreev (keys);
+	}
+
+	g_strfreev (names);
+	g_key_file_unref (keyfile);
+
+	data->needs_compaction = TRUE;
+}
+
+static KeyfileMetadataData *
+keyfile_metadata_data_new (const char *keyfile_filename)
+{
+	KeyfileMetadataData *data;
+	GMappedFile *mapped;
+	gchar *contents;
+	gsize length;
+	GError *error = NULL;
+
 	data = g_slice_new0 (KeyfileMetadataData);
-	data->keyfile = retval;
+	data->store_filename = g_strconcat (keyfile_filename, ".db", NULL);
+	data->journal_filename = g_strconcat (keyfile_filename, ".db-journal", NULL);
+	data->sections = g_hash_table_new_full (g_str_hash, g_str_equal,
+	                                        g_free, (GDestroyNotify) g_hash_table_destroy);
+	data->pending = g_string_new (NULL);
+
+	mapped = g_mapped_file_new (data->store_filename, FALSE, &error);
+
+	if (mapped != NULL &&
+	    check_header (g_mapped_file_get_contents (mapped),
+	                  g_mapped_file_get_length (mapped))) {
+		data->store_size = g_mapped_file_get_length (mapped);
+		if (!load_records (data,
+		                   g_mapped_file_get_contents (mapped),
+		                   data->store_size)) {
+			data->needs_compaction = TRUE;
+		}
+	} else {
+		if (mapped != NULL) {
+			g_warning ("Ignoring the unreadable metadata store %s",
+			           data->store_filename);
+		} else if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+			g_warning ("Unable to open the metadata store: %s",
+			           error->message);
+		}
+
+		import_keyfile (data, keyfile_filename);
+	}
+
+	g_clear_pointer (&mapped, g_mapped_file_unref);
+	g_clear_error (&error);
+
+	if (g_file_get_contents (data->journal_filename, &contents, &length, NULL)) {
+		if (check_header (contents, length)) {
+			data->journal_size = length;
+			/* rewrite the store rather than append after a torn tail */
+			if (!load_records (data, contents, length)) {
+				data->needs_compaction = TRUE;
+			}
+		} else {
+			data->needs_compaction = TRUE;
+		}
+		g_free (contents);
+	}
 
 	return data;
 }
@@ -75,7 +412,10 @@ keyfile_metadata_data_new (const char *keyfile_filename)
 static void
 keyfile_metadata_data_free (KeyfileMetadataData *data)
 {
-	g_key_file_unref (data->keyfile);
+	g_hash_table_destroy (data->sections);
+	g_string_free (data->pending, TRUE);
+	g_free (data->store_filename);
+	g_free (data->journal_filename);
 
 	if (data->save_in_idle_id != 0) {
 		g_source_remove (data->save_in_idle_id);
@@ -84,8 +424,10 @@ keyfile_metadata_data_free (KeyfileMetadataData *data)
 	g_slice_free (KeyfileMetadataData, data);
 }
 
-static GKeyFile *
-get_keyfile (const char *keyfile_filename)
+static void save_in_idle (const char *keyfile_filename);
+
+static KeyfileMetadataData *
+get_data (const char *keyfile_filename)
 {
 	KeyfileMetadataData *data;
 
@@ -104,33 +446,114 @@ get_keyfile (const char *keyfile_filename)
 		g_hash_table_insert (data_hash,
 		                     g_strdup (keyfile_filename),
 		                     data);
+
+		/* write out what was just imported */
+		if (data->needs_compaction) {
+			save_in_idle (keyfile_filename);
+		}
+	}
+
+	return data;
+}
+
+/* Writes all the metadata to a new snapshot and drops the journal */
+static gboolean
+compact (KeyfileMetadataData *data,
+         GError             **error)
+{
+	GHashTableIter sections_iter, keys_iter;
+	gpointer name, section, key, value;
+	GString *contents;
+	gboolean res;
+
+	contents = g_string_new (NULL);
+	append_header (contents);
+
+	g_hash_table_iter_init (&sections_iter, data->sections);
+	while (g_hash_table_iter_next (&sections_iter, &name, &section)) {
+		g_hash_table_iter_init (&keys_iter, section);
+		while (g_hash_table_iter_next (&keys_iter, &key, &value)) {
+			append_record (contents, name, key, value);
+		}
+	}
+
+	res = g_file_set_contents (data->store_filename,
+	                           contents->str, contents->len,
+	                           error);
+
+	if (res) {
+		data->store_size = contents->len;
+		data->journal_size = 0;
+		data->needs_compaction = FALSE;
+		g_string_truncate (data->pending, 0);
+		g_unlink (data->journal_filename);
+	}
+
+	g_string_free (contents, TRUE);
+
+	return res;
+}
+
+static gboolean
+append_to_journal (KeyfileMetadataData *data,
+                   GError             **error)
+{
+	GString *header;
+	gboolean res;
+	int fd;
+
+	fd = g_open (data->journal_filename, O_WRONLY | O_CREAT | O_APPEND, 0600);
+	if (fd < 0) {
+		int saved_errno = errno;
+
+		g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+		             "%s", g_strerror (saved_errno));
+		return FALSE;
 	}
 
-	return data->keyfile;
+	if (data->journal_size == 0) {
+		header = g_string_new (NULL);
+		append_header (header);
+		g_string_prepend_len (data->pending, header->str, header->len);
+		g_string_free (header, TRUE);
+	}
+
+	res = write (fd, data->pending->str, data->pending->len) == (gssize) data->pending->len;
+	if (!res) {
+		int saved_errno = errno;
+
+		g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+		             "%s", g_strerror (saved_errno));
+		/* don't append after a partial record */
+		data->needs_compaction = TRUE;
+	} else {
+		data->journal_size += data->pending->len;
+		g_string_truncate (data->pending, 0);
+	}
+
+	close (fd);
+
+	return res;
 }
 
 static gboolean
 save_in_idle_cb (const gchar *keyfile_filename)
 {
 	KeyfileMetadataData *data;
-	gchar *contents;
-	gsize length;
 	GError *error = NULL;
 
 	data = g_hash_table_lookup (data_hash, keyfile_filename);
 	data->save_in_idle_id = 0;
 
-	contents = g_key_file_to_data (data->keyfile, &length, NULL);
-
-	if (contents != NULL) {
-		g_file_set_contents (keyfile_filename,
-		                     contents, length,
-		                     &error);
-		g_free (contents);
+	if (data->needs_compaction ||
+	    data->journal_size + data->pending->len > MAX (JOURNAL_MIN_COMPACT_SIZE, data->store_size)) {
+		compact (data, &error);
+	} else if (data->pending->len > 0) {
+		append_to_journal (data, &error);
 	}
 
 	if (error != NULL) {
-		g_warning ("Couldn't save the desktop metadata keyfile to disk: %s",
+		g_warning ("Couldn't save the desktop metadata to disk: %s",
 		           error->message);
 		g_error_free (error);
 	}
@@ -158,21 +581,21 @@ save_in_idle (const char *keyfile_filename)
 	                                         g_free);
 }
 
-void
-nautilus_keyfile_metadata_set_string (NautilusFile *file,
-                                      const char *keyfile_filename,
-                                      const gchar *name,
-                                      const gchar *key,
-                                      const gchar *string)
+static void
+set_and_save (NautilusFile *file,
+              const char   *keyfile_filename,
+              const char   *name,
+              const char   *key,
+              gchar       **values,
+              gboolean      is_list)
 {
-	GKeyFile *keyfile;
+	KeyfileMetadataData *data;
+	MetadataValue *value;
 
-	keyfile = get_keyfile (keyfile_filename);
+	data = get_data (keyfile_filename);
 
-	g_key_file_set_string (keyfile,
-	                       name,
-	                       key,
-	                       string);
+	value = set_value (data, name, key, values, is_list);
+	append_record (data->pending, name, key, value);
 
 	save_in_idle (keyfile_filename);
 
@@ -181,7 +604,21 @@ nautilus_keyfile_metadata_set_string (NautilusFile *file,
 	}
 }
 
-#define STRV_TERMINATOR "@x-nautilus-desktop-metadata-term@"
+void
+nautilus_keyfile_metadata_set_string (NautilusFile *file,
+                                      const char *keyfile_filename,
+                                      const gchar *name,
+                                      const gchar *key,
+                                      const gchar *string)
+{
+	gchar **values;
+
+	values = g_new (gchar *, 2);
+	values[0] = g_strdup (string);
+	values[1] = NULL;
+
+	set_and_save (file, keyfile_filename, name, key, values, FALSE);
+}
 
 void
 nautilus_keyfile_metadata_set_stringv (NautilusFile *file,
@@ -190,46 +627,8 @@ nautilus_keyfile_metadata_set_stringv (NautilusFile *file,
                                        const char *key,
                                        const char * const *stringv)
 {
-	GKeyFile *keyfile;
-	guint length;
-	gchar **actual_stringv = NULL;
-	gboolean free_strv = FALSE;
-
-	keyfile = get_keyfile (keyfile_filename);
-
-	/* if we would be setting a single-length strv, append a fake
-	 * terminator to the array, to be able to differentiate it later from
-	 * the single string case
-	 */
-	length = g_strv_length ((gchar **) stringv);
-
-	if (length == 1) {
-		actual_stringv = g_malloc0 (3 * sizeof (gchar *));
-		actual_stringv[0] = (gchar *) stringv[0];
-		actual_stringv[1] = STRV_TERMINATOR;
-		actual_stringv[2] = NULL;
-
-		length = 2;
-		free_strv = TRUE;
-	} else {
-		actual_stringv = (gchar **) stringv;
-	}
-
-	g_key_file_set_string_list (keyfile,
-	                            name,
-	                            key,
-	                            (const gchar **) actual_stringv,
-	                            length);
-
-	save_in_idle (keyfile_filename);
-
-	if (nautilus_keyfile_metadata_update_from_keyfile (file, keyfile_filename, name)) {
-		nautilus_file_changed (file);
-	}
-
-	if (free_strv) {
-		g_free (actual_stringv);
-	}
+	set_and_save (file, keyfile_filename, name, key,
+	              g_strdupv ((gchar **) stringv), TRUE);
 }
 
 gboolean
@@ -237,79 +636,41 @@ nautilus_keyfile_metadata_update_from_keyfile (NautilusFile *file,
                                                const char *keyfile_filename,
                                                const gchar *name)
 {
-	gchar **keys, **values;
-	const gchar *actual_values[2];
-	const gchar *key, *value;
+	GHashTable *section;
+	GHashTableIter iter;
+	gpointer key;
+	MetadataValue *value;
 	gchar *gio_key;
-	gsize length, values_length;
-	GKeyFile *keyfile;
 	GFileInfo *info;
-	gint idx;
 	gboolean res;
 
-	keyfile = get_keyfile (keyfile_filename);
+	section = get_section (get_data (keyfile_filename), name, FALSE);
 
-	keys = g_key_file_get_keys (keyfile,
-	                            name,
-	                            &length,
-	                            NULL);
-
-	if (keys == NULL) {
+	if (section == NULL) {
 		return FALSE;
 	}
 
 	info = g_file_info_new ();
 
-	for (idx = 0; idx < length; idx++) {
-		key = keys[idx];
-		values = g_key_file_get_string_list (keyfile,
-		                                     name,
-		                                     key,
-		                                     &values_length,
-		                                     NULL);
-
+	g_hash_table_iter_init (&iter, section);
+	while (g_hash_table_iter_next (&iter, &key, (gpointer *) &value)) {
 		gio_key = g_strconcat ("metadata::", key, NULL);
 
-		if (values_length < 1) {
-			continue;
-		} else if (values_length == 1) {
-			g_file_info_set_attribute_string (info,
-			                                  gio_key,
-			                                  values[0]);
-		} else if (values_length == 2) {
-			/* deal with the fact that single-length strv are stored
-			 * with an additional terminator in the keyfile string, to differentiate
-			 * them from the regular string case.
-			 */
-			value = values[1];
-
-			if (g_strcmp0 (value, STRV_TERMINATOR) == 0) {
-				/* if the 2nd value is the terminator, remove it */
-				actual_values[0] = values[0];
-				actual_values[1] = NULL;
-
-				g_file_info_set_attribute_stringv (info,
-				                                   gio_key,
-				                                   (gchar **) actual_values);
-			} else {
-				/* otherwise, set it as a regular strv */
-				g_file_info_set_attribute_stringv (info,
-				                                   gio_key,
-				                                   values);
-			}
-		} else {
+		if (value->is_list) {
 			g_file_info_set_attribute_stringv (info,
 			                                   gio_key,
-			                                   values);
+			                                   value->values);
+		} else if (value->values[0] != NULL) {
+			g_file_info_set_attribute_string (info,
+			                                  gio_key,
+			                                  value->values[0]);
 		}
 
 		g_free (gio_key);
-		g_strfreev (values);
 	}
 
 	res = nautilus_file_update_metadata_from_info (file, info);
 
-	g_strfreev (keys);
 	g_object_unref (info);
 
 	return res;
@@ -48,6 +48,9 @@ static GQuark attribute_name_q,
 /* msec delay after Loading... dummy row turns into (empty) */
 #define LOADING_TO_EMPTY_DELAY 100
 
+/* Number of icon surfaces kept around for the icon columns */
+#define ICON_SURFACE_CACHE_SIZE 256
+
 static guint list_model_signals[LAST_SIGNAL] = { 0 };
 
 static int nautilus_list_model_file_entry_compare_func (gconstpointer a,
@@ -74,9 +77,21 @@ struct NautilusListModelDetails {
 
 	GPtrArray *columns;
 
-	GList *highlight_files;
+	GHashTable *highlight_files; /* set of NautilusFile's */
+
+	/* IconSurfaceEntry -> link in icon_surfaces_lru, most recently
+	 * used first. Rows showing the same icon share its surface. */
+	GHashTable *icon_surfaces;
+	GQueue icon_surfaces_lru;
 };
 
+typedef struct {
+	GdkPixbuf *pixbuf;
+	int scale;
+	gboolean highlighted;
+	cairo_surface_t *surface;
+} IconSurfaceEntry;
+
 typedef struct {
 	NautilusListModel *model;
 	
@@ -247,6 +262,86 @@ nautilus_list_model_get_icon_scale (NautilusListModel *model)
 	return retval;
 }
 
+static guint
+icon_surface_entry_hash (gconstpointer key)
+{
+	const IconSurfaceEntry *entry = key;
+
+	return g_direct_hash (entry->pixbuf) ^ (entry->scale << 1) ^ entry->highlighted;
+}
+
+static gboolean
+icon_surface_entry_equal (gconstpointer a,
+			  gconstpointer b)
+{
+	const IconSurfaceEntry *entry_a = a;
+	const IconSurfaceEntry *entry_b = b;
+
+	return entry_a->pixbuf == entry_b->pixbuf &&
+		entry_a->scale == entry_b->scale &&
+		entry_a->highlighted == entry_b->highlighted;
+}
+
+static void
+icon_surface_entry_free (IconSurfaceEntry *entry)
+{
+	g_object_unref (entry->pixbuf);
+	cairo_surface_destroy (entry->surface);
+	g_slice_free (IconSurfaceEntry, entry);
+}
+
+/* Returns the surface for @icon, converting it only if it isn't one of
+ * the recently used ones. The icon pixbufs themselves are shared by the
+ * icon info cache, so the same themed icon maps to the same entry; the
+ * entry holds on to the pixbuf so that it can't be mistaken for a new
+ * one at the same address. */
+static cairo_surface_t *
+lookup_icon_surface (NautilusListModel *model,
+		     GdkPixbuf *icon,
+		     int scale,
+		     gboolean highlighted)
+{
+	IconSurfaceEntry lookup_entry, *entry;
+	GdkPixbuf *rendered_icon;
+	GList *link;
+
+	lookup_entry.pixbuf = icon;
+	lookup_entry.scale = scale;
+	lookup_entry.highlighted = highlighted;
+
+	link = g_hash_table_lookup (model->details->icon_surfaces, &lookup_entry);
+	if (link != NULL) {
+		g_queue_unlink (&model->details->icon_surfaces_lru, link);
+		g_queue_push_head_link (&model->details->icon_surfaces_lru, link);
+
+		return ((IconSurfaceEntry *) link->data)->surface;
+	}
+
+	entry = g_slice_new (IconSurfaceEntry);
+	entry->pixbuf = g_object_ref (icon);
+	entry->scale = scale;
+	entry->highlighted = highlighted;
+
+	rendered_icon = highlighted ? eel_create_spotlight_pixbuf (icon) : NULL;
+	entry->surface = gdk_cairo_surface_create_from_pixbuf (rendered_icon != NULL ? rendered_icon : icon,
+							       scale, NULL);
+	g_clear_object (&rendered_icon);
+
+	g_queue_push_head (&model->details->icon_surfaces_lru, entry);
+	g_hash_table_insert (model->details->icon_surfaces, entry,
+			     model->details->icon_surfaces_lru.head);
+
+	while (model->details->icon_surfaces_lru.length > ICON_SURFACE_CACHE_SIZE) {
+		IconSurfaceEntry *old_entry;
+
+		old_entry = g_queue_pop_tail (&model->details->icon_surfaces_lru);
+		g_hash_table_remove (model->details->icon_surfaces, old_entry);
+		icon_surface_entry_free (old_entry);
+	}
+
+	return entry->surface;
+}
+
 guint
 nautilus_list_model_get_icon_size_for_zoom_level (NautilusListZoomLevel zoom_level)
 {
@@ -270,11 +365,11 @@ nautilus_list_model_get_value (GtkTreeModel *tree_model, GtkTreeIter *iter, int
 	FileEntry *file_entry;
 	NautilusFile *file;
 	char *str;
-	GdkPixbuf *icon, *rendered_icon;
+	GdkPixbuf *icon;
 	int icon_size, icon_scale;
 	NautilusListZoomLevel zoom_level;
 	NautilusFileIconFlags flags;
-	cairo_surface_t *surface;
+	gboolean highlighted;
 	
 	model = (NautilusListModel *)tree_model;
 
@@ -312,39 +407,27 @@ nautilus_list_model_get_value (GtkTreeModel *tree_model, GtkTreeIter *iter, int
 				NAUTILUS_FILE_ICON_FLAGS_USE_ONE_EMBLEM;
 
 			if (model->details->drag_view != NULL) {
-				GtkTreePath *path_a, *path_b;
-				
+				GtkTreePath *drag_path;
+				GtkTreeIter drag_iter;
+
 				gtk_tree_view_get_drag_dest_row (model->details->drag_view,
-								 &path_a,
+								 &drag_path,
 								 NULL);
-				if (path_a != NULL) {
-					path_b = gtk_tree_model_get_path (tree_model, iter);
-
-					if (gtk_tree_path_compare (path_a, path_b) == 0) {
+				if (drag_path != NULL) {
+					if (gtk_tree_model_get_iter (tree_model, &drag_iter, drag_path) &&
+					    drag_iter.user_data == iter->user_data) {
 						flags |= NAUTILUS_FILE_ICON_FLAGS_FOR_DRAG_ACCEPT;
 					}
-						
-					gtk_tree_path_free (path_a);
-					gtk_tree_path_free (path_b);
-				}
-			}
-
-			icon = nautilus_file_get_icon_pixbuf (file, icon_size, TRUE, icon_scale, flags);
-
-			if (model->details->highlight_files != NULL &&
-			    g_list_find_custom (model->details->highlight_files,
-			                        file, (GCompareFunc) nautilus_file_compare_location))
-			{
-				rendered_icon = eel_create_spotlight_pixbuf (icon);
 
-				if (rendered_icon != NULL) {
-					g_object_unref (icon);
-					icon = rendered_icon;
+					gtk_tree_path_free (drag_path);
 				}
 			}
 
-			surface = gdk_cairo_surface_create_from_pixbuf (icon, icon_scale, NULL);
-			g_value_take_boxed (value, surface);
+			highlighted = model->details->highlight_files != NULL &&
+				g_hash_table_contains (model->details->highlight_files, file);
+
+			icon = nautilus_file_get_icon_pixbuf (file, icon_size, TRUE, icon_scale, flags);
+			g_value_set_boxed (value, lookup_icon_surface (model, icon, icon_scale, highlighted));
 			g_object_unref (icon);
 		}
 		break;
@@ -1376,10 +1459,13 @@ nautilus_list_model_finalize (GObject *object)
 	model = NAUTILUS_LIST_MODEL (object);
 
 	if (model->details->highlight_files != NULL) {
-		nautilus_file_list_free (model->details->highlight_files);
+		g_hash_table_destroy (model->details->highlight_files);
 		model->details->highlight_files = NULL;
 	}
 
+	g_hash_table_destroy (model->details->icon_surfaces);
+	g_queue_free_full (&model->details->icon_surfaces_lru, (GDestroyNotify) icon_surface_entry_free);
+
 	g_free (model->details);
 
 	G_OBJECT_CLASS (nautilus_list_model_parent_class)->finalize (object);
@@ -1395,6 +1481,8 @@ nautilus_list_model_init (NautilusListModel *model)
 	model->details->stamp = g_random_int ();
 	model->details->sort_attribute = 0;
 	model->details->columns = g_ptr_array_new ();
+	model->details->icon_surfaces = g_hash_table_new (icon_surface_entry_hash,
+							  icon_surface_entry_equal);
 }
 
 static void
@@ -1498,6 +1586,7 @@ nautilus_list_model_subdirectory_done_loading (NautilusListModel *model, Nautilu
 
 static void
 refresh_row (gpointer data,
+             gpointer value,
              gpointer user_data)
 {
 	NautilusFile *file;
@@ -1523,17 +1612,24 @@ void
 nautilus_list_model_set_highlight_for_files (NautilusListModel *model,
 					     GList *files)
 {
+	GList *l;
+
 	if (model->details->highlight_files != NULL) {
-		g_list_foreach (model->details->highlight_files,
-		                refresh_row, model);
-		nautilus_file_list_free (model->details->highlight_files);
+		g_hash_table_foreach (model->details->highlight_files,
+		                      refresh_row, model);
+		g_hash_table_destroy (model->details->highlight_files);
 		model->details->highlight_files = NULL;
 	}
 
 	if (files != NULL) {
-		model->details->highlight_files = nautilus_file_list_copy (files);
-		g_list_foreach (model->details->highlight_files,
-		                refresh_row, model);
-
+		model->details->highlight_files =
+			g_hash_table_new_full (g_direct_hash, g_direct_equal,
+			                       (GDestroyNotify) nautilus_file_unref, NULL);
+		for (l = files; l != NULL; l = l->next) {
+			g_hash_table_add (model->details->highlight_files,
+			                  nautilus_file_ref (l->data));
+		}
+		g_hash_table_foreach (model->details->highlight_files,
+		                      refresh_row, model);
 	}
 }
@@ -58,15 +58,18 @@ guint
 nautilus_metadata_get_id (const char *metadata)
 {
   static GHashTable *hash;
+  GHashTable *new_hash;
   int i;
 
-  if (hash == NULL)
+  /* Also called from the threads that load directories */
+  if (g_once_init_enter (&hash))
     {
-      hash = g_hash_table_new (g_str_hash, g_str_equal);
+      new_hash = g_hash_table_new (g_str_hash, g_str_equal);
       for (i = 0; used_metadata_names[i] != NULL; i++)
-	g_hash_table_insert (hash,
+	g_hash_table_insert (new_hash,
 			     used_metadata_names[i],
 			     GINT_TO_POINTER (i + 1));
+      g_once_init_leave (&hash, new_hash);
     }
 
   return GPOINTER_TO_INT (g_hash_table_lookup (hash, metadata));
@@ -420,6 +420,80 @@ nautilus_mime_get_default_application_for_file (NautilusFile *file)
 	return app;
 }
 
+/* The default application of a file only depends on its content type,
+ * whether it's local and, if nothing handles the type, its uri scheme,
+ * so when activating many files they're looked up once per activation.
+ */
+typedef struct {
+	GHashTable *by_type[2];
+	GHashTable *by_scheme;
+} DefaultApplicationCache;
+
+static void
+app_info_unref0 (gpointer app)
+{
+	if (app != NULL) {
+		g_object_unref (app);
+	}
+}
+
+static void
+default_application_cache_init (DefaultApplicationCache *cache)
+{
+	cache->by_type[0] = g_hash_table_new_full (g_str_hash, g_str_equal,
+						   g_free, app_info_unref0);
+	cache->by_type[1] = g_hash_table_new_full (g_str_hash, g_str_equal,
+						   g_free, app_info_unref0);
+	cache->by_scheme = g_hash_table_new_full (g_str_hash, g_str_equal,
+						  g_free, app_info_unref0);
+}
+
+static void
+default_application_cache_destroy (DefaultApplicationCache *cache)
+{
+	g_hash_table_destroy (cache->by_type[0]);
+	g_hash_table_destroy (cache->by_type[1]);
+	g_hash_table_destroy (cache->by_scheme);
+}
+
+/* Same as nautilus_mime_get_default_application_for_file () */
+static GAppInfo *
+default_application_cache_lookup (DefaultApplicationCache *cache,
+				  NautilusFile *file)
+{
+	GAppInfo *app;
+	char *mime_type;
+	char *uri_scheme;
+	gboolean remote;
+
+	if (!nautilus_mime_actions_check_if_required_attributes_ready (file)) {
+		return NULL;
+	}
+
+	remote = !nautilus_file_is_local_or_fuse (file);
+	mime_type = nautilus_file_get_mime_type (file);
+	if (!g_hash_table_lookup_extended (cache->by_type[remote], mime_type,
+					   NULL, (gpointer *) &app)) {
+		app = g_app_info_get_default_for_type (mime_type, remote);
+		g_hash_table_insert (cache->by_type[remote], g_strdup (mime_type), app);
+	}
+	g_free (mime_type);
+
+	if (app == NULL) {
+		uri_scheme = nautilus_file_get_uri_scheme (file);
+		if (uri_scheme != NULL) {
+			if (!g_hash_table_lookup_extended (cache->by_scheme, uri_scheme,
+							   NULL, (gpointer *) &app)) {
+				app = g_app_info_get_default_for_uri_scheme (uri_scheme);
+				g_hash_table_insert (cache->by_scheme, g_strdup (uri_scheme), app);
+			}
+			g_free (uri_scheme);
+		}
+	}
+
+	return app != NULL ? g_object_ref (app) : NULL;
+}
+
 static int
 file_compare_by_mime_type (NautilusFile *file_a,
 			   NautilusFile *file_b)
@@ -767,24 +841,24 @@ list_to_parameters_foreach (GAppInfo *application,
 /**
  * make_activation_parameters
  *
- * Construct a list of ApplicationLaunchParameters from a list of NautilusFiles,
+ * Construct a list of ApplicationLaunchParameters from a list of LaunchLocations,
  * where files that have the same default application are put into the same
  * launch parameter, and others are put into the unhandled_files list.
  *
- * @files: Files to use for construction.
- * @unhandled_files: Files without any default application will be put here.
+ * @locations: Locations to use for construction.
+ * @unhandled_uris: Uris without any default application will be put here.
  * 
  * Return value: Newly allocated list of ApplicationLaunchParameters.
  **/
 static GList *
-make_activation_parameters (GList *uris,
+make_activation_parameters (GList *locations,
 			    GList **unhandled_uris)
 {
 	GList *ret, *l, *app_uris;
-	NautilusFile *file;
+	LaunchLocation *location;
 	GAppInfo *app, *old_app;
 	GHashTable *app_table;
-	char *uri;
+	DefaultApplicationCache app_cache;
 
 	ret = NULL;
 	*unhandled_uris = NULL;
@@ -794,12 +868,12 @@ make_activation_parameters (GList *uris,
 		 (GEqualFunc) g_app_info_equal,
 		 (GDestroyNotify) g_object_unref,
 		 (GDestroyNotify) g_list_free);
+	default_application_cache_init (&app_cache);
 
-	for (l = uris; l != NULL; l = l->next) {
-		uri = l->data;
-		file = nautilus_file_get_by_uri (uri);
+	for (l = locations; l != NULL; l = l->next) {
+		location = l->data;
 
-		app = nautilus_mime_get_default_application_for_file (file);
+		app = default_application_cache_lookup (&app_cache, location->file);
 		if (app != NULL) {
 			app_uris = NULL;
 
@@ -808,19 +882,18 @@ make_activation_parameters (GList *uris,
 							  (gpointer *) &app_uris)) {
 				g_hash_table_steal (app_table, old_app);
 
-				app_uris = g_list_prepend (app_uris, uri);
+				app_uris = g_list_prepend (app_uris, location->uri);
 
 				g_object_unref (app);
 				app = old_app;
 			} else {
-				app_uris = g_list_prepend (NULL, uri);
+				app_uris = g_list_prepend (NULL, location->uri);
 			}
 
 			g_hash_table_insert (app_table, app, app_uris);
 		} else {
-			*unhandled_uris = g_list_prepend (*unhandled_uris, uri);
+			*unhandled_uris = g_list_prepend (*unhandled_uris, location->uri);
 		}
-		nautilus_file_unref (file);
 	}
 
 	g_hash_table_foreach (app_table,
@@ -828,6 +901,7 @@ make_activation_parameters (GList *uris,
 			      &ret);
 
 	g_hash_table_destroy (app_table);
+	default_application_cache_destroy (&app_cache);
 
 	*unhandled_uris = g_list_reverse (*unhandled_uris);
 
@@ -1503,7 +1577,7 @@ activate_files (ActivateParameters *parameters)
 	GList *launch_desktop_files;
 	GList *launch_files;
 	GList *launch_in_terminal_files;
-	GList *open_in_app_uris;
+	GList *open_in_app_locations;
 	GList *open_in_app_parameters;
 	GList *unhandled_open_in_app_uris;
 	ApplicationLaunchParameters *one_parameters;
@@ -1526,7 +1600,7 @@ activate_files (ActivateParameters *parameters)
 	launch_desktop_files = NULL;
 	launch_files = NULL;
 	launch_in_terminal_files = NULL;
-	open_in_app_uris = NULL;
+	open_in_app_locations = NULL;
 	open_in_view_files = NULL;
 
 	for (l = parameters->locations; l != NULL; l = l->next) {
@@ -1561,7 +1635,7 @@ activate_files (ActivateParameters *parameters)
 			open_in_view_files = g_list_prepend (open_in_view_files, file);
 			break;
 		case ACTIVATION_ACTION_OPEN_IN_APPLICATION :
-			open_in_app_uris = g_list_prepend (open_in_app_uris, location->uri);
+			open_in_app_locations = g_list_prepend (open_in_app_locations, location);
 			break;
 		case ACTIVATION_ACTION_DO_NOTHING :
 			break;
@@ -1677,19 +1751,19 @@ activate_files (ActivateParameters *parameters)
 	open_in_app_parameters = NULL;
 	unhandled_open_in_app_uris = NULL;
 
-	if (open_in_app_uris != NULL) {
-		open_in_app_uris = g_list_reverse (open_in_app_uris);
+	if (open_in_app_locations != NULL) {
+		open_in_app_locations = g_list_reverse (open_in_app_locations);
 
 		open_in_app_parameters = make_activation_parameters
-			(open_in_app_uris, &unhandled_open_in_app_uris);
+			(open_in_app_locations, &unhandled_open_in_app_uris);
 	}
 
 	num_apps = g_list_length (open_in_app_parameters);
 	num_unhandled = g_list_length (unhandled_open_in_app_uris);
-	num_files = g_list_length (open_in_app_uris);
+	num_files = g_list_length (open_in_app_locations);
 	open_files = TRUE;
 
-	if (open_in_app_uris != NULL &&
+	if (open_in_app_locations != NULL &&
 	    (!parameters->user_confirmation ||
 	     num_files + num_unhandled > SILENT_OPEN_LIMIT) &&
 	     num_apps > 1) {
@@ -1753,7 +1827,7 @@ activate_files (ActivateParameters *parameters)
 	g_list_free (launch_files);
 	g_list_free (launch_in_terminal_files);
 	g_list_free (open_in_view_files);
-	g_list_free (open_in_app_uris);
+	g_list_free (open_in_app_locations);
 	g_list_free (open_in_app_parameters);
 	g_list_free (unhandled_open_in_app_uris);
 	
@@ -1892,12 +1966,47 @@ activate_callback (GList *files, gpointer callback_data)
 	}
 }
 
+/* Activation usually starts from a view that already has everything
+ * activation needs for the files it shows, so only wait on the ones
+ * that are missing something.
+ */
+static void
+call_when_locations_ready (ActivateParameters       *parameters,
+			   NautilusFileListCallback  callback)
+{
+	GList *files, *l;
+	LaunchLocation *location;
+
+	files = NULL;
+	for (l = parameters->locations; l != NULL; l = l->next) {
+		location = l->data;
+
+		if (!nautilus_mime_actions_check_if_required_attributes_ready (location->file)) {
+			files = g_list_prepend (files,
+						nautilus_file_ref (location->file));
+		}
+	}
+
+	if (files == NULL) {
+		callback (NULL, parameters);
+		return;
+	}
+
+	files = g_list_reverse (files);
+	nautilus_file_list_call_when_ready
+		(files,
+		 nautilus_mime_actions_get_required_file_attributes (),
+		 &parameters->files_handle,
+		 callback, parameters);
+	nautilus_file_list_free (files);
+}
+
 static void
 activate_activation_uris_ready_callback (GList *files_ignore,
 					 gpointer callback_data)
 {
 	ActivateParameters *parameters = callback_data;
-	GList *l, *next, *files;
+	GList *l, *next;
 	NautilusFile *file;
 	LaunchLocation *location;
 
@@ -1956,26 +2065,21 @@ activate_activation_uris_ready_callback (GList *files_ignore,
 
 
 	/* get the parameters for the actual files */	
-	files = get_file_list_for_launch_locations (parameters->locations);
-	nautilus_file_list_call_when_ready
-		(files,
-		 nautilus_mime_actions_get_required_file_attributes (),
-		 &parameters->files_handle,
-		 activate_callback, parameters);
-	nautilus_file_list_free (files);
+	call_when_locations_ready (parameters, activate_callback);
 }
 
 static void
 activation_get_activation_uris (ActivateParameters *parameters)
 {
-	GList *l, *files;
+	GList *l, *next;
 	NautilusFile *file;
 	LaunchLocation *location;
 
 	/* link target info might be stale, re-read it */
-	for (l = parameters->locations; l != NULL; l = l->next) {
+	for (l = parameters->locations; l != NULL; l = next) {
 		location = l->data;
 		file = location->file;
+		next = l->next;
 
 		if (file_was_cancelled (file)) {
 			launch_location_free (location);
@@ -1989,12 +2093,7 @@ activation_get_activation_uris (ActivateParameters *parameters)
 		return;
 	}
 
-	files = get_file_list_for_launch_locations (parameters->locations);
-	nautilus_file_list_call_when_ready
-		(files, nautilus_mime_actions_get_required_file_attributes (),
-		 &parameters->files_handle,
-		 activate_activation_uris_ready_callback, parameters);
-	nautilus_file_list_free (files);
+	call_when_locations_ready (parameters, activate_activation_uris_ready_callback);
 }
 
 static void
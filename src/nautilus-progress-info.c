@@ -56,6 +56,10 @@ struct _NautilusProgressInfo
 	double progress;
         gdouble remaining_time;
         gdouble elapsed_time;
+        guint64 files_done;
+        guint64 files_total;
+        guint64 bytes_done;
+        guint64 bytes_total;
 	gboolean activity_mode;
 	gboolean started;
 	gboolean finished;
@@ -712,6 +716,40 @@ nautilus_progress_info_get_total_elapsed_time (NautilusProgressInfo *info)
         return elapsed_time;
 }
 
+/* Counts behind the progress fraction, for consumers that want more than
+ * a percentage. They don't emit anything by themselves, they are meant to
+ * be updated right before nautilus_progress_info_set_progress().
+ */
+void
+nautilus_progress_info_set_transferred (NautilusProgressInfo *info,
+                                        guint64               files_done,
+                                        guint64               files_total,
+                                        guint64               bytes_done,
+                                        guint64               bytes_total)
+{
+        G_LOCK (progress_info);
+        info->files_done = files_done;
+        info->files_total = files_total;
+        info->bytes_done = bytes_done;
+        info->bytes_total = bytes_total;
+        G_UNLOCK (progress_info);
+}
+
+void
+nautilus_progress_info_get_transferred (NautilusProgressInfo *info,
+                                        guint64              *files_done,
+                                        guint64              *files_total,
+                                        guint64              *bytes_done,
+                                        guint64              *bytes_total)
+{
+        G_LOCK (progress_info);
+        *files_done = info->files_done;
+        *files_total = info->files_total;
+        *bytes_done = info->bytes_done;
+        *bytes_total = info->bytes_total;
+        G_UNLOCK (progress_info);
+}
+
 void
 nautilus_progress_info_set_destination (NautilusProgressInfo *info,
                                         GFile                *file)
@@ -85,6 +85,16 @@ void          nautilus_progress_info_set_elapsed_time (NautilusProgressInfo *inf
                                                        gdouble               time);
 gdouble       nautilus_progress_info_get_elapsed_time (NautilusProgressInfo *info);
 gdouble       nautilus_progress_info_get_total_elapsed_time (NautilusProgressInfo *info);
+void          nautilus_progress_info_set_transferred (NautilusProgressInfo *info,
+                                                      guint64               files_done,
+                                                      guint64               files_total,
+                                                      guint64               bytes_done,
+                                                      guint64               bytes_total);
+void          nautilus_progress_info_get_transferred (NautilusProgressInfo *info,
+                                                      guint64              *files_done,
+                                                      guint64              *files_total,
+                                                      guint64              *bytes_done,
+                                                      guint64              *bytes_total);
 
 void nautilus_progress_info_set_destination (NautilusProgressInfo *info,
                                              GFile                *file);
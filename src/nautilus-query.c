@@ -46,8 +46,15 @@ struct _NautilusQuery {
         gboolean recursive;
 	char **prepared_words;
         GMutex prepared_words_mutex;
+
+        /* Content type -> MIME_TYPE_ACCEPTED or MIME_TYPE_REJECTED */
+        GHashTable *mime_type_matches;
+        GMutex mime_type_matches_mutex;
 };
 
+#define MIME_TYPE_ACCEPTED GINT_TO_POINTER (1)
+#define MIME_TYPE_REJECTED GINT_TO_POINTER (2)
+
 static void  nautilus_query_class_init       (NautilusQueryClass *class);
 static void  nautilus_query_init             (NautilusQuery      *query);
 
@@ -78,6 +85,9 @@ finalize (GObject *object)
         g_clear_object (&query->location);
         g_clear_pointer (&query->date_range, g_ptr_array_unref);
         g_mutex_clear (&query->prepared_words_mutex);
+        g_list_free_full (query->mime_types, g_free);
+        g_clear_pointer (&query->mime_type_matches, g_hash_table_destroy);
+        g_mutex_clear (&query->mime_type_matches_mutex);
 
 	G_OBJECT_CLASS (nautilus_query_parent_class)->finalize (object);
 }
@@ -303,6 +313,7 @@ nautilus_query_init (NautilusQuery *query)
         query->search_type = g_settings_get_enum (nautilus_preferences, "search-filter-time-type");
         query->search_content = NAUTILUS_QUERY_SEARCH_CONTENT_SIMPLE;
         g_mutex_init (&query->prepared_words_mutex);
+        g_mutex_init (&query->mime_type_matches_mutex);
 }
 
 static gchar *
@@ -317,11 +328,31 @@ prepare_string_for_compare (const gchar *string)
 	return res;
 }
 
+/* ASCII is unchanged by normalization and only needs its case folded,
+ * except in locales like Turkish where "I" doesn't lower to "i" */
+static gboolean
+ascii_strdown_is_utf8_strdown (void)
+{
+	static gsize result = 0;
+
+	if (g_once_init_enter (&result)) {
+		gchar *lower;
+
+		lower = g_utf8_strdown ("I", -1);
+		g_once_init_leave (&result, strcmp (lower, "i") == 0 ? 1 : 2);
+		g_free (lower);
+	}
+
+	return result == 1;
+}
+
 gdouble
 nautilus_query_matches_string (NautilusQuery *query,
 			       const gchar *string)
 {
-	gchar *prepared_string, *ptr;
+	gchar buffer[256];
+	gchar *prepared_string, *allocated_string, *ptr;
+	gsize len;
 	gboolean found;
 	gdouble retval;
 	gint idx, nonexact_malus;
@@ -337,7 +368,23 @@ nautilus_query_matches_string (NautilusQuery *query,
 		g_free (prepared_string);
 	}
 
-	prepared_string = prepare_string_for_compare (string);
+	/* Avoid allocating for the common case of short ASCII names, this is
+	 * called for every file crawled by a search */
+	allocated_string = NULL;
+	len = strlen (string);
+	if (len < sizeof (buffer) &&
+	    g_str_is_ascii (string) &&
+	    ascii_strdown_is_utf8_strdown ()) {
+		gsize i;
+
+		for (i = 0; i <= len; i++) {
+			buffer[i] = g_ascii_tolower (string[i]);
+		}
+		prepared_string = buffer;
+	} else {
+		allocated_string = prepare_string_for_compare (string);
+		prepared_string = allocated_string;
+	}
 	found = TRUE;
 	ptr = NULL;
 	nonexact_malus = 0;
@@ -353,12 +400,12 @@ nautilus_query_matches_string (NautilusQuery *query,
         g_mutex_unlock (&query->prepared_words_mutex);
 
 	if (!found) {
-		g_free (prepared_string);
+		g_free (allocated_string);
 		return -1;
 	}
 
 	retval = MAX (10.0, 50.0 - (gdouble) (ptr - prepared_string) - nonexact_malus);
-	g_free (prepared_string);
+	g_free (allocated_string);
 
 	return retval;
 }
@@ -414,6 +461,14 @@ nautilus_query_set_location (NautilusQuery *query,
 
 }
 
+static void
+clear_mime_type_matches (NautilusQuery *query)
+{
+        g_mutex_lock (&query->mime_type_matches_mutex);
+        g_clear_pointer (&query->mime_type_matches, g_hash_table_destroy);
+        g_mutex_unlock (&query->mime_type_matches_mutex);
+}
+
 GList *
 nautilus_query_get_mime_types (NautilusQuery *query)
 {
@@ -429,6 +484,7 @@ nautilus_query_set_mime_types (NautilusQuery *query, GList *mime_types)
 
         g_list_free_full (query->mime_types, g_free);
         query->mime_types = g_list_copy_deep (mime_types, (GCopyFunc) g_strdup, NULL);
+        clear_mime_type_matches (query);
 
         g_object_notify (G_OBJECT (query), "mimetypes");
 }
@@ -439,10 +495,100 @@ nautilus_query_add_mime_type (NautilusQuery *query, const char *mime_type)
         g_return_if_fail (NAUTILUS_IS_QUERY (query));
 
         query->mime_types = g_list_append (query->mime_types, g_strdup (mime_type));
+        clear_mime_type_matches (query);
 
         g_object_notify (G_OBJECT (query), "mimetypes");
 }
 
+/**
+ * nautilus_query_matches_mime_type:
+ * @query: a #NautilusQuery
+ * @mime_type: the content type of a file
+ *
+ * Checks @mime_type against the mime types of @query, including their
+ * subclasses. The result is remembered, so that checking many files only
+ * walks the mime type hierarchy once per distinct type.
+ *
+ * Returns: %TRUE if a file of type @mime_type is acceptable, which is always
+ * the case if @query has no mime types.
+ */
+gboolean
+nautilus_query_matches_mime_type (NautilusQuery *query,
+                                  const char    *mime_type)
+{
+        gpointer match;
+        GList *l;
+
+        g_return_val_if_fail (NAUTILUS_IS_QUERY (query), FALSE);
+
+        if (query->mime_types == NULL) {
+                return TRUE;
+        }
+
+        if (mime_type == NULL) {
+                return FALSE;
+        }
+
+        g_mutex_lock (&query->mime_type_matches_mutex);
+        if (query->mime_type_matches == NULL) {
+                query->mime_type_matches = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                                  g_free, NULL);
+        }
+
+        match = g_hash_table_lookup (query->mime_type_matches, mime_type);
+        if (match == NULL) {
+                match = MIME_TYPE_REJECTED;
+                for (l = query->mime_types; l != NULL; l = l->next) {
+                        if (g_content_type_is_a (mime_type, l->data)) {
+                                match = MIME_TYPE_ACCEPTED;
+                                break;
+                        }
+                }
+                g_hash_table_insert (query->mime_type_matches, g_strdup (mime_type), match);
+        }
+        g_mutex_unlock (&query->mime_type_matches_mutex);
+
+        return match == MIME_TYPE_ACCEPTED;
+}
+
+/**
+ * nautilus_query_matches_file_name_mime_type:
+ * @query: a #NautilusQuery
+ * @file_name: the name of a regular, non-empty file
+ *
+ * Checks the mime types of @query using only the name of a file, the way
+ * the content type of a local file is guessed before its contents are
+ * sniffed.
+ *
+ * Returns: %NAUTILUS_QUERY_MIME_MATCH_UNKNOWN if the name is not enough to
+ * know the content type of the file, and the contents have to be looked at.
+ */
+NautilusQueryMimeMatch
+nautilus_query_matches_file_name_mime_type (NautilusQuery *query,
+                                            const char    *file_name)
+{
+        char *content_type;
+        gboolean uncertain;
+        gboolean matches;
+
+        g_return_val_if_fail (NAUTILUS_IS_QUERY (query), NAUTILUS_QUERY_MIME_MATCH_NO);
+
+        if (query->mime_types == NULL) {
+                return NAUTILUS_QUERY_MIME_MATCH_YES;
+        }
+
+        content_type = g_content_type_guess (file_name, NULL, 0, &uncertain);
+        if (uncertain) {
+                g_free (content_type);
+                return NAUTILUS_QUERY_MIME_MATCH_UNKNOWN;
+        }
+
+        matches = nautilus_query_matches_mime_type (query, content_type);
+        g_free (content_type);
+
+        return matches ? NAUTILUS_QUERY_MIME_MATCH_YES : NAUTILUS_QUERY_MIME_MATCH_NO;
+}
+
 gboolean
 nautilus_query_get_show_hidden_files (NautilusQuery *query)
 {
@@ -612,3 +758,176 @@ nautilus_query_is_empty (NautilusQuery *query)
 
         return FALSE;
 }
+
+/**
+ * nautilus_query_copy:
+ * @query: a #NautilusQuery
+ *
+ * Creates a new query with the same search criteria as @query. Useful to
+ * keep a snapshot of a query that is edited in place while a search for it
+ * runs.
+ *
+ * Returns: (transfer full): a new #NautilusQuery.
+ */
+NautilusQuery *
+nautilus_query_copy (NautilusQuery *query)
+{
+        NautilusQuery *copy;
+
+        g_return_val_if_fail (NAUTILUS_IS_QUERY (query), NULL);
+
+        copy = nautilus_query_new ();
+
+        copy->text = g_strdup (query->text);
+        g_set_object (&copy->location, query->location);
+        copy->mime_types = g_list_copy_deep (query->mime_types, (GCopyFunc) g_strdup, NULL);
+        copy->show_hidden = query->show_hidden;
+        copy->date_range = nautilus_query_get_date_range (query);
+        copy->search_type = query->search_type;
+        copy->search_content = query->search_content;
+        copy->recursive = query->recursive;
+
+        return copy;
+}
+
+static gchar **
+get_words_for_compare (NautilusQuery *query)
+{
+        gchar *prepared_string;
+        gchar **words;
+
+        prepared_string = prepare_string_for_compare (query->text);
+        words = g_strsplit (prepared_string, " ", -1);
+        g_free (prepared_string);
+
+        return words;
+}
+
+static gboolean
+words_are_refinement_of (NautilusQuery *query,
+                         NautilusQuery *previous)
+{
+        gchar **words, **previous_words;
+        gboolean contained;
+        gint i, j;
+
+        if (g_strcmp0 (query->text, previous->text) == 0) {
+                return TRUE;
+        }
+
+        if (!query->text || !previous->text) {
+                return FALSE;
+        }
+
+        words = get_words_for_compare (query);
+        previous_words = get_words_for_compare (previous);
+
+        /* A name matches when it contains every word, so it is enough that
+         * each previous word is contained in one of the new ones. */
+        contained = TRUE;
+        for (i = 0; contained && previous_words[i] != NULL; i++) {
+                if (previous_words[i][0] == '\0') {
+                        continue;
+                }
+
+                contained = FALSE;
+                for (j = 0; words[j] != NULL; j++) {
+                        if (strstr (words[j], previous_words[i]) != NULL) {
+                                contained = TRUE;
+                                break;
+                        }
+                }
+        }
+
+        g_strfreev (words);
+        g_strfreev (previous_words);
+
+        return contained;
+}
+
+static gboolean
+mime_types_are_refinement_of (NautilusQuery *query,
+                              NautilusQuery *previous)
+{
+        GList *l, *m;
+        gboolean found;
+
+        if (previous->mime_types == NULL) {
+                return TRUE;
+        }
+
+        if (query->mime_types == NULL) {
+                return FALSE;
+        }
+
+        for (l = query->mime_types; l != NULL; l = l->next) {
+                found = FALSE;
+                for (m = previous->mime_types; m != NULL; m = m->next) {
+                        if (g_content_type_is_a (l->data, m->data)) {
+                                found = TRUE;
+                                break;
+                        }
+                }
+
+                if (!found) {
+                        return FALSE;
+                }
+        }
+
+        return TRUE;
+}
+
+static gboolean
+date_range_is_refinement_of (NautilusQuery *query,
+                             NautilusQuery *previous)
+{
+        GDateTime *initial_date, *end_date;
+        GDateTime *previous_initial_date, *previous_end_date;
+
+        if (previous->date_range == NULL) {
+                return TRUE;
+        }
+
+        if (query->date_range == NULL ||
+            query->search_type != previous->search_type) {
+                return FALSE;
+        }
+
+        initial_date = g_ptr_array_index (query->date_range, 0);
+        end_date = g_ptr_array_index (query->date_range, 1);
+        previous_initial_date = g_ptr_array_index (previous->date_range, 0);
+        previous_end_date = g_ptr_array_index (previous->date_range, 1);
+
+        return g_date_time_compare (initial_date, previous_initial_date) >= 0 &&
+               g_date_time_compare (end_date, previous_end_date) <= 0;
+}
+
+/**
+ * nautilus_query_is_refinement_of:
+ * @query: a #NautilusQuery
+ * @previous: the query searched for before @query
+ *
+ * Checks whether every file matching @query also matches @previous, which
+ * is what usually happens while typing a search. In that case the results
+ * of @previous can be filtered instead of searching again from scratch.
+ *
+ * Returns: %TRUE if @query only narrows down @previous.
+ */
+gboolean
+nautilus_query_is_refinement_of (NautilusQuery *query,
+                                 NautilusQuery *previous)
+{
+        g_return_val_if_fail (NAUTILUS_IS_QUERY (query), FALSE);
+        g_return_val_if_fail (NAUTILUS_IS_QUERY (previous), FALSE);
+
+        if (query->recursive != previous->recursive ||
+            query->show_hidden != previous->show_hidden ||
+            query->search_content != previous->search_content ||
+            !g_file_equal (query->location, previous->location)) {
+                return FALSE;
+        }
+
+        return words_are_refinement_of (query, previous) &&
+               mime_types_are_refinement_of (query, previous) &&
+               date_range_is_refinement_of (query, previous);
+}
@@ -35,6 +35,12 @@ typedef enum {
         NAUTILUS_QUERY_SEARCH_CONTENT_FULL_TEXT,
 } NautilusQuerySearchContent;
 
+typedef enum {
+        NAUTILUS_QUERY_MIME_MATCH_NO,
+        NAUTILUS_QUERY_MIME_MATCH_YES,
+        NAUTILUS_QUERY_MIME_MATCH_UNKNOWN
+} NautilusQueryMimeMatch;
+
 #define NAUTILUS_TYPE_QUERY		(nautilus_query_get_type ())
 
 G_DECLARE_FINAL_TYPE (NautilusQuery, nautilus_query, NAUTILUS, QUERY, GObject)
@@ -54,6 +60,9 @@ void           nautilus_query_set_location       (NautilusQuery *query,
 GList *        nautilus_query_get_mime_types     (NautilusQuery *query);
 void           nautilus_query_set_mime_types     (NautilusQuery *query, GList *mime_types);
 void           nautilus_query_add_mime_type      (NautilusQuery *query, const char *mime_type);
+gboolean       nautilus_query_matches_mime_type  (NautilusQuery *query, const char *mime_type);
+NautilusQueryMimeMatch nautilus_query_matches_file_name_mime_type (NautilusQuery *query,
+                                                                   const char    *file_name);
 
 NautilusQuerySearchContent nautilus_query_get_search_content (NautilusQuery *query);
 void                       nautilus_query_set_search_content (NautilusQuery              *query,
@@ -83,4 +92,9 @@ char *         nautilus_query_to_readable_string (NautilusQuery *query);
 
 gboolean       nautilus_query_is_empty           (NautilusQuery *query);
 
+NautilusQuery *nautilus_query_copy               (NautilusQuery *query);
+
+gboolean       nautilus_query_is_refinement_of   (NautilusQuery *query,
+                                                  NautilusQuery *previous);
+
 #endif /* NAUTILUS_QUERY_H */
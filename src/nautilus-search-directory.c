@@ -28,15 +28,32 @@
 #include "nautilus-search-provider.h"
 #include "nautilus-search-engine.h"
 #include "nautilus-search-engine-model.h"
+#include "nautilus-ui-utilities.h"
 
 #include <eel/eel-glib-extensions.h>
+#include <eel/eel-string.h>
 #include <gtk/gtk.h>
 #include <gio/gio.h>
 #include <string.h>
 #include <sys/time.h>
 
+/* Searches can find millions of files, but only the best ranked ones are
+ * looked at. Files are only created for that many hits at a time, the rest
+ * are kept until nautilus_search_directory_load_more_files() asks for them. */
+#define SEARCH_FILES_PAGE_SIZE 500
+
+/* A hit, without the NautilusFile until it's one of the best ranked */
+typedef struct {
+	NautilusFile *file;
+	gdouble relevance;
+	eel_ref_str uri;
+} SearchResult;
+
 struct NautilusSearchDirectoryDetails {
 	NautilusQuery *query;
+	/* What the current results were searched for. The query is edited
+	 * in place while typing, so keep a copy to compare against. */
+	NautilusQuery *searched_query;
 
 	NautilusSearchEngine *engine;
 
@@ -60,6 +77,10 @@ struct NautilusSearchDirectoryDetails {
 	GList *files;
 	GHashTable *files_hash;
 
+	guint max_files;
+	GPtrArray *file_results; /* SearchResults of files, worst first heap */
+	GPtrArray *pending_results; /* SearchResults without file, best first heap */
+
 	GList *monitor_list;
 	GList *callback_list;
 	GList *pending_callback_list;
@@ -109,32 +130,179 @@ static void search_engine_error (NautilusSearchEngine *engine, const char *error
 static void search_callback_file_ready_callback (NautilusFile *file, gpointer data);
 static void file_changed (NautilusFile *file, NautilusSearchDirectory *search);
 
+static SearchResult *
+search_result_new (NautilusSearchHit *hit)
+{
+	SearchResult *result;
+
+	result = g_slice_new (SearchResult);
+	result->file = NULL;
+	result->relevance = nautilus_search_hit_get_relevance (hit);
+	/* Shared with the hit and the search engine */
+	result->uri = eel_ref_str_ref ((eel_ref_str) nautilus_search_hit_get_uri (hit));
+
+	return result;
+}
+
 static void
-reset_file_list (NautilusSearchDirectory *search)
+search_result_free (SearchResult *result)
 {
-	GList *list, *monitor_list;
-	NautilusFile *file;
-	SearchMonitor *monitor;
+	eel_ref_str_unref (result->uri);
+	g_slice_free (SearchResult, result);
+}
 
-	/* Remove file connections */
-	for (list = search->details->files; list != NULL; list = list->next) {
-		file = list->data;
+static gboolean
+search_result_is_before (SearchResult *result,
+			 SearchResult *other,
+			 gboolean      best_first)
+{
+	return best_first ? result->relevance > other->relevance :
+			    result->relevance < other->relevance;
+}
 
-		/* Disconnect change handler */
-		g_signal_handlers_disconnect_by_func (file, file_changed, search);
+static void
+result_heap_push (GPtrArray    *heap,
+		  SearchResult *result,
+		  gboolean      best_first)
+{
+	guint i, parent;
+
+	g_ptr_array_add (heap, result);
+
+	for (i = heap->len - 1; i > 0; i = parent) {
+		parent = (i - 1) / 2;
+		if (!search_result_is_before (heap->pdata[i], heap->pdata[parent], best_first)) {
+			break;
+		}
+
+		heap->pdata[i] = heap->pdata[parent];
+		heap->pdata[parent] = result;
+	}
+}
+
+static SearchResult *
+result_heap_pop (GPtrArray *heap,
+		 gboolean   best_first)
+{
+	SearchResult *top, *result;
+	guint i, child, len;
+
+	top = heap->pdata[0];
+	len = heap->len - 1;
+	result = heap->pdata[len];
+	heap->pdata[0] = result;
+	g_ptr_array_set_size (heap, len);
+
+	for (i = 0; (child = 2 * i + 1) < len; i = child) {
+		if (child + 1 < len &&
+		    search_result_is_before (heap->pdata[child + 1], heap->pdata[child], best_first)) {
+			child++;
+		}
 
-		/* Remove monitors */
-		for (monitor_list = search->details->monitor_list; monitor_list; 
-		     monitor_list = monitor_list->next) {
-			monitor = monitor_list->data;
-			nautilus_file_monitor_remove (file, monitor);
+		if (!search_result_is_before (heap->pdata[child], result, best_first)) {
+			break;
 		}
+
+		heap->pdata[i] = heap->pdata[child];
+		heap->pdata[child] = result;
+	}
+
+	return top;
+}
+
+static void
+result_heap_clear (GPtrArray *heap)
+{
+	g_ptr_array_foreach (heap, (GFunc) search_result_free, NULL);
+	g_ptr_array_set_size (heap, 0);
+}
+
+static void
+disconnect_file (NautilusSearchDirectory *search,
+		 NautilusFile            *file)
+{
+	GList *monitor_list;
+	SearchMonitor *monitor;
+
+	/* Disconnect change handler */
+	g_signal_handlers_disconnect_by_func (file, file_changed, search);
+
+	/* Remove monitors */
+	for (monitor_list = search->details->monitor_list; monitor_list; 
+	     monitor_list = monitor_list->next) {
+		monitor = monitor_list->data;
+		nautilus_file_monitor_remove (file, monitor);
+	}
+}
+
+static void
+reset_file_list (NautilusSearchDirectory *search)
+{
+	GList *list;
+
+	/* Remove file connections */
+	for (list = search->details->files; list != NULL; list = list->next) {
+		disconnect_file (search, list->data);
 	}
 	
 	nautilus_file_list_free (search->details->files);
 	search->details->files = NULL;
 
 	g_hash_table_remove_all (search->details->files_hash);
+
+	result_heap_clear (search->details->file_results);
+	result_heap_clear (search->details->pending_results);
+	search->details->max_files = SEARCH_FILES_PAGE_SIZE;
+}
+
+/* Returns the file for @result, borrowed from the files list */
+static NautilusFile *
+add_result_file (NautilusSearchDirectory *search,
+		 SearchResult            *result)
+{
+	NautilusFile *file;
+	SearchMonitor *monitor;
+	GList *monitor_list;
+
+	file = nautilus_file_get_by_uri (result->uri);
+	nautilus_file_set_search_relevance (file, result->relevance);
+
+	for (monitor_list = search->details->monitor_list; monitor_list; monitor_list = monitor_list->next) {
+		monitor = monitor_list->data;
+
+		/* Add monitors */
+		nautilus_file_monitor_add (file, monitor, monitor->monitor_attributes);
+	}
+
+	g_signal_connect (file, "changed", G_CALLBACK (file_changed), search);
+
+	search->details->files = g_list_prepend (search->details->files, file);
+	g_hash_table_add (search->details->files_hash, file);
+
+	result->file = file;
+	result_heap_push (search->details->file_results, result, FALSE);
+
+	return file;
+}
+
+/* Moves the worst ranked file back to the pending results, and returns it
+ * with the reference the files list had */
+static NautilusFile *
+remove_worst_result_file (NautilusSearchDirectory *search)
+{
+	SearchResult *result;
+	NautilusFile *file;
+
+	result = result_heap_pop (search->details->file_results, FALSE);
+	file = result->file;
+	result->file = NULL;
+	result_heap_push (search->details->pending_results, result, TRUE);
+
+	disconnect_file (search, file);
+	g_hash_table_remove (search->details->files_hash, file);
+	search->details->files = g_list_remove (search->details->files, file);
+
+	return file;
 }
 
 static void
@@ -182,6 +350,8 @@ start_search (NautilusSearchDirectory *search)
 	set_hidden_files (search);
 	nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (search->details->engine),
 					    search->details->query);
+	g_clear_object (&search->details->searched_query);
+	search->details->searched_query = nautilus_query_copy (search->details->query);
 
 	model_provider = nautilus_search_engine_get_model_provider (search->details->engine);
 	nautilus_search_engine_model_set_model (model_provider, search->details->base_model);
@@ -549,12 +719,14 @@ search_engine_hits_added (NautilusSearchEngine *engine, GList *hits,
 			  NautilusSearchDirectory *search)
 {
 	GList *hit_list;
-	GList *file_list;
+	GList *added, *removed, *link;
 	NautilusFile *file;
-	SearchMonitor *monitor;
-	GList *monitor_list;
+	NautilusSearchHitScorer *scorer;
+	SearchResult *result, *worst;
 
-	file_list = NULL;
+	added = NULL;
+	removed = NULL;
+	scorer = NULL;
 
 	for (hit_list = hits; hit_list != NULL; hit_list = hit_list->next) {
 		NautilusSearchHit *hit = hit_list->data;
@@ -566,27 +738,47 @@ search_engine_hits_added (NautilusSearchEngine *engine, GList *hits,
 			continue;
 		}
 
-		nautilus_search_hit_compute_scores (hit, search->details->query);
-
-		file = nautilus_file_get_by_uri (uri);
-		nautilus_file_set_search_relevance (file, nautilus_search_hit_get_relevance (hit));
-
-		for (monitor_list = search->details->monitor_list; monitor_list; monitor_list = monitor_list->next) {
-			monitor = monitor_list->data;
-
-			/* Add monitors */
-			nautilus_file_monitor_add (file, monitor, monitor->monitor_attributes);
+		/* Hits might come scored from the provider already */
+		if (!nautilus_search_hit_has_relevance (hit)) {
+			if (scorer == NULL) {
+				scorer = nautilus_search_hit_scorer_new (search->details->query);
+			}
+			nautilus_search_hit_scorer_compute_scores (scorer, hit);
 		}
 
-		g_signal_connect (file, "changed", G_CALLBACK (file_changed), search),
+		result = search_result_new (hit);
+
+		if (search->details->file_results->len >= search->details->max_files) {
+			worst = g_ptr_array_index (search->details->file_results, 0);
+			if (!search_result_is_before (result, worst, TRUE)) {
+				result_heap_push (search->details->pending_results, result, TRUE);
+				continue;
+			}
+
+			/* Make room for the better one */
+			file = remove_worst_result_file (search);
+			link = g_list_find (added, file);
+			if (link != NULL) {
+				added = g_list_delete_link (added, link);
+				nautilus_file_unref (file);
+			} else {
+				removed = g_list_prepend (removed, file);
+			}
+		}
 
-		file_list = g_list_prepend (file_list, file);
-		g_hash_table_add (search->details->files_hash, file);
+		added = g_list_prepend (added, add_result_file (search, result));
 	}
 	
-	search->details->files = g_list_concat (search->details->files, file_list);
+	g_clear_pointer (&scorer, nautilus_search_hit_scorer_free);
+
+	nautilus_directory_emit_files_added (NAUTILUS_DIRECTORY (search), added);
+	g_list_free (added);
 
-	nautilus_directory_emit_files_added (NAUTILUS_DIRECTORY (search), file_list);
+	/* Files that aren't in the directory anymore are removed by clients */
+	if (removed != NULL) {
+		nautilus_directory_emit_files_changed (NAUTILUS_DIRECTORY (search), removed);
+		nautilus_file_list_free (removed);
+	}
 
 	file = nautilus_directory_get_corresponding_file (NAUTILUS_DIRECTORY (search));
 	nautilus_file_emit_changed (file);
@@ -819,6 +1011,7 @@ search_dispose (GObject *object)
 	}
 
 	g_clear_object (&search->details->query);
+	g_clear_object (&search->details->searched_query);
 	stop_search (search);
         search_disconnect_engine(search);
 
@@ -835,6 +1028,8 @@ search_finalize (GObject *object)
 	search = NAUTILUS_SEARCH_DIRECTORY (object);
 
 	g_hash_table_destroy (search->details->files_hash);
+	g_ptr_array_free (search->details->file_results, TRUE);
+	g_ptr_array_free (search->details->pending_results, TRUE);
 
 	G_OBJECT_CLASS (nautilus_search_directory_parent_class)->finalize (object);
 }
@@ -846,6 +1041,9 @@ nautilus_search_directory_init (NautilusSearchDirectory *search)
 						       NautilusSearchDirectoryDetails);
 
 	search->details->files_hash = g_hash_table_new (g_direct_hash, g_direct_equal);
+	search->details->max_files = SEARCH_FILES_PAGE_SIZE;
+	search->details->file_results = g_ptr_array_new ();
+	search->details->pending_results = g_ptr_array_new ();
 
         search->details->engine = nautilus_search_engine_new ();
         search_connect_engine (search);
@@ -987,3 +1185,237 @@ nautilus_search_directory_get_query (NautilusSearchDirectory *search)
 					   
 	return NULL;
 }
+
+static gdouble
+get_match_bonus (gdouble match)
+{
+	/* Same as nautilus_search_hit_compute_scores () */
+	return match > 0 ? MIN (500, 10.0 * match) : 0.0;
+}
+
+static gboolean
+file_matches_query (NautilusFile  *file,
+		    NautilusQuery *query)
+{
+	GList *mime_types, *l;
+	GPtrArray *date_range;
+	NautilusDateType date_type;
+	time_t date;
+	gboolean found;
+
+	mime_types = nautilus_query_get_mime_types (query);
+	found = (mime_types == NULL);
+	for (l = mime_types; l != NULL; l = l->next) {
+		if (nautilus_file_is_mime_type (file, l->data)) {
+			found = TRUE;
+			break;
+		}
+	}
+	g_list_free_full (mime_types, g_free);
+
+	date_range = nautilus_query_get_date_range (query);
+	if (found && date_range != NULL) {
+		if (nautilus_query_get_search_type (query) == NAUTILUS_QUERY_SEARCH_TYPE_LAST_ACCESS) {
+			date_type = NAUTILUS_DATE_TYPE_ACCESSED;
+		} else {
+			date_type = NAUTILUS_DATE_TYPE_MODIFIED;
+		}
+
+		found = nautilus_file_get_date (file, date_type, &date) &&
+			nautilus_file_date_in_between (date,
+						       g_ptr_array_index (date_range, 0),
+						       g_ptr_array_index (date_range, 1));
+	}
+	g_clear_pointer (&date_range, g_ptr_array_unref);
+
+	return found;
+}
+
+static gboolean
+query_filters_are_equal (NautilusQuery *query,
+			 NautilusQuery *other)
+{
+	NautilusQuery *filters, *other_filters;
+	gboolean equal;
+
+	filters = nautilus_query_copy (query);
+	other_filters = nautilus_query_copy (other);
+	nautilus_query_set_text (filters, "");
+	nautilus_query_set_text (other_filters, "");
+
+	equal = nautilus_query_is_refinement_of (filters, other_filters) &&
+		nautilus_query_is_refinement_of (other_filters, filters);
+
+	g_object_unref (filters);
+	g_object_unref (other_filters);
+
+	return equal;
+}
+
+/**
+ * nautilus_search_directory_refine_query:
+ * @search: a #NautilusSearchDirectory
+ * @query: the new query
+ *
+ * Narrows down the current search to @query, if @query is a refinement of
+ * what was searched for, see nautilus_query_is_refinement_of(). The files
+ * found so far that don't match anymore are removed with a files-changed
+ * signal, and a search that is still running continues with @query from
+ * where it is.
+ *
+ * Returns: %TRUE if the search was refined, %FALSE if the directory has to
+ * be reloaded for @query.
+ */
+gboolean
+nautilus_search_directory_refine_query (NautilusSearchDirectory *search,
+					NautilusQuery           *query)
+{
+	NautilusQuery *searched_query;
+	GList *l, *next, *changed, *removed;
+	NautilusFile *file;
+	char *name;
+	gdouble match, searched_match;
+	gboolean check_info, same_text;
+	char *text, *searched_text;
+	GPtrArray *file_results;
+	SearchResult *result;
+	guint i;
+
+	searched_query = search->details->searched_query;
+
+	if (!search->details->search_running || searched_query == NULL) {
+		return FALSE;
+	}
+
+	/* Hits without a file can't be matched against the new query */
+	if (search->details->pending_results->len > 0) {
+		return FALSE;
+	}
+
+	/* Hidden files are searched for depending on the monitors */
+	nautilus_query_set_show_hidden_files (query,
+					      nautilus_query_get_show_hidden_files (searched_query));
+
+	/* The files are only matched by name, not by content */
+	if (nautilus_query_get_search_content (query) != NAUTILUS_QUERY_SEARCH_CONTENT_SIMPLE ||
+	    !nautilus_query_is_refinement_of (query, searched_query)) {
+		return FALSE;
+	}
+
+	/* Matching the mime type or date needs the file info, which the files
+	 * that were just found might not have yet */
+	check_info = !query_filters_are_equal (query, searched_query);
+	for (l = search->details->files; check_info && l != NULL; l = l->next) {
+		if (!nautilus_file_check_if_ready (l->data, NAUTILUS_FILE_ATTRIBUTE_INFO)) {
+			return FALSE;
+		}
+	}
+
+	if (!nautilus_search_engine_refine (search->details->engine, query)) {
+		return FALSE;
+	}
+
+	text = nautilus_query_get_text (query);
+	searched_text = nautilus_query_get_text (searched_query);
+	same_text = g_strcmp0 (text, searched_text) == 0;
+	g_free (text);
+	g_free (searched_text);
+
+	changed = NULL;
+	removed = NULL;
+	for (l = search->details->files; l != NULL; l = next) {
+		next = l->next;
+		file = l->data;
+
+		name = nautilus_file_get_display_name (file);
+		match = same_text ? 0 : nautilus_query_matches_string (query, name);
+
+		if (match == -1 || (check_info && !file_matches_query (file, query))) {
+			search->details->files = g_list_remove_link (search->details->files, l);
+			removed = g_list_concat (l, removed);
+		} else if (!same_text) {
+			searched_match = nautilus_query_matches_string (searched_query, name);
+			if (match != searched_match) {
+				nautilus_file_set_search_relevance (file,
+								    file->details->search_relevance +
+								    get_match_bonus (match) -
+								    get_match_bonus (searched_match));
+				changed = g_list_prepend (changed, file);
+			}
+		}
+
+		g_free (name);
+	}
+
+	for (l = removed; l != NULL; l = l->next) {
+		file = l->data;
+
+		g_hash_table_remove (search->details->files_hash, file);
+		disconnect_file (search, file);
+	}
+
+	/* Rank again the files that are left */
+	file_results = search->details->file_results;
+	search->details->file_results = g_ptr_array_new ();
+	for (i = 0; i < file_results->len; i++) {
+		result = g_ptr_array_index (file_results, i);
+
+		if (g_hash_table_contains (search->details->files_hash, result->file)) {
+			result->relevance = result->file->details->search_relevance;
+			result_heap_push (search->details->file_results, result, FALSE);
+		} else {
+			search_result_free (result);
+		}
+	}
+	g_ptr_array_free (file_results, TRUE);
+
+	g_clear_object (&search->details->searched_query);
+	search->details->searched_query = nautilus_query_copy (query);
+	nautilus_search_directory_set_query (search, query);
+
+	/* Files that aren't in the directory anymore are removed by clients */
+	changed = g_list_concat (changed, g_list_copy (removed));
+	if (changed != NULL) {
+		nautilus_directory_emit_files_changed (NAUTILUS_DIRECTORY (search), changed);
+	}
+
+	g_list_free (changed);
+	nautilus_file_list_free (removed);
+
+	return TRUE;
+}
+
+/**
+ * nautilus_search_directory_load_more_files:
+ * @search: a #NautilusSearchDirectory
+ *
+ * Adds the next best ranked hits that were found to the directory files,
+ * if there are more hits than files.
+ */
+void
+nautilus_search_directory_load_more_files (NautilusSearchDirectory *search)
+{
+	GList *added;
+	NautilusFile *file;
+	SearchResult *result;
+
+	if (search->details->pending_results->len == 0) {
+		return;
+	}
+
+	search->details->max_files += SEARCH_FILES_PAGE_SIZE;
+
+	added = NULL;
+	while (search->details->file_results->len < search->details->max_files &&
+	       search->details->pending_results->len > 0) {
+		result = result_heap_pop (search->details->pending_results, TRUE);
+		added = g_list_prepend (added, add_result_file (search, result));
+	}
+
+	nautilus_directory_emit_files_added (NAUTILUS_DIRECTORY (search), added);
+	g_list_free (added);
+
+	file = nautilus_directory_get_corresponding_file (NAUTILUS_DIRECTORY (search));
+	nautilus_file_emit_changed (file);
+	nautilus_file_unref (file);
+}
@@ -57,6 +57,9 @@ char   *nautilus_search_directory_generate_new_uri     (void);
 NautilusQuery *nautilus_search_directory_get_query       (NautilusSearchDirectory *search);
 void           nautilus_search_directory_set_query       (NautilusSearchDirectory *search,
 							  NautilusQuery           *query);
+gboolean       nautilus_search_directory_refine_query    (NautilusSearchDirectory *search,
+							  NautilusQuery           *query);
+void           nautilus_search_directory_load_more_files (NautilusSearchDirectory *search);
 
 NautilusDirectory *
                nautilus_search_directory_get_base_model (NautilusSearchDirectory  *search);
@@ -0,0 +1,751 @@
+/*
+ * Copyright (C) 2016 Red Hat, Inc
+ *
+ * Nautilus is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * Nautilus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; see the file COPYING.  If not,
+ * see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+#include "nautilus-search-hit.h"
+#include "nautilus-search-provider.h"
+#include "nautilus-search-engine-content.h"
+#include "nautilus-ui-utilities.h"
+#define DEBUG_FLAG NAUTILUS_DEBUG_SEARCH
+#include "nautilus-debug.h"
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+#define BATCH_SIZE 100
+
+/* Files bigger than this are most likely not text anyway */
+#define MAX_FILE_SIZE (64 * 1024 * 1024)
+
+/* A file with a NUL byte at the start is considered binary */
+#define BINARY_CHECK_SIZE 8192
+
+/* Files are read, not mapped: a mapped file that is truncated meanwhile
+ * would crash us with SIGBUS when reading past its new end */
+#define READ_CHUNK_SIZE (256 * 1024)
+
+/* How many files the crawler lets the workers fall behind */
+#define MAX_QUEUED_FILES 1024
+
+enum {
+	PROP_0,
+	PROP_RUNNING,
+	NUM_PROPERTIES
+};
+
+typedef struct {
+	NautilusSearchEngineContent *engine;
+	GCancellable *cancellable;
+
+	NautilusQuery *query;
+	GList *mime_types;
+	char **words;
+	gboolean recursive;
+	gboolean show_hidden;
+
+	GQueue *directories; /* GFiles */
+	GHashTable *visited;
+
+	GThreadPool *pool;
+
+	/* Protected by mutex, shared with the workers */
+	GMutex mutex;
+	GCond cond;
+	guint n_queued_files;
+	GList *hits;
+	guint n_hits;
+} SearchThreadData;
+
+typedef struct {
+	char *path;
+	GDateTime *modification_time;
+} SearchJob;
+
+struct NautilusSearchEngineContentDetails {
+	NautilusQuery *query;
+
+	SearchThreadData *active_search;
+};
+
+static void nautilus_search_provider_init (NautilusSearchProviderInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (NautilusSearchEngineContent,
+			 nautilus_search_engine_content,
+			 G_TYPE_OBJECT,
+			 G_IMPLEMENT_INTERFACE (NAUTILUS_TYPE_SEARCH_PROVIDER,
+						nautilus_search_provider_init))
+
+static void
+finalize (GObject *object)
+{
+	NautilusSearchEngineContent *content;
+
+	content = NAUTILUS_SEARCH_ENGINE_CONTENT (object);
+	g_clear_object (&content->details->query);
+
+	G_OBJECT_CLASS (nautilus_search_engine_content_parent_class)->finalize (object);
+}
+
+/* Words are matched ignoring ASCII case, any other byte has to be equal */
+static char **
+get_words (NautilusQuery *query)
+{
+	GPtrArray *words;
+	char **split, *text;
+	int i;
+
+	text = nautilus_query_get_text (query);
+	if (text == NULL) {
+		return NULL;
+	}
+
+	split = g_strsplit (text, " ", -1);
+	g_free (text);
+
+	words = g_ptr_array_new ();
+	for (i = 0; split[i] != NULL; i++) {
+		if (split[i][0] != '\0') {
+			g_ptr_array_add (words, g_ascii_strdown (split[i], -1));
+		}
+	}
+	g_strfreev (split);
+
+	if (words->len == 0) {
+		g_ptr_array_free (words, TRUE);
+		return NULL;
+	}
+
+	g_ptr_array_add (words, NULL);
+
+	return (char **) g_ptr_array_free (words, FALSE);
+}
+
+static void
+search_job_free (SearchJob *job)
+{
+	g_free (job->path);
+	g_date_time_unref (job->modification_time);
+	g_free (job);
+}
+
+static SearchThreadData *
+search_thread_data_new (NautilusSearchEngineContent *engine,
+			NautilusQuery               *query)
+{
+	SearchThreadData *data;
+
+	data = g_new0 (SearchThreadData, 1);
+
+	data->engine = g_object_ref (engine);
+	data->cancellable = g_cancellable_new ();
+
+	data->query = nautilus_query_copy (query);
+	data->mime_types = nautilus_query_get_mime_types (query);
+	data->words = get_words (query);
+	data->recursive = nautilus_query_get_recursive (query);
+	data->show_hidden = nautilus_query_get_show_hidden_files (query);
+
+	data->directories = g_queue_new ();
+	g_queue_push_tail (data->directories, nautilus_query_get_location (query));
+	data->visited = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	g_mutex_init (&data->mutex);
+	g_cond_init (&data->cond);
+
+	return data;
+}
+
+static void
+search_thread_data_free (SearchThreadData *data)
+{
+	g_queue_free_full (data->directories, g_object_unref);
+	g_hash_table_destroy (data->visited);
+	g_object_unref (data->cancellable);
+	g_object_unref (data->query);
+	g_list_free_full (data->mime_types, g_free);
+	g_strfreev (data->words);
+	g_list_free_full (data->hits, g_object_unref);
+	g_mutex_clear (&data->mutex);
+	g_cond_clear (&data->cond);
+	g_object_unref (data->engine);
+
+	g_free (data);
+}
+
+static gboolean
+search_thread_done_idle (gpointer user_data)
+{
+	SearchThreadData *data = user_data;
+	NautilusSearchEngineContent *engine = data->engine;
+
+	if (g_cancellable_is_cancelled (data->cancellable)) {
+		DEBUG ("Content engine finished and cancelled");
+	} else {
+		DEBUG ("Content engine finished");
+	}
+	engine->details->active_search = NULL;
+	nautilus_search_provider_finished (NAUTILUS_SEARCH_PROVIDER (engine),
+					   NAUTILUS_SEARCH_PROVIDER_STATUS_NORMAL);
+
+	g_object_notify (G_OBJECT (engine), "running");
+
+	search_thread_data_free (data);
+
+	return FALSE;
+}
+
+typedef struct {
+	GList *hits;
+	SearchThreadData *thread_data;
+} SearchHitsData;
+
+static gboolean
+search_thread_add_hits_idle (gpointer user_data)
+{
+	SearchHitsData *data = user_data;
+
+	if (!g_cancellable_is_cancelled (data->thread_data->cancellable)) {
+		DEBUG ("Content engine add hits");
+		nautilus_search_provider_hits_added (NAUTILUS_SEARCH_PROVIDER (data->thread_data->engine),
+						     data->hits);
+	}
+
+	g_list_free_full (data->hits, g_object_unref);
+	g_free (data);
+
+	return FALSE;
+}
+
+/* Called with the mutex held */
+static void
+send_batch (SearchThreadData *thread_data)
+{
+	SearchHitsData *data;
+
+	if (thread_data->hits) {
+		data = g_new (SearchHitsData, 1);
+		data->hits = thread_data->hits;
+		data->thread_data = thread_data;
+		g_idle_add (search_thread_add_hits_idle, data);
+	}
+	thread_data->hits = NULL;
+	thread_data->n_hits = 0;
+}
+
+/* Looks for @word, which is lowercase, ignoring ASCII case. The candidates
+ * are found with memchr(), which is vectorized in most C libraries. */
+static const char *
+find_word (const char *text,
+	   gsize       len,
+	   const char *word,
+	   gsize       word_len)
+{
+	const char *p, *end, *last;
+	const char *candidate, *upper_candidate;
+	char first, upper;
+
+	first = word[0];
+	upper = g_ascii_toupper (first);
+	p = text;
+	end = text + len;
+
+	while ((gsize) (end - p) >= word_len) {
+		/* A match can't start after this */
+		last = end - word_len + 1;
+
+		candidate = memchr (p, first, last - p);
+		if (upper != first) {
+			upper_candidate = memchr (p, upper, (candidate != NULL ? candidate : last) - p);
+			if (upper_candidate != NULL) {
+				candidate = upper_candidate;
+			}
+		}
+
+		if (candidate == NULL) {
+			return NULL;
+		}
+
+		if (g_ascii_strncasecmp (candidate, word, word_len) == 0) {
+			return candidate;
+		}
+
+		p = candidate + 1;
+	}
+
+	return NULL;
+}
+
+/* Returns the offset of the first word, or -1 if some word is missing.
+ * The end of each chunk is kept for the next one, so that words crossing
+ * chunks are found too. */
+static goffset
+match_file_contents (SearchThreadData *data,
+		     const char       *path)
+{
+	gboolean *found;
+	guint n_words, n_found, i;
+	gsize max_word_len, kept, len;
+	goffset base, offset;
+	const char *match;
+	gssize res;
+	char *buffer;
+	int fd;
+
+	fd = open (path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return -1;
+	}
+
+	n_words = g_strv_length (data->words);
+	found = g_new0 (gboolean, n_words);
+	max_word_len = 1;
+	for (i = 0; i < n_words; i++) {
+		max_word_len = MAX (max_word_len, strlen (data->words[i]));
+	}
+	buffer = g_malloc (READ_CHUNK_SIZE + max_word_len);
+
+	n_found = 0;
+	offset = -1;
+	base = 0;
+	kept = 0;
+	while (n_found < n_words && base < MAX_FILE_SIZE &&
+	       !g_cancellable_is_cancelled (data->cancellable)) {
+		res = read (fd, buffer + kept, READ_CHUNK_SIZE);
+		if (res < 0 && errno == EINTR) {
+			continue;
+		}
+		if (res <= 0) {
+			break;
+		}
+		len = kept + res;
+
+		if (base == 0 && kept == 0 &&
+		    memchr (buffer, '\0', MIN (len, BINARY_CHECK_SIZE)) != NULL) {
+			break;
+		}
+
+		for (i = 0; i < n_words; i++) {
+			if (found[i]) {
+				continue;
+			}
+
+			match = find_word (buffer, len, data->words[i], strlen (data->words[i]));
+			if (match != NULL) {
+				found[i] = TRUE;
+				n_found++;
+				if (i == 0) {
+					offset = base + (match - buffer);
+				}
+			}
+		}
+
+		kept = MIN (len, max_word_len - 1);
+		memmove (buffer, buffer + len - kept, kept);
+		base += len - kept;
+	}
+
+	close (fd);
+	g_free (buffer);
+	g_free (found);
+
+	return n_found == n_words && n_words > 0 ? offset : -1;
+}
+
+static void
+search_job_func (gpointer job_data,
+		 gpointer user_data)
+{
+	SearchJob *job = job_data;
+	SearchThreadData *data = user_data;
+	goffset offset;
+	NautilusSearchHit *hit;
+	GFile *file;
+	char *uri;
+
+	offset = -1;
+
+	if (!g_cancellable_is_cancelled (data->cancellable)) {
+		offset = match_file_contents (data, job->path);
+	}
+
+	if (offset >= 0) {
+		file = g_file_new_for_path (job->path);
+		uri = g_file_get_uri (file);
+		hit = nautilus_search_hit_new (uri);
+		g_free (uri);
+		g_object_unref (file);
+
+		nautilus_search_hit_set_fts_rank (hit, 1.0);
+		nautilus_search_hit_set_snippet_offset (hit, offset);
+		nautilus_search_hit_set_modification_time (hit, job->modification_time);
+	} else {
+		hit = NULL;
+	}
+
+	g_mutex_lock (&data->mutex);
+	if (hit != NULL) {
+		data->hits = g_list_prepend (data->hits, hit);
+		if (++data->n_hits >= BATCH_SIZE) {
+			send_batch (data);
+		}
+	}
+	data->n_queued_files--;
+	g_cond_signal (&data->cond);
+	g_mutex_unlock (&data->mutex);
+
+	search_job_free (job);
+}
+
+/* Only looks at the contents of the file for its type when its name is
+ * not enough */
+static gboolean
+file_matches_mime_types (SearchThreadData *data,
+			 GFile            *file,
+			 GFileInfo        *info)
+{
+	GFileInfo *type_info;
+	gboolean found;
+
+	/* Empty files are never sniffed, they have their own type */
+	if (g_file_info_get_size (info) > 0) {
+		switch (nautilus_query_matches_file_name_mime_type (data->query,
+								    g_file_info_get_name (info))) {
+		case NAUTILUS_QUERY_MIME_MATCH_YES:
+			return TRUE;
+		case NAUTILUS_QUERY_MIME_MATCH_NO:
+			return FALSE;
+		case NAUTILUS_QUERY_MIME_MATCH_UNKNOWN:
+			break;
+		}
+	}
+
+	type_info = g_file_query_info (file,
+				       G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE,
+				       G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+				       data->cancellable, NULL);
+	if (type_info == NULL) {
+		return FALSE;
+	}
+
+	found = nautilus_query_matches_mime_type (data->query,
+						  g_file_info_get_content_type (type_info));
+	g_object_unref (type_info);
+
+	return found;
+}
+
+static gboolean
+file_info_matches_filters (SearchThreadData *data,
+			   GFile            *file,
+			   GFileInfo        *info)
+{
+	GPtrArray *date_range;
+	guint64 file_time;
+	gboolean found;
+
+	if (g_file_info_get_size (info) > MAX_FILE_SIZE) {
+		return FALSE;
+	}
+
+	found = TRUE;
+
+	date_range = nautilus_query_get_date_range (data->query);
+	if (date_range != NULL) {
+		if (nautilus_query_get_search_type (data->query) == NAUTILUS_QUERY_SEARCH_TYPE_LAST_ACCESS) {
+			file_time = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_ACCESS);
+		} else {
+			file_time = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+		}
+
+		found = nautilus_file_date_in_between (file_time,
+						       g_ptr_array_index (date_range, 0),
+						       g_ptr_array_index (date_range, 1));
+	}
+	g_clear_pointer (&date_range, g_ptr_array_unref);
+
+	if (found && data->mime_types != NULL) {
+		found = file_matches_mime_types (data, file, info);
+	}
+
+	return found;
+}
+
+#define STD_ATTRIBUTES \
+	G_FILE_ATTRIBUTE_STANDARD_NAME "," \
+	G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP "," \
+	G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN "," \
+	G_FILE_ATTRIBUTE_STANDARD_TYPE "," \
+	G_FILE_ATTRIBUTE_STANDARD_SIZE "," \
+	G_FILE_ATTRIBUTE_TIME_MODIFIED "," \
+	G_FILE_ATTRIBUTE_TIME_ACCESS "," \
+	G_FILE_ATTRIBUTE_ID_FILE
+
+static void
+queue_file (SearchThreadData *data,
+	    GFile            *file,
+	    GFileInfo        *info)
+{
+	SearchJob *job;
+	guint64 mtime;
+
+	job = g_new (SearchJob, 1);
+	job->path = g_file_get_path (file);
+	mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+	job->modification_time = g_date_time_new_from_unix_local (mtime);
+
+	g_mutex_lock (&data->mutex);
+	while (data->n_queued_files >= MAX_QUEUED_FILES) {
+		g_cond_wait (&data->cond, &data->mutex);
+	}
+	data->n_queued_files++;
+	g_mutex_unlock (&data->mutex);
+
+	g_thread_pool_push (data->pool, job, NULL);
+}
+
+static void
+visit_directory (GFile            *dir,
+		 SearchThreadData *data)
+{
+	GFileEnumerator *enumerator;
+	GFileInfo *info;
+	GFile *child;
+	GFileType type;
+	const char *id;
+
+	enumerator = g_file_enumerate_children (dir, STD_ATTRIBUTES,
+						G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+						data->cancellable, NULL);
+
+	if (enumerator == NULL) {
+		return;
+	}
+
+	while ((info = g_file_enumerator_next_file (enumerator, data->cancellable, NULL)) != NULL) {
+		if (!data->show_hidden &&
+		    (g_file_info_get_is_hidden (info) || g_file_info_get_is_backup (info))) {
+			g_object_unref (info);
+			continue;
+		}
+
+		child = g_file_get_child (dir, g_file_info_get_name (info));
+		type = g_file_info_get_file_type (info);
+
+		if (type == G_FILE_TYPE_REGULAR && file_info_matches_filters (data, child, info)) {
+			queue_file (data, child, info);
+		} else if (type == G_FILE_TYPE_DIRECTORY && data->recursive) {
+			id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE);
+			if (id == NULL || !g_hash_table_contains (data->visited, id)) {
+				if (id != NULL) {
+					g_hash_table_add (data->visited, g_strdup (id));
+				}
+				g_queue_push_tail (data->directories, g_object_ref (child));
+			}
+		}
+
+		g_object_unref (child);
+		g_object_unref (info);
+	}
+
+	g_object_unref (enumerator);
+}
+
+static gpointer
+search_thread_func (gpointer user_data)
+{
+	SearchThreadData *data;
+	GFile *dir;
+
+	data = user_data;
+
+	data->pool = g_thread_pool_new (search_job_func, data,
+					g_get_num_processors (), FALSE, NULL);
+
+	while (!g_cancellable_is_cancelled (data->cancellable) &&
+	       (dir = g_queue_pop_head (data->directories)) != NULL) {
+		visit_directory (dir, data);
+		g_object_unref (dir);
+	}
+
+	/* Wait for the files that are still being searched */
+	g_thread_pool_free (data->pool, FALSE, TRUE);
+	data->pool = NULL;
+
+	if (!g_cancellable_is_cancelled (data->cancellable)) {
+		g_mutex_lock (&data->mutex);
+		send_batch (data);
+		g_mutex_unlock (&data->mutex);
+	}
+
+	g_idle_add (search_thread_done_idle, data);
+
+	return NULL;
+}
+
+static gboolean
+search_finished_idle (gpointer user_data)
+{
+	NautilusSearchEngineContent *engine = user_data;
+
+	DEBUG ("Content engine finished, nothing to search");
+	nautilus_search_provider_finished (NAUTILUS_SEARCH_PROVIDER (engine),
+					   NAUTILUS_SEARCH_PROVIDER_STATUS_NORMAL);
+
+	return FALSE;
+}
+
+static void
+nautilus_search_engine_content_start (NautilusSearchProvider *provider)
+{
+	NautilusSearchEngineContent *content;
+	SearchThreadData *data;
+	GThread *thread;
+	GFile *location;
+	gboolean is_native;
+
+	content = NAUTILUS_SEARCH_ENGINE_CONTENT (provider);
+
+	if (content->details->active_search != NULL) {
+		return;
+	}
+
+	location = nautilus_query_get_location (content->details->query);
+	is_native = g_file_is_native (location);
+	g_object_unref (location);
+
+	data = search_thread_data_new (content, content->details->query);
+
+	/* Contents are read with plain read(), which needs local files */
+	if (!is_native || data->words == NULL) {
+		search_thread_data_free (data);
+		g_idle_add_full (G_PRIORITY_DEFAULT_IDLE, search_finished_idle,
+				 g_object_ref (content), g_object_unref);
+		return;
+	}
+
+	DEBUG ("Content engine start");
+
+	thread = g_thread_new ("nautilus-search-content", search_thread_func, data);
+	content->details->active_search = data;
+
+	g_object_notify (G_OBJECT (provider), "running");
+
+	g_thread_unref (thread);
+}
+
+static void
+nautilus_search_engine_content_stop (NautilusSearchProvider *provider)
+{
+	NautilusSearchEngineContent *content;
+
+	content = NAUTILUS_SEARCH_ENGINE_CONTENT (provider);
+
+	if (content->details->active_search != NULL) {
+		DEBUG ("Content engine stop");
+		g_cancellable_cancel (content->details->active_search->cancellable);
+	}
+}
+
+static void
+nautilus_search_engine_content_set_query (NautilusSearchProvider *provider,
+					  NautilusQuery          *query)
+{
+	NautilusSearchEngineContent *content;
+
+	content = NAUTILUS_SEARCH_ENGINE_CONTENT (provider);
+
+	g_object_ref (query);
+	g_clear_object (&content->details->query);
+	content->details->query = query;
+}
+
+static gboolean
+nautilus_search_engine_content_is_running (NautilusSearchProvider *provider)
+{
+	NautilusSearchEngineContent *content;
+
+	content = NAUTILUS_SEARCH_ENGINE_CONTENT (provider);
+
+	return content->details->active_search != NULL;
+}
+
+static void
+nautilus_search_engine_content_get_property (GObject    *object,
+					     guint       arg_id,
+					     GValue     *value,
+					     GParamSpec *pspec)
+{
+	switch (arg_id) {
+	case PROP_RUNNING:
+		g_value_set_boolean (value, nautilus_search_engine_content_is_running (NAUTILUS_SEARCH_PROVIDER (object)));
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, arg_id, pspec);
+		break;
+	}
+}
+
+static void
+nautilus_search_provider_init (NautilusSearchProviderInterface *iface)
+{
+	iface->set_query = nautilus_search_engine_content_set_query;
+	iface->start = nautilus_search_engine_content_start;
+	iface->stop = nautilus_search_engine_content_stop;
+	iface->is_running = nautilus_search_engine_content_is_running;
+}
+
+static void
+nautilus_search_engine_content_class_init (NautilusSearchEngineContentClass *class)
+{
+	GObjectClass *gobject_class;
+
+	gobject_class = G_OBJECT_CLASS (class);
+	gobject_class->finalize = finalize;
+	gobject_class->get_property = nautilus_search_engine_content_get_property;
+
+	/**
+	 * NautilusSearchEngineContent::running:
+	 *
+	 * Whether the search engine is running a search.
+	 */
+	g_object_class_override_property (gobject_class, PROP_RUNNING, "running");
+
+	g_type_class_add_private (class, sizeof (NautilusSearchEngineContentDetails));
+}
+
+static void
+nautilus_search_engine_content_init (NautilusSearchEngineContent *engine)
+{
+	engine->details = G_TYPE_INSTANCE_GET_PRIVATE (engine, NAUTILUS_TYPE_SEARCH_ENGINE_CONTENT,
+						       NautilusSearchEngineContentDetails);
+}
+
+NautilusSearchEngineContent *
+nautilus_search_engine_content_new (void)
+{
+	NautilusSearchEngineContent *engine;
+
+	engine = g_object_new (NAUTILUS_TYPE_SEARCH_ENGINE_CONTENT, NULL);
+
+	return engine;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2016 Red Hat, Inc
+ *
+ * Nautilus is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * Nautilus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; see the file COPYING.  If not,
+ * see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef NAUTILUS_SEARCH_ENGINE_CONTENT_H
+#define NAUTILUS_SEARCH_ENGINE_CONTENT_H
+
+#include <glib-object.h>
+
+#define NAUTILUS_TYPE_SEARCH_ENGINE_CONTENT		(nautilus_search_engine_content_get_type ())
+#define NAUTILUS_SEARCH_ENGINE_CONTENT(obj)		(G_TYPE_CHECK_INSTANCE_CAST ((obj), NAUTILUS_TYPE_SEARCH_ENGINE_CONTENT, NautilusSearchEngineContent))
+#define NAUTILUS_SEARCH_ENGINE_CONTENT_CLASS(klass)	(G_TYPE_CHECK_CLASS_CAST ((klass), NAUTILUS_TYPE_SEARCH_ENGINE_CONTENT, NautilusSearchEngineContentClass))
+#define NAUTILUS_IS_SEARCH_ENGINE_CONTENT(obj)		(G_TYPE_CHECK_INSTANCE_TYPE ((obj), NAUTILUS_TYPE_SEARCH_ENGINE_CONTENT))
+#define NAUTILUS_IS_SEARCH_ENGINE_CONTENT_CLASS(klass)	(G_TYPE_CHECK_CLASS_TYPE ((klass), NAUTILUS_TYPE_SEARCH_ENGINE_CONTENT))
+#define NAUTILUS_SEARCH_ENGINE_CONTENT_GET_CLASS(obj)	(G_TYPE_INSTANCE_GET_CLASS ((obj), NAUTILUS_TYPE_SEARCH_ENGINE_CONTENT, NautilusSearchEngineContentClass))
+
+typedef struct NautilusSearchEngineContentDetails NautilusSearchEngineContentDetails;
+
+typedef struct NautilusSearchEngineContent {
+	GObject parent;
+	NautilusSearchEngineContentDetails *details;
+} NautilusSearchEngineContent;
+
+typedef struct {
+	GObjectClass parent_class;
+} NautilusSearchEngineContentClass;
+
+GType          nautilus_search_engine_content_get_type  (void);
+
+NautilusSearchEngineContent* nautilus_search_engine_content_new       (void);
+
+#endif /* NAUTILUS_SEARCH_ENGINE_CONTENT_H */
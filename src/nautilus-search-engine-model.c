@@ -122,8 +122,8 @@ model_directory_ready_cb (NautilusDirectory	*directory,
 			  gpointer		 user_data)
 {
 	NautilusSearchEngineModel *model = user_data;
-	gchar *uri, *display_name;
-	GList *files, *hits, *mime_types, *l, *m;
+	gchar *uri, *display_name, *mime_type;
+	GList *files, *hits, *mime_types, *l;
 	NautilusFile *file;
 	gdouble match;
 	gboolean found;
@@ -144,14 +144,9 @@ model_directory_ready_cb (NautilusDirectory	*directory,
 		found = (match > -1);
 
 		if (found && mime_types) {
-			found = FALSE;
-
-			for (m = mime_types; m != NULL; m = m->next) {
-				if (nautilus_file_is_mime_type (file, m->data)) {
-					found = TRUE;
-					break;
-				}
-			}
+			mime_type = nautilus_file_get_mime_type (file);
+			found = nautilus_query_matches_mime_type (model->details->query, mime_type);
+			g_free (mime_type);
 		}
 
                 date_range = nautilus_query_get_date_range (model->details->query);
@@ -28,11 +28,18 @@
 #include "nautilus-debug.h"
 
 #include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <glib.h>
 #include <gio/gio.h>
 
 #define BATCH_SIZE 500
 
+/* Same as G_FILE_ATTRIBUTE_ID_FILE for local files */
+#define LOCAL_FILE_ID_FORMAT "l%" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT
+
 enum {
 	PROP_RECURSIVE = 1,
         PROP_RUNNING,
@@ -51,10 +58,18 @@ typedef struct {
 	GHashTable *visited;
 
 	gboolean recursive;
+	gboolean utf8_filenames;
 	gint n_processed_files;
 	GList *hits;
+	NautilusSearchHitScorer *scorer;
+	GList *unsent_directories; /* GFiles visited since the last batch */
 
 	NautilusQuery *query;
+
+	/* Main thread only. Set when the search was stopped to continue
+	 * crawling with a refined query. */
+	NautilusQuery *refine_query;
+	GList *revisit_directories;
 } SearchThreadData;
 
 
@@ -68,6 +83,7 @@ struct NautilusSearchEngineSimpleDetails {
 };
 
 static void nautilus_search_provider_init (NautilusSearchProviderInterface *iface);
+static gpointer search_thread_func (gpointer user_data);
 
 G_DEFINE_TYPE_WITH_CODE (NautilusSearchEngineSimple,
 			 nautilus_search_engine_simple,
@@ -91,19 +107,17 @@ search_thread_data_new (NautilusSearchEngineSimple *engine,
 			NautilusQuery *query)
 {
 	SearchThreadData *data;
-	GFile *location;
 	
 	data = g_new0 (SearchThreadData, 1);
 
 	data->engine = g_object_ref (engine);
 	data->directories = g_queue_new ();
 	data->visited = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
-	data->query = g_object_ref (query);
-
-	location = nautilus_query_get_location (query);
+	/* The query might be edited while we search, keep our own */
+	data->query = nautilus_query_copy (query);
 
-	g_queue_push_tail (data->directories, location);
 	data->mime_types = nautilus_query_get_mime_types (query);
+	data->utf8_filenames = g_get_filename_charsets (NULL);
 
 	data->cancellable = g_cancellable_new ();
 	
@@ -121,17 +135,80 @@ search_thread_data_free (SearchThreadData *data)
 	g_object_unref (data->query);
 	g_list_free_full (data->mime_types, g_free);
 	g_list_free_full (data->hits, g_object_unref);
+	g_clear_pointer (&data->scorer, nautilus_search_hit_scorer_free);
+	g_list_free_full (data->unsent_directories, g_object_unref);
+	g_clear_object (&data->refine_query);
+	g_list_free_full (data->revisit_directories, g_object_unref);
 	g_object_unref (data->engine);
 
 	g_free (data);
 }
 
+static void
+start_search_thread (NautilusSearchEngineSimple *simple,
+		     SearchThreadData           *data)
+{
+	GThread *thread;
+
+	thread = g_thread_new ("nautilus-search-simple", search_thread_func, data);
+	simple->details->active_search = data;
+
+	g_thread_unref (thread);
+}
+
+static SearchThreadData *
+search_thread_data_resume (SearchThreadData *old_data)
+{
+	SearchThreadData *data;
+	GList *l;
+
+	data = search_thread_data_new (old_data->engine, old_data->refine_query);
+
+	/* Directories whose hits never made it to the engine have to be
+	 * visited again, before the ones that were never visited at all */
+	g_queue_free (data->directories);
+	data->directories = old_data->directories;
+	old_data->directories = g_queue_new ();
+
+	for (l = old_data->unsent_directories; l != NULL; l = l->next) {
+		g_queue_push_head (data->directories, l->data);
+	}
+	g_clear_pointer (&old_data->unsent_directories, g_list_free);
+
+	for (l = old_data->revisit_directories; l != NULL; l = l->next) {
+		g_queue_push_head (data->directories, l->data);
+	}
+	g_clear_pointer (&old_data->revisit_directories, g_list_free);
+
+	g_hash_table_destroy (data->visited);
+	data->visited = old_data->visited;
+	old_data->visited = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	return data;
+}
+
 static gboolean
 search_thread_done_idle (gpointer user_data)
 {
 	SearchThreadData *data = user_data;
 	NautilusSearchEngineSimple *engine = data->engine;
+	SearchThreadData *resumed_data;
+
+	if (data->refine_query != NULL) {
+		resumed_data = search_thread_data_resume (data);
 
+		/* Nothing is left to crawl if the refine came in after the
+		 * thread was done, then this search is finished too */
+		if (!g_queue_is_empty (resumed_data->directories)) {
+			DEBUG ("Simple engine continuing with refined query");
+			start_search_thread (engine, resumed_data);
+			search_thread_data_free (data);
+
+			return FALSE;
+		}
+
+		search_thread_data_free (resumed_data);
+	}
 
         if (g_cancellable_is_cancelled (data->cancellable)) {
 	        DEBUG ("Simple engine finished and cancelled");
@@ -151,6 +228,7 @@ search_thread_done_idle (gpointer user_data)
 
 typedef struct {
 	GList *hits;
+	GList *directories;
 	SearchThreadData *thread_data;
 } SearchHitsData;
 
@@ -164,9 +242,16 @@ search_thread_add_hits_idle (gpointer user_data)
 	        DEBUG ("Simple engine add hits");
 		nautilus_search_provider_hits_added (NAUTILUS_SEARCH_PROVIDER (data->thread_data->engine),
 						     data->hits);
+	} else if (data->thread_data->refine_query != NULL) {
+		/* These hits are lost, look at their directories again */
+		data->thread_data->revisit_directories =
+			g_list_concat (data->directories,
+				       data->thread_data->revisit_directories);
+		data->directories = NULL;
 	}
 
 	g_list_free_full (data->hits, g_object_unref);
+	g_list_free_full (data->directories, g_object_unref);
 	g_free (data);
 	
 	return FALSE;
@@ -182,10 +267,16 @@ send_batch (SearchThreadData *thread_data)
 	if (thread_data->hits) {
 		data = g_new (SearchHitsData, 1);
 		data->hits = thread_data->hits;
+		data->directories = thread_data->unsent_directories;
 		data->thread_data = thread_data;
 		g_idle_add (search_thread_add_hits_idle, data);
+	} else {
+		g_list_free_full (thread_data->unsent_directories, g_object_unref);
 	}
 	thread_data->hits = NULL;
+	thread_data->unsent_directories = NULL;
+
+	g_clear_pointer (&thread_data->scorer, nautilus_search_hit_scorer_free);
 }
 
 #define STD_ATTRIBUTES \
@@ -194,20 +285,91 @@ send_batch (SearchThreadData *thread_data)
 	G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP "," \
 	G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN "," \
 	G_FILE_ATTRIBUTE_STANDARD_TYPE "," \
+	G_FILE_ATTRIBUTE_STANDARD_SIZE "," \
 	G_FILE_ATTRIBUTE_TIME_MODIFIED "," \
         G_FILE_ATTRIBUTE_TIME_ACCESS "," \
 	G_FILE_ATTRIBUTE_ID_FILE
 
+/* Checks the mime types of the query, only looking at the contents of
+ * the file when its name is not enough */
+static gboolean
+file_matches_mime_types (SearchThreadData *data,
+			 GFile            *file,
+			 const char       *name,
+			 GFileType         type,
+			 goffset           size)
+{
+	GFileInfo *info;
+	gboolean found;
+
+	if (type == G_FILE_TYPE_DIRECTORY) {
+		return nautilus_query_matches_mime_type (data->query, "inode/directory");
+	}
+
+	/* Empty files are never sniffed, they have their own type */
+	if (type == G_FILE_TYPE_REGULAR && size > 0) {
+		switch (nautilus_query_matches_file_name_mime_type (data->query, name)) {
+		case NAUTILUS_QUERY_MIME_MATCH_YES:
+			return TRUE;
+		case NAUTILUS_QUERY_MIME_MATCH_NO:
+			return FALSE;
+		case NAUTILUS_QUERY_MIME_MATCH_UNKNOWN:
+			break;
+		}
+	}
+
+	info = g_file_query_info (file,
+				  G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE,
+				  G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+				  data->cancellable, NULL);
+	if (info == NULL) {
+		return FALSE;
+	}
+
+	found = nautilus_query_matches_mime_type (data->query,
+						  g_file_info_get_content_type (info));
+	g_object_unref (info);
+
+	return found;
+}
+
+static void
+add_hit (SearchThreadData *data,
+	 GFile            *file,
+	 gdouble           match,
+	 guint64           mtime)
+{
+	NautilusSearchHit *hit;
+	GDateTime *date;
+	char *uri;
+
+	uri = g_file_get_uri (file);
+	hit = nautilus_search_hit_new (uri);
+	g_free (uri);
+	nautilus_search_hit_set_fts_rank (hit, match);
+	date = g_date_time_new_from_unix_local (mtime);
+	nautilus_search_hit_set_modification_time (hit, date);
+	g_date_time_unref (date);
+
+	/* Score here rather than in the main loop, with the
+	 * same time for the whole batch */
+	if (data->scorer == NULL) {
+		data->scorer = nautilus_search_hit_scorer_new (data->query);
+	}
+	nautilus_search_hit_scorer_compute_scores (data->scorer, hit);
+
+	data->hits = g_list_prepend (data->hits, hit);
+}
+
 static void
 visit_directory (GFile *dir, SearchThreadData *data)
 {
 	GFileEnumerator *enumerator;
 	GFileInfo *info;
 	GFile *child;
-	const char *mime_type, *display_name;
+	const char *display_name;
 	gdouble match;
 	gboolean is_hidden, found;
-	GList *l;
 	const char *id;
 	gboolean visited;
 	guint64 atime;
@@ -217,13 +379,7 @@ visit_directory (GFile *dir, SearchThreadData *data)
         GDateTime *end_date;
 
 
-	enumerator = g_file_enumerate_children (dir,
-						data->mime_types != NULL ?
-						STD_ATTRIBUTES ","
-						G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE
-						:
-						STD_ATTRIBUTES
-						,
+	enumerator = g_file_enumerate_children (dir, STD_ATTRIBUTES,
 						G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
 						data->cancellable, NULL);
 	
@@ -246,18 +402,6 @@ visit_directory (GFile *dir, SearchThreadData *data)
 		match = nautilus_query_matches_string (data->query, display_name);
 		found = (match > -1);
 
-		if (found && data->mime_types) {
-			mime_type = g_file_info_get_content_type (info);
-			found = FALSE;
-			
-			for (l = data->mime_types; mime_type != NULL && l != NULL; l = l->next) {
-				if (g_content_type_is_a (mime_type, l->data)) {
-					found = TRUE;
-					break;
-				}
-			}
-		}
-
 		mtime = g_file_info_get_attribute_uint64 (info, "time::modified");
 		atime = g_file_info_get_attribute_uint64 (info, "time::access");
 
@@ -281,20 +425,15 @@ visit_directory (GFile *dir, SearchThreadData *data)
                         g_ptr_array_unref (date_range);
                 }
 
+		if (found && data->mime_types) {
+			found = file_matches_mime_types (data, child,
+							 g_file_info_get_name (info),
+							 g_file_info_get_file_type (info),
+							 g_file_info_get_size (info));
+		}
+
 		if (found) {
-			NautilusSearchHit *hit;
-			GDateTime *date;
-			char *uri;
-
-			uri = g_file_get_uri (child);
-			hit = nautilus_search_hit_new (uri);
-			g_free (uri);
-			nautilus_search_hit_set_fts_rank (hit, match);
-			date = g_date_time_new_from_unix_local (mtime);
-			nautilus_search_hit_set_modification_time (hit, date);
-			g_date_time_unref (date);
-
-			data->hits = g_list_prepend (data->hits, hit);
+			add_hit (data, child, match, mtime);
 		}
 		
 		data->n_processed_files++;
@@ -328,6 +467,160 @@ visit_directory (GFile *dir, SearchThreadData *data)
 }
 
 
+/* Names listed in the .hidden file of a directory, as GIO does */
+static GHashTable *
+read_hidden_names (const char *dir_path)
+{
+	GHashTable *names;
+	char *path, *contents;
+	char **lines;
+	int i;
+
+	path = g_build_filename (dir_path, ".hidden", NULL);
+	if (!g_file_get_contents (path, &contents, NULL, NULL)) {
+		g_free (path);
+		return NULL;
+	}
+	g_free (path);
+
+	names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	lines = g_strsplit (contents, "\n", -1);
+	for (i = 0; lines[i] != NULL; i++) {
+		if (lines[i][0] != '\0') {
+			g_hash_table_add (names, lines[i]);
+		} else {
+			g_free (lines[i]);
+		}
+	}
+	g_free (lines);
+	g_free (contents);
+
+	return names;
+}
+
+/* Does the same as visit_directory() for a local directory, but on the raw
+ * entries, so that nothing is allocated for entries that don't match */
+static void
+visit_directory_native (GFile            *dir,
+			const char       *dir_path,
+			SearchThreadData *data)
+{
+	DIR *dir_stream;
+	struct dirent *entry;
+	struct stat statbuf;
+	GHashTable *hidden_names;
+	GPtrArray *date_range;
+	GFile *child;
+	const char *name;
+	char *display_name;
+	char id[64];
+	gboolean show_hidden, maybe_directory, found;
+	gdouble match;
+	guint64 file_time;
+	int fd;
+
+	fd = open (dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) {
+		return;
+	}
+
+	dir_stream = fdopendir (fd);
+	if (dir_stream == NULL) {
+		close (fd);
+		return;
+	}
+
+	show_hidden = nautilus_query_get_show_hidden_files (data->query);
+	hidden_names = show_hidden ? NULL : read_hidden_names (dir_path);
+	date_range = nautilus_query_get_date_range (data->query);
+
+	while (!g_cancellable_is_cancelled (data->cancellable) &&
+	       (entry = readdir (dir_stream)) != NULL) {
+		name = entry->d_name;
+		if (strcmp (name, ".") == 0 || strcmp (name, "..") == 0) {
+			continue;
+		}
+
+		if (!show_hidden &&
+		    (name[0] == '.' || g_str_has_suffix (name, "~") ||
+		     (hidden_names != NULL && g_hash_table_contains (hidden_names, name)))) {
+			continue;
+		}
+
+		/* The display name of a local file is its name, unless it's
+		 * not in UTF-8 */
+		if (data->utf8_filenames && g_utf8_validate (name, -1, NULL)) {
+			match = nautilus_query_matches_string (data->query, name);
+		} else {
+			display_name = g_filename_display_name (name);
+			match = nautilus_query_matches_string (data->query, display_name);
+			g_free (display_name);
+		}
+		found = (match > -1);
+
+		maybe_directory = data->engine->details->recursive &&
+				  (entry->d_type == DT_DIR || entry->d_type == DT_UNKNOWN);
+
+		data->n_processed_files++;
+		if (data->n_processed_files > BATCH_SIZE) {
+			send_batch (data);
+		}
+
+		/* Most entries end here */
+		if (!found && !maybe_directory) {
+			continue;
+		}
+
+		if (fstatat (fd, name, &statbuf, AT_SYMLINK_NOFOLLOW) != 0) {
+			continue;
+		}
+
+		if (found && date_range != NULL) {
+			if (nautilus_query_get_search_type (data->query) == NAUTILUS_QUERY_SEARCH_TYPE_LAST_ACCESS) {
+				file_time = statbuf.st_atime;
+			} else {
+				file_time = statbuf.st_mtime;
+			}
+			found = nautilus_file_date_in_between (file_time,
+							       g_ptr_array_index (date_range, 0),
+							       g_ptr_array_index (date_range, 1));
+		}
+
+		if (!found && !(data->engine->details->recursive && S_ISDIR (statbuf.st_mode))) {
+			continue;
+		}
+
+		child = g_file_get_child (dir, name);
+
+		if (found && data->mime_types != NULL) {
+			found = file_matches_mime_types (data, child, name,
+							 S_ISDIR (statbuf.st_mode) ? G_FILE_TYPE_DIRECTORY :
+							 S_ISREG (statbuf.st_mode) ? G_FILE_TYPE_REGULAR :
+							 G_FILE_TYPE_UNKNOWN,
+							 statbuf.st_size);
+		}
+
+		if (found) {
+			add_hit (data, child, match, statbuf.st_mtime);
+		}
+
+		if (data->engine->details->recursive && S_ISDIR (statbuf.st_mode)) {
+			g_snprintf (id, sizeof (id), LOCAL_FILE_ID_FORMAT,
+				    (guint64) statbuf.st_dev, (guint64) statbuf.st_ino);
+			if (!g_hash_table_contains (data->visited, id)) {
+				g_hash_table_add (data->visited, g_strdup (id));
+				g_queue_push_tail (data->directories, g_object_ref (child));
+			}
+		}
+
+		g_object_unref (child);
+	}
+
+	g_clear_pointer (&date_range, g_ptr_array_unref);
+	g_clear_pointer (&hidden_names, g_hash_table_destroy);
+	closedir (dir_stream);
+}
+
 static gpointer 
 search_thread_func (gpointer user_data)
 {
@@ -335,12 +628,16 @@ search_thread_func (gpointer user_data)
 	GFile *dir;
 	GFileInfo *info;
 	const char *id;
+	char *path;
 
 	data = user_data;
 
 	/* Insert id for toplevel directory into visited */
 	dir = g_queue_peek_head (data->directories);
-	info = g_file_query_info (dir, G_FILE_ATTRIBUTE_ID_FILE, 0, data->cancellable, NULL);
+	info = NULL;
+	if (dir != NULL) {
+		info = g_file_query_info (dir, G_FILE_ATTRIBUTE_ID_FILE, 0, data->cancellable, NULL);
+	}
 	if (info) {
 		id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE);
 		if (id) {
@@ -351,8 +648,18 @@ search_thread_func (gpointer user_data)
 	
 	while (!g_cancellable_is_cancelled (data->cancellable) &&
 	       (dir = g_queue_pop_head (data->directories)) != NULL) {
-		visit_directory (dir, data);
-		g_object_unref (dir);
+		path = NULL;
+		if (g_file_is_native (dir)) {
+			path = g_file_get_path (dir);
+		}
+
+		if (path != NULL) {
+			visit_directory_native (dir, path, data);
+			g_free (path);
+		} else {
+			visit_directory (dir, data);
+		}
+		data->unsent_directories = g_list_prepend (data->unsent_directories, dir);
 	}
 
 	if (!g_cancellable_is_cancelled (data->cancellable)) {
@@ -369,7 +676,6 @@ nautilus_search_engine_simple_start (NautilusSearchProvider *provider)
 {
 	NautilusSearchEngineSimple *simple;
 	SearchThreadData *data;
-	GThread *thread;
 	
 	simple = NAUTILUS_SEARCH_ENGINE_SIMPLE (provider);
 
@@ -380,13 +686,12 @@ nautilus_search_engine_simple_start (NautilusSearchProvider *provider)
 	DEBUG ("Simple engine start");
 	
 	data = search_thread_data_new (simple, simple->details->query);
+	g_queue_push_tail (data->directories,
+			   nautilus_query_get_location (simple->details->query));
 
-	thread = g_thread_new ("nautilus-search-simple", search_thread_func, data);
-	simple->details->active_search = data;
+	start_search_thread (simple, data);
 
         g_object_notify (G_OBJECT (provider), "running");
-
-	g_thread_unref (thread);
 }
 
 static void
@@ -398,6 +703,7 @@ nautilus_search_engine_simple_stop (NautilusSearchProvider *provider)
 
 	if (simple->details->active_search != NULL) {
 		DEBUG ("Simple engine stop");
+		g_clear_object (&simple->details->active_search->refine_query);
 		g_cancellable_cancel (simple->details->active_search->cancellable);
 	}
 }
@@ -523,3 +829,38 @@ nautilus_search_engine_simple_new (void)
 
 	return engine;
 }
+
+/**
+ * nautilus_search_engine_simple_refine:
+ * @simple: a #NautilusSearchEngineSimple
+ * @query: a query refining the one being searched for
+ *
+ * Sets @query as the query of @simple. If a search is running, it stops
+ * and a new one continues crawling where it left off with @query instead
+ * of starting over from the query location. @query has to be a refinement
+ * of the current query, see nautilus_query_is_refinement_of().
+ */
+void
+nautilus_search_engine_simple_refine (NautilusSearchEngineSimple *simple,
+				      NautilusQuery              *query)
+{
+	SearchThreadData *data;
+
+	nautilus_search_engine_simple_set_query (NAUTILUS_SEARCH_PROVIDER (simple), query);
+
+	data = simple->details->active_search;
+	if (data == NULL) {
+		return;
+	}
+
+	/* Don't bring back a search that was stopped */
+	if (g_cancellable_is_cancelled (data->cancellable) && data->refine_query == NULL) {
+		return;
+	}
+
+	DEBUG ("Simple engine refine");
+
+	g_clear_object (&data->refine_query);
+	data->refine_query = g_object_ref (query);
+	g_cancellable_cancel (data->cancellable);
+}
@@ -493,3 +493,10 @@ nautilus_search_engine_tracker_new (void)
 {
 	return g_object_new (NAUTILUS_TYPE_SEARCH_ENGINE_TRACKER, NULL);
 }
+
+/* Whether Tracker can answer queries, including full text ones */
+gboolean
+nautilus_search_engine_tracker_is_available (NautilusSearchEngineTracker *tracker)
+{
+	return tracker->details->connection != NULL;
+}
@@ -46,4 +46,6 @@ GType nautilus_search_engine_tracker_get_type (void);
 
 NautilusSearchEngineTracker* nautilus_search_engine_tracker_new (void);
 
+gboolean nautilus_search_engine_tracker_is_available (NautilusSearchEngineTracker *tracker);
+
 #endif /* NAUTILUS_SEARCH_ENGINE_TRACKER_H */
@@ -26,9 +26,12 @@
 #include "nautilus-search-engine.h"
 #include "nautilus-search-engine-simple.h"
 #include "nautilus-search-engine-model.h"
+#include "nautilus-search-engine-content.h"
 #define DEBUG_FLAG NAUTILUS_DEBUG_SEARCH
 #include "nautilus-debug.h"
 
+#include <eel/eel-string.h>
+
 #ifdef ENABLE_TRACKER
 #include "nautilus-search-engine-tracker.h"
 #endif
@@ -40,6 +43,9 @@ struct NautilusSearchEngineDetails
 #endif
 	NautilusSearchEngineSimple *simple;
 	NautilusSearchEngineModel *model;
+	NautilusSearchEngineContent *content;
+
+	NautilusQuery *query;
 
 	GHashTable *uris;
 	guint providers_running;
@@ -71,11 +77,26 @@ nautilus_search_engine_set_query (NautilusSearchProvider *provider,
 				  NautilusQuery          *query)
 {
 	NautilusSearchEngine *engine = NAUTILUS_SEARCH_ENGINE (provider);
+
+	g_set_object (&engine->details->query, query);
 #ifdef ENABLE_TRACKER
 	nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (engine->details->tracker), query);
 #endif
 	nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (engine->details->model), query);
 	nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (engine->details->simple), query);
+	nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (engine->details->content), query);
+}
+
+/* Tracker already searches the contents of files when it's there, the
+ * content provider is only for systems without it */
+static gboolean
+tracker_is_available (NautilusSearchEngine *engine)
+{
+#ifdef ENABLE_TRACKER
+	return nautilus_search_engine_tracker_is_available (engine->details->tracker);
+#else
+	return FALSE;
+#endif
 }
 
 static void
@@ -102,6 +123,12 @@ search_engine_start_real (NautilusSearchEngine *engine)
 
 	nautilus_search_provider_start (NAUTILUS_SEARCH_PROVIDER (engine->details->simple));
 	engine->details->providers_running++;
+
+	if (nautilus_query_get_search_content (engine->details->query) == NAUTILUS_QUERY_SEARCH_CONTENT_FULL_TEXT &&
+	    !tracker_is_available (engine)) {
+		nautilus_search_provider_start (NAUTILUS_SEARCH_PROVIDER (engine->details->content));
+		engine->details->providers_running++;
+	}
 }
 
 static void
@@ -146,6 +173,7 @@ nautilus_search_engine_stop (NautilusSearchProvider *provider)
 #endif
 	nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (engine->details->model));
 	nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (engine->details->simple));
+	nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (engine->details->content));
 
 	engine->details->running = FALSE;
 	engine->details->restart = FALSE;
@@ -172,11 +200,14 @@ search_provider_hits_added (NautilusSearchProvider *provider,
 		int count;
 		const char *uri;
 
+		/* Hit uris are unique strings, look them up by address */
 		uri = nautilus_search_hit_get_uri (hit);
 		count = GPOINTER_TO_INT (g_hash_table_lookup (engine->details->uris, uri));
 		if (count == 0)
 			added = g_list_prepend (added, hit);
-		g_hash_table_replace (engine->details->uris, g_strdup (uri), GINT_TO_POINTER (++count));
+		g_hash_table_insert (engine->details->uris,
+				     eel_ref_str_ref ((eel_ref_str) uri),
+				     GINT_TO_POINTER (++count));
 	}
 	if (added != NULL) {
 		added = g_list_reverse (added);
@@ -291,6 +322,8 @@ nautilus_search_engine_finalize (GObject *object)
 #endif
 	g_clear_object (&engine->details->model);
 	g_clear_object (&engine->details->simple);
+	g_clear_object (&engine->details->content);
+	g_clear_object (&engine->details->query);
 
 	G_OBJECT_CLASS (nautilus_search_engine_parent_class)->finalize (object);
 }
@@ -340,7 +373,8 @@ nautilus_search_engine_init (NautilusSearchEngine *engine)
 						       NAUTILUS_TYPE_SEARCH_ENGINE,
 						       NautilusSearchEngineDetails);
 
-	engine->details->uris = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	engine->details->uris = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+						       (GDestroyNotify) eel_ref_str_unref, NULL);
 
 #ifdef ENABLE_TRACKER
 	engine->details->tracker = nautilus_search_engine_tracker_new ();
@@ -351,6 +385,9 @@ nautilus_search_engine_init (NautilusSearchEngine *engine)
 
 	engine->details->simple = nautilus_search_engine_simple_new ();
 	connect_provider_signals (engine, NAUTILUS_SEARCH_PROVIDER (engine->details->simple));
+
+	engine->details->content = nautilus_search_engine_content_new ();
+	connect_provider_signals (engine, NAUTILUS_SEARCH_PROVIDER (engine->details->content));
 }
 
 NautilusSearchEngine *
@@ -374,3 +411,49 @@ nautilus_search_engine_get_simple_provider (NautilusSearchEngine *engine)
 {
 	return engine->details->simple;
 }
+
+/**
+ * nautilus_search_engine_refine:
+ * @engine: a #NautilusSearchEngine
+ * @query: a query refining the one being searched for
+ *
+ * Sets @query as the query of @engine without starting over, when only the
+ * simple provider, which can continue where it is, is still searching.
+ * Hits found so far are not reported again, it's up to the caller to
+ * filter them with @query.
+ *
+ * Returns: %TRUE if the search was refined, %FALSE if it has to be
+ * restarted for @query.
+ */
+gboolean
+nautilus_search_engine_refine (NautilusSearchEngine *engine,
+			       NautilusQuery        *query)
+{
+	if (engine->details->restart) {
+		return FALSE;
+	}
+
+	if (engine->details->running) {
+#ifdef ENABLE_TRACKER
+		if (nautilus_search_provider_is_running (NAUTILUS_SEARCH_PROVIDER (engine->details->tracker))) {
+			return FALSE;
+		}
+#endif
+		if (nautilus_search_provider_is_running (NAUTILUS_SEARCH_PROVIDER (engine->details->model)) ||
+		    nautilus_search_provider_is_running (NAUTILUS_SEARCH_PROVIDER (engine->details->content))) {
+			return FALSE;
+		}
+	}
+
+	DEBUG ("Search engine refine");
+
+#ifdef ENABLE_TRACKER
+	nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (engine->details->tracker), query);
+#endif
+	g_set_object (&engine->details->query, query);
+	nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (engine->details->model), query);
+	nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (engine->details->content), query);
+	nautilus_search_engine_simple_refine (engine->details->simple, query);
+
+	return TRUE;
+}
@@ -53,5 +53,7 @@ NautilusSearchEngineModel *
                       nautilus_search_engine_get_model_provider (NautilusSearchEngine *engine);
 NautilusSearchEngineSimple *
                       nautilus_search_engine_get_simple_provider (NautilusSearchEngine *engine);
+gboolean              nautilus_search_engine_refine              (NautilusSearchEngine *engine,
+                                                                  NautilusQuery        *query);
 
 #endif /* NAUTILUS_SEARCH_ENGINE_H */
@@ -27,15 +27,19 @@
 #define DEBUG_FLAG NAUTILUS_DEBUG_SEARCH_HIT
 #include "nautilus-debug.h"
 
+#include <eel/eel-string.h>
+
 struct NautilusSearchHitDetails
 {
-	char      *uri;
+	eel_ref_str uri;
 
 	GDateTime *modification_time;
 	GDateTime *access_time;
 	gdouble    fts_rank;
+	goffset    snippet_offset;
 
 	gdouble    relevance;
+	gboolean   has_relevance;
 };
 
 enum {
@@ -49,48 +53,105 @@ enum {
 
 G_DEFINE_TYPE (NautilusSearchHit, nautilus_search_hit, G_TYPE_OBJECT)
 
-void
-nautilus_search_hit_compute_scores (NautilusSearchHit *hit,
-				    NautilusQuery     *query)
+struct NautilusSearchHitScorer
 {
+	/* Query location URI, without a trailing slash */
+	char      *location_uri;
+	gsize      location_uri_len;
+
 	GDateTime *now;
+};
+
+/**
+ * nautilus_search_hit_scorer_new:
+ * @query: a #NautilusQuery
+ *
+ * Creates a scorer for the hits of @query. It does the work that doesn't
+ * depend on the hit once, so it should be shared by a batch of hits. It
+ * doesn't use @query after creation, so it can be used in a search thread.
+ *
+ * Returns: (transfer full): a new #NautilusSearchHitScorer.
+ */
+NautilusSearchHitScorer *
+nautilus_search_hit_scorer_new (NautilusQuery *query)
+{
+	NautilusSearchHitScorer *scorer;
 	GFile *query_location;
-	GFile *hit_location;
-	GTimeSpan m_diff = G_MAXINT64;
-	GTimeSpan a_diff = G_MAXINT64;
-	GTimeSpan t_diff = G_MAXINT64;
-	gdouble recent_bonus = 0.0;
-	gdouble proximity_bonus = 0.0;
-	gdouble match_bonus = 0.0;
+
+	scorer = g_new0 (NautilusSearchHitScorer, 1);
 
 	query_location = nautilus_query_get_location (query);
-	hit_location = g_file_new_for_uri (hit->details->uri);
+	scorer->location_uri = g_file_get_uri (query_location);
+	scorer->location_uri_len = strlen (scorer->location_uri);
+	if (scorer->location_uri_len > 0 &&
+	    scorer->location_uri[scorer->location_uri_len - 1] == '/') {
+		scorer->location_uri[--scorer->location_uri_len] = '\0';
+	}
+	g_object_unref (query_location);
+
+	scorer->now = g_date_time_new_now_local ();
+
+	return scorer;
+}
+
+void
+nautilus_search_hit_scorer_free (NautilusSearchHitScorer *scorer)
+{
+	g_free (scorer->location_uri);
+	g_date_time_unref (scorer->now);
+	g_free (scorer);
+}
+
+/* Number of directories between the query location and the hit, or -1 if
+ * the hit is not inside the query location */
+static gint
+get_directory_count (NautilusSearchHitScorer *scorer,
+		     const char              *uri)
+{
+	const char *p;
+	gint dir_count;
 
-	if (g_file_has_prefix (hit_location, query_location)) {
-		GFile *parent, *location;
-		guint dir_count = 0;
+	if (strncmp (uri, scorer->location_uri, scorer->location_uri_len) != 0) {
+		return -1;
+	}
 
-		parent = g_file_get_parent (hit_location);
+	p = uri + scorer->location_uri_len;
+	if (*p != '/') {
+		return -1;
+	}
 
-		while (!g_file_equal (parent, query_location)) {
+	dir_count = -1;
+	for (; *p != '\0'; p++) {
+		/* Trailing slashes don't add a directory */
+		if (*p == '/' && p[1] != '\0') {
 			dir_count++;
-			location = parent;
-			parent = g_file_get_parent (location);
-			g_object_unref (location);
 		}
-		g_object_unref (parent);
+	}
 
-		if (dir_count < 10) {
-			proximity_bonus = 10000.0 - 1000.0 * dir_count;
-		}
+	return dir_count;
+}
+
+void
+nautilus_search_hit_scorer_compute_scores (NautilusSearchHitScorer *scorer,
+					   NautilusSearchHit       *hit)
+{
+	GTimeSpan m_diff = G_MAXINT64;
+	GTimeSpan a_diff = G_MAXINT64;
+	GTimeSpan t_diff = G_MAXINT64;
+	gdouble recent_bonus = 0.0;
+	gdouble proximity_bonus = 0.0;
+	gdouble match_bonus = 0.0;
+	gint dir_count;
+
+	dir_count = get_directory_count (scorer, hit->details->uri);
+	if (dir_count >= 0 && dir_count < 10) {
+		proximity_bonus = 10000.0 - 1000.0 * dir_count;
 	}
-	g_object_unref (hit_location);
 
-	now = g_date_time_new_now_local ();
 	if (hit->details->modification_time != NULL)
-		m_diff = g_date_time_difference (now, hit->details->modification_time);
+		m_diff = g_date_time_difference (scorer->now, hit->details->modification_time);
 	if (hit->details->access_time != NULL)
-		a_diff = g_date_time_difference (now, hit->details->access_time);
+		a_diff = g_date_time_difference (scorer->now, hit->details->access_time);
 	m_diff /= G_TIME_SPAN_DAY;
 	a_diff /= G_TIME_SPAN_DAY;
 	t_diff = MIN (m_diff, a_diff);
@@ -115,13 +176,24 @@ nautilus_search_hit_compute_scores (NautilusSearchHit *hit,
 	}
 
 	hit->details->relevance = recent_bonus + proximity_bonus + match_bonus;
+	hit->details->has_relevance = TRUE;
 	DEBUG ("Hit %s computed relevance %.2f (%.2f + %.2f + %.2f)", hit->details->uri, hit->details->relevance,
 	       proximity_bonus, recent_bonus, match_bonus);
+}
 
-	g_date_time_unref (now);
-	g_object_unref (query_location);
+void
+nautilus_search_hit_compute_scores (NautilusSearchHit *hit,
+				    NautilusQuery     *query)
+{
+	NautilusSearchHitScorer *scorer;
+
+	scorer = nautilus_search_hit_scorer_new (query);
+	nautilus_search_hit_scorer_compute_scores (scorer, hit);
+	nautilus_search_hit_scorer_free (scorer);
 }
 
+/* The uri is unique for all the hits of the same file, so it can be
+ * compared by address and kept with eel_ref_str_ref() without copying it */
 const char *
 nautilus_search_hit_get_uri (NautilusSearchHit *hit)
 {
@@ -134,12 +206,18 @@ nautilus_search_hit_get_relevance (NautilusSearchHit *hit)
 	return hit->details->relevance;
 }
 
+gboolean
+nautilus_search_hit_has_relevance (NautilusSearchHit *hit)
+{
+	return hit->details->has_relevance;
+}
+
 static void
 nautilus_search_hit_set_uri (NautilusSearchHit *hit,
 			     const char        *uri)
 {
-	g_free (hit->details->uri);
-	hit->details->uri = g_strdup (uri);
+	eel_ref_str_unref (hit->details->uri);
+	hit->details->uri = eel_ref_str_get_unique (uri);
 }
 
 void
@@ -149,6 +227,27 @@ nautilus_search_hit_set_fts_rank (NautilusSearchHit *hit,
 	hit->details->fts_rank = rank;
 }
 
+/**
+ * nautilus_search_hit_set_snippet_offset:
+ * @hit: a #NautilusSearchHit
+ * @offset: byte offset in the file contents
+ *
+ * Sets where in the file contents the query matched, for hits found by
+ * their contents.
+ */
+void
+nautilus_search_hit_set_snippet_offset (NautilusSearchHit *hit,
+					goffset            offset)
+{
+	hit->details->snippet_offset = offset;
+}
+
+goffset
+nautilus_search_hit_get_snippet_offset (NautilusSearchHit *hit)
+{
+	return hit->details->snippet_offset;
+}
+
 void
 nautilus_search_hit_set_modification_time (NautilusSearchHit *hit,
 					   GDateTime         *date)
@@ -186,6 +285,7 @@ nautilus_search_hit_set_property (GObject *object,
 	switch (arg_id) {
 	case PROP_RELEVANCE:
 		hit->details->relevance = g_value_get_double (value);
+		hit->details->has_relevance = TRUE;
 		break;
 	case PROP_FTS_RANK:
 		nautilus_search_hit_set_fts_rank (hit, g_value_get_double (value));
@@ -242,7 +342,7 @@ nautilus_search_hit_finalize (GObject *object)
 {
 	NautilusSearchHit *hit = NAUTILUS_SEARCH_HIT (object);
 
-	g_free (hit->details->uri);
+	eel_ref_str_unref (hit->details->uri);
 
 	if (hit->details->access_time != NULL) {
 		g_date_time_unref (hit->details->access_time);
@@ -312,6 +412,7 @@ nautilus_search_hit_init (NautilusSearchHit *hit)
 	hit->details = G_TYPE_INSTANCE_GET_PRIVATE (hit,
 						    NAUTILUS_TYPE_SEARCH_HIT,
 						    NautilusSearchHitDetails);
+	hit->details->snippet_offset = -1;
 }
 
 NautilusSearchHit *
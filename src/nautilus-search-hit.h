@@ -31,6 +31,7 @@
 #define NAUTILUS_SEARCH_HIT_GET_CLASS(obj)    (G_TYPE_INSTANCE_GET_CLASS ((obj), NAUTILUS_TYPE_SEARCH_HIT, NautilusSearchHitClass))
 
 typedef struct NautilusSearchHitDetails NautilusSearchHitDetails;
+typedef struct NautilusSearchHitScorer NautilusSearchHitScorer;
 
 typedef struct NautilusSearchHit {
 	GObject parent;
@@ -51,11 +52,21 @@ void                nautilus_search_hit_set_modification_time (NautilusSearchHit
 							       GDateTime         *date);
 void                nautilus_search_hit_set_access_time       (NautilusSearchHit *hit,
 							       GDateTime         *date);
+void                nautilus_search_hit_set_snippet_offset    (NautilusSearchHit *hit,
+							       goffset            offset);
 
 void                nautilus_search_hit_compute_scores        (NautilusSearchHit *hit,
 							       NautilusQuery     *query);
 
 const char *        nautilus_search_hit_get_uri               (NautilusSearchHit *hit);
 gdouble             nautilus_search_hit_get_relevance         (NautilusSearchHit *hit);
+gboolean            nautilus_search_hit_has_relevance         (NautilusSearchHit *hit);
+goffset             nautilus_search_hit_get_snippet_offset    (NautilusSearchHit *hit);
+
+NautilusSearchHitScorer *
+                    nautilus_search_hit_scorer_new            (NautilusQuery           *query);
+void                nautilus_search_hit_scorer_free           (NautilusSearchHitScorer *scorer);
+void                nautilus_search_hit_scorer_compute_scores (NautilusSearchHitScorer *scorer,
+							       NautilusSearchHit       *hit);
 
 #endif /* NAUTILUS_SEARCH_HIT_H */
@@ -39,6 +39,21 @@
 #include "nautilus-shell-search-provider-generated.h"
 #include "nautilus-shell-search-provider.h"
 
+/* Number of result metas kept around between requests; the shell asks for
+ * metas of the visible results again on every keystroke. */
+#define METAS_CACHE_SIZE 256
+/* Serialized themed icons, shared between all the files that use them */
+#define ICONS_CACHE_SIZE 64
+
+/* Upper bounds, in milliseconds, of the GetResultMetas latency buckets */
+static const gint metas_latency_buckets[] = { 1, 4, 16, 64, 256, G_MAXINT };
+#define N_METAS_LATENCY_BUCKETS G_N_ELEMENTS (metas_latency_buckets)
+
+typedef struct {
+  gchar *uri;
+  GVariant *meta;
+} MetaCacheEntry;
+
 typedef struct {
   NautilusShellSearchProvider *self;
 
@@ -58,7 +73,14 @@ struct _NautilusShellSearchProvider {
 
   PendingSearch *current_search;
 
+  /* uri -> link in metas_lru, most recently used first */
   GHashTable *metas_cache;
+  GQueue metas_lru;
+
+  /* GIcon -> serialized icon */
+  GHashTable *icons_cache;
+
+  guint metas_latency[N_METAS_LATENCY_BUCKETS];
 };
 
 G_DEFINE_TYPE (NautilusShellSearchProvider, nautilus_shell_search_provider, G_TYPE_OBJECT)
@@ -103,6 +125,121 @@ get_gicon (NautilusShellSearchProvider *self,
     return nautilus_file_get_gicon (file, 0);
 }
 
+static void
+meta_cache_entry_free (MetaCacheEntry *entry)
+{
+  g_free (entry->uri);
+  g_variant_unref (entry->meta);
+
+  g_slice_free (MetaCacheEntry, entry);
+}
+
+static GVariant *
+metas_cache_lookup (NautilusShellSearchProvider *self,
+                    const gchar                 *uri)
+{
+  GList *link;
+
+  link = g_hash_table_lookup (self->metas_cache, uri);
+  if (link == NULL)
+    return NULL;
+
+  g_queue_unlink (&self->metas_lru, link);
+  g_queue_push_head_link (&self->metas_lru, link);
+
+  return ((MetaCacheEntry *) link->data)->meta;
+}
+
+static void
+metas_cache_insert (NautilusShellSearchProvider *self,
+                    const gchar                 *uri,
+                    GVariant                    *meta)
+{
+  MetaCacheEntry *entry;
+  GList *link;
+
+  link = g_hash_table_lookup (self->metas_cache, uri);
+  if (link != NULL) {
+    entry = link->data;
+    g_variant_unref (entry->meta);
+    entry->meta = g_variant_ref (meta);
+
+    g_queue_unlink (&self->metas_lru, link);
+    g_queue_push_head_link (&self->metas_lru, link);
+    return;
+  }
+
+  entry = g_slice_new (MetaCacheEntry);
+  entry->uri = g_strdup (uri);
+  entry->meta = g_variant_ref (meta);
+
+  g_queue_push_head (&self->metas_lru, entry);
+  g_hash_table_insert (self->metas_cache, entry->uri, self->metas_lru.head);
+
+  while (self->metas_lru.length > METAS_CACHE_SIZE) {
+    entry = g_queue_pop_tail (&self->metas_lru);
+    g_hash_table_remove (self->metas_cache, entry->uri);
+    meta_cache_entry_free (entry);
+  }
+}
+
+static GVariant *
+serialize_icon (NautilusShellSearchProvider *self,
+                GIcon                       *gicon)
+{
+  GVariant *serialized;
+
+  /* Thumbnails and pixbufs are specific to a file, only themed icons
+   * are worth remembering. */
+  if (!G_IS_THEMED_ICON (gicon))
+    return g_icon_serialize (gicon);
+
+  serialized = g_hash_table_lookup (self->icons_cache, gicon);
+  if (serialized != NULL)
+    return g_variant_ref (serialized);
+
+  if (g_hash_table_size (self->icons_cache) >= ICONS_CACHE_SIZE)
+    g_hash_table_remove_all (self->icons_cache);
+
+  serialized = g_icon_serialize (gicon);
+  g_hash_table_insert (self->icons_cache,
+                       g_object_ref (gicon), g_variant_ref (serialized));
+
+  return serialized;
+}
+
+static void
+record_metas_latency (NautilusShellSearchProvider *self,
+                      gint64                       start_time)
+{
+  GString *histogram;
+  gint elapsed;
+  guint idx;
+
+  elapsed = (gint) ((g_get_monotonic_time () - start_time) / 1000);
+
+  for (idx = 0; idx < N_METAS_LATENCY_BUCKETS; idx++) {
+    if (elapsed < metas_latency_buckets[idx]) {
+      self->metas_latency[idx]++;
+      break;
+    }
+  }
+
+  histogram = g_string_new (NULL);
+  for (idx = 0; idx < N_METAS_LATENCY_BUCKETS; idx++) {
+    if (metas_latency_buckets[idx] == G_MAXINT)
+      g_string_append_printf (histogram, " >=%dms: %u",
+                              metas_latency_buckets[idx - 1], self->metas_latency[idx]);
+    else
+      g_string_append_printf (histogram, " <%dms: %u",
+                              metas_latency_buckets[idx], self->metas_latency[idx]);
+  }
+
+  g_debug ("*** GetResultMetas completed - time elapsed %dms, latencies:%s",
+           elapsed, histogram->str);
+  g_string_free (histogram, TRUE);
+}
+
 static void
 pending_search_free (PendingSearch *search)
 {
@@ -146,18 +283,25 @@ search_hits_added_cb (NautilusSearchEngine *engine,
   PendingSearch *search = user_data;
   GList *l;
   NautilusSearchHit *hit;
+  NautilusSearchHitScorer *scorer;
   const gchar *hit_uri;
 
   g_debug ("*** Search engine hits added");
 
+  scorer = nautilus_search_hit_scorer_new (search->query);
+
   for (l = hits; l != NULL; l = l->next) {
     hit = l->data;
-    nautilus_search_hit_compute_scores (hit, search->query);
+    if (!nautilus_search_hit_has_relevance (hit))
+      nautilus_search_hit_scorer_compute_scores (scorer, hit);
     hit_uri = nautilus_search_hit_get_uri (hit);
     g_debug ("    %s", hit_uri);
 
-    g_hash_table_replace (search->hits, g_strdup (hit_uri), g_object_ref (hit));
+    /* Keyed by the uri of the hit itself, which lives as long as it */
+    g_hash_table_replace (search->hits, (gpointer) hit_uri, g_object_ref (hit));
   }
+
+  nautilus_search_hit_scorer_free (scorer);
 }
 
 static gint
@@ -380,7 +524,8 @@ search_add_volumes_and_bookmarks (PendingSearch *search)
       hit = nautilus_search_hit_new (candidate->uri);
       nautilus_search_hit_set_fts_rank (hit, match);
       nautilus_search_hit_compute_scores (hit, search->query);
-      g_hash_table_replace (search->hits, g_strdup (candidate->uri), hit);
+      g_hash_table_replace (search->hits,
+                            (gpointer) nautilus_search_hit_get_uri (hit), hit);
     }
   }
   g_list_free_full (candidates, (GDestroyNotify) search_hit_candidate_free);
@@ -416,7 +561,7 @@ execute_search (NautilusShellSearchProvider *self,
 
   pending_search = g_slice_new0 (PendingSearch);
   pending_search->invocation = g_object_ref (invocation);
-  pending_search->hits = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+  pending_search->hits = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_object_unref);
   pending_search->query = query;
   pending_search->engine = nautilus_search_engine_new ();
   pending_search->start_time = g_get_monotonic_time ();
@@ -478,11 +623,22 @@ typedef struct {
   GDBusMethodInvocation *invocation;
 
   gchar **uris;
+  /* metas for uris, in the same order; held here so that
+   * entries evicted from the cache meanwhile are still returned */
+  GVariant **metas;
 } ResultMetasData;
 
 static void
 result_metas_data_free (ResultMetasData *data)
 {
+  gint idx;
+
+  for (idx = 0; data->uris[idx] != NULL; idx++) {
+    if (data->metas[idx] != NULL)
+      g_variant_unref (data->metas[idx]);
+  }
+  g_free (data->metas);
+
   g_clear_object (&data->self);
   g_clear_object (&data->invocation);
   g_strfreev (data->uris);
@@ -491,24 +647,19 @@ result_metas_data_free (ResultMetasData *data)
 }
 
 static void
-result_metas_return_from_cache (ResultMetasData *data)
+result_metas_return (ResultMetasData *data)
 {
   GVariantBuilder builder;
-  GVariant *meta;
-  gint64 current_time;
   gint idx;
 
   g_variant_builder_init (&builder, G_VARIANT_TYPE ("aa{sv}"));
 
   for (idx = 0; data->uris[idx] != NULL; idx++) {
-    meta = g_hash_table_lookup (data->self->metas_cache,
-                                data->uris[idx]);
-    g_variant_builder_add_value (&builder, meta);
+    if (data->metas[idx] != NULL)
+      g_variant_builder_add_value (&builder, data->metas[idx]);
   }
 
-  current_time = g_get_monotonic_time ();
-  g_debug ("*** GetResultMetas completed - time elapsed %dms",
-           (gint) ((current_time - data->start_time) / 1000));
+  record_metas_latency (data->self, data->start_time);
 
   g_dbus_method_invocation_return_value (data->invocation,
                                          g_variant_new ("(aa{sv})", &builder));
@@ -528,8 +679,9 @@ result_list_attributes_ready_cb (GList    *file_list,
   gchar *thumbnail_path;
   GIcon *gicon;
   GFile *location;
-  GVariant *meta_variant;
+  GVariant *meta_variant, *icon_variant;
   gint icon_scale;
+  gint idx;
 
   icon_scale = gdk_screen_get_monitor_scale_factor (gdk_screen_get_default (), 0);
 
@@ -569,20 +721,31 @@ result_list_attributes_ready_cb (GList    *file_list,
                                                      NAUTILUS_FILE_ICON_FLAGS_USE_THUMBNAILS));
     }
 
+    icon_variant = serialize_icon (data->self, gicon);
     g_variant_builder_add (&meta, "{sv}",
-                           "icon", g_icon_serialize (gicon));
+                           "icon", icon_variant);
+    g_variant_unref (icon_variant);
     g_object_unref (gicon);
 
-    meta_variant = g_variant_builder_end (&meta);
-    g_hash_table_insert (data->self->metas_cache,
-                         g_strdup (uri), g_variant_ref_sink (meta_variant));
+    meta_variant = g_variant_ref_sink (g_variant_builder_end (&meta));
+    /* Serialize it now, so that answering from the cache later only
+     * copies the data into the reply. */
+    g_variant_get_data (meta_variant);
+    metas_cache_insert (data->self, uri, meta_variant);
+
+    for (idx = 0; data->uris[idx] != NULL; idx++) {
+      if (data->metas[idx] == NULL && g_strcmp0 (data->uris[idx], uri) == 0)
+        data->metas[idx] = g_variant_ref (meta_variant);
+    }
+
+    g_variant_unref (meta_variant);
 
     g_free (display_name);
     g_free (description);
     g_free (uri);
   }
 
-  result_metas_return_from_cache (data);
+  result_metas_return (data);
   result_metas_data_free (data);
 }
 
@@ -596,26 +759,31 @@ handle_get_result_metas (NautilusShellSearchProvider2  *skeleton,
   GList *missing_files = NULL;
   const gchar *uri;
   ResultMetasData *data;
+  GVariant *meta;
   gint idx;
 
   g_debug ("****** GetResultMetas");
 
+  data = g_slice_new0 (ResultMetasData);
+  data->self = g_object_ref (self);
+  data->invocation = g_object_ref (invocation);
+  data->start_time = g_get_monotonic_time ();
+  data->uris = g_strdupv (results);
+  data->metas = g_new0 (GVariant *, g_strv_length (results));
+
   for (idx = 0; results[idx] != NULL; idx++) {
     uri = results[idx];
+    meta = metas_cache_lookup (self, uri);
 
-    if (!g_hash_table_lookup (self->metas_cache, uri)) {
+    if (meta != NULL) {
+      data->metas[idx] = g_variant_ref (meta);
+    } else {
       missing_files = g_list_prepend (missing_files, nautilus_file_get_by_uri (uri));
     }
   }
 
-  data = g_slice_new0 (ResultMetasData);
-  data->self = g_object_ref (self);
-  data->invocation = g_object_ref (invocation);
-  data->start_time = g_get_monotonic_time ();
-  data->uris = g_strdupv (results);
-
   if (missing_files == NULL) {
-    result_metas_return_from_cache (data);
+    result_metas_return (data);
     result_metas_data_free (data);
     return TRUE;
   }
@@ -678,7 +846,10 @@ search_provider_dispose (GObject *obj)
   NautilusShellSearchProvider *self = NAUTILUS_SHELL_SEARCH_PROVIDER (obj);
 
   g_clear_object (&self->skeleton);
-  g_hash_table_destroy (self->metas_cache);
+  g_clear_pointer (&self->metas_cache, g_hash_table_destroy);
+  g_queue_foreach (&self->metas_lru, (GFunc) meta_cache_entry_free, NULL);
+  g_queue_clear (&self->metas_lru);
+  g_clear_pointer (&self->icons_cache, g_hash_table_destroy);
   cancel_current_search (self);
 
   G_OBJECT_CLASS (nautilus_shell_search_provider_parent_class)->dispose (obj);
@@ -687,8 +858,10 @@ search_provider_dispose (GObject *obj)
 static void
 nautilus_shell_search_provider_init (NautilusShellSearchProvider *self)
 {
-  self->metas_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                             g_free, (GDestroyNotify) g_variant_unref);
+  self->metas_cache = g_hash_table_new (g_str_hash, g_str_equal);
+  g_queue_init (&self->metas_lru);
+  self->icons_cache = g_hash_table_new_full (g_icon_hash, (GEqualFunc) g_icon_equal,
+                                             g_object_unref, (GDestroyNotify) g_variant_unref);
 
   self->skeleton = nautilus_shell_search_provider2_skeleton_new ();
 
@@ -79,59 +79,192 @@ vfs_file_check_if_ready (NautilusFile *file,
 		 file_attributes);
 }
 
-static void
-set_metadata_get_info_callback (GObject *source_object,
-				GAsyncResult *res,
-				gpointer callback_data)
-{
+/* Metadata writes are collected per directory and written together from
+ * one thread once the main loop is idle, so that moving or aligning many
+ * icons at once doesn't turn into one round trip per file and key. The
+ * new values are put in the file's metadata right away.
+ */
+typedef struct {
+	NautilusDirectory *directory;
+	/* NautilusFile -> GFileInfo holding its pending metadata:: attributes */
+	GHashTable *files;
+	guint flush_id;
+	/* a batch is being written; the next one waits for it, so that
+	 * writes to a file land in order */
+	gboolean writing;
+} MetadataWriteBuffer;
+
+typedef struct {
 	NautilusFile *file;
+	GFile *location;
+	GFileInfo *info;
+	/* what is stored after the write, read back in the same thread */
 	GFileInfo *new_info;
-	GError *error;
+} MetadataWrite;
 
-	file = callback_data;
+static GHashTable *metadata_write_buffers = NULL;
 
-	error = NULL;
-	new_info = g_file_query_info_finish (G_FILE (source_object), res, &error);
-	if (new_info != NULL) {
-		if (nautilus_file_update_info (file, new_info)) {
-			nautilus_file_changed (file);
+static void
+metadata_write_free (MetadataWrite *write)
+{
+	nautilus_file_unref (write->file);
+	g_object_unref (write->location);
+	g_object_unref (write->info);
+	g_clear_object (&write->new_info);
+
+	g_slice_free (MetadataWrite, write);
+}
+
+static void
+metadata_writes_free (GList *writes)
+{
+	g_list_free_full (writes, (GDestroyNotify) metadata_write_free);
+}
+
+static void
+write_metadata_thread (GTask        *task,
+		       gpointer      source_object,
+		       gpointer      task_data,
+		       GCancellable *cancellable)
+{
+	GList *l;
+	MetadataWrite *write;
+
+	for (l = task_data; l != NULL; l = l->next) {
+		write = l->data;
+		g_file_set_attributes_from_info (write->location,
+						 write->info,
+						 0,
+						 NULL,
+						 NULL);
+		write->new_info = g_file_query_info (write->location,
+						     NAUTILUS_FILE_DEFAULT_ATTRIBUTES,
+						     0,
+						     NULL,
+						     NULL);
+	}
+}
+
+static gboolean flush_metadata_write_buffer (gpointer user_data);
+
+static void
+write_metadata_done (GObject      *source_object,
+		     GAsyncResult *result,
+		     gpointer      user_data)
+{
+	MetadataWriteBuffer *buffer;
+	GList *l;
+	MetadataWrite *write;
+
+	buffer = user_data;
+	buffer->writing = FALSE;
+
+	/* Install what is actually stored now. This also puts back the
+	 * written values if an info update with the old metadata came in
+	 * while the batch was pending. Files with newer pending values
+	 * are left to their own batch, not to show older values again. */
+	for (l = g_task_get_task_data (G_TASK (result)); l != NULL; l = l->next) {
+		write = l->data;
+		if (write->new_info != NULL &&
+		    !g_hash_table_contains (buffer->files, write->file) &&
+		    nautilus_file_update_info (write->file, write->new_info)) {
+			nautilus_file_changed (write->file);
 		}
-		g_object_unref (new_info);
 	}
-	nautilus_file_unref (file);
-	if (error) {
-		g_error_free (error);
+
+	if (buffer->flush_id != 0) {
+		g_source_remove (buffer->flush_id);
 	}
+	flush_metadata_write_buffer (buffer);
+}
+
+static gboolean
+flush_metadata_write_buffer (gpointer user_data)
+{
+	MetadataWriteBuffer *buffer;
+	GHashTableIter iter;
+	gpointer file, info;
+	MetadataWrite *write;
+	GList *writes;
+	GTask *task;
+
+	buffer = user_data;
+	buffer->flush_id = 0;
+
+	if (buffer->writing) {
+		return FALSE;
+	}
+
+	/* the buffer only lives while it has something to write */
+	if (g_hash_table_size (buffer->files) == 0) {
+		g_hash_table_remove (metadata_write_buffers, buffer->directory);
+		return FALSE;
+	}
+
+	writes = NULL;
+	g_hash_table_iter_init (&iter, buffer->files);
+	while (g_hash_table_iter_next (&iter, &file, &info)) {
+		write = g_slice_new0 (MetadataWrite);
+		write->file = nautilus_file_ref (file);
+		write->location = nautilus_file_get_location (file);
+		write->info = g_object_ref (info);
+		writes = g_list_prepend (writes, write);
+	}
+	g_hash_table_remove_all (buffer->files);
+
+	buffer->writing = TRUE;
+	task = g_task_new (NULL, NULL, write_metadata_done, buffer);
+	g_task_set_task_data (task, writes, (GDestroyNotify) metadata_writes_free);
+	g_task_run_in_thread (task, write_metadata_thread);
+	g_object_unref (task);
+
+	return FALSE;
 }
 
 static void
-set_metadata_callback (GObject *source_object,
-		       GAsyncResult *result,
-		       gpointer callback_data)
+metadata_write_buffer_free (MetadataWriteBuffer *buffer)
 {
-	NautilusFile *file;
-	GError *error;
-	gboolean res;
+	if (buffer->flush_id != 0) {
+		g_source_remove (buffer->flush_id);
+	}
+	g_hash_table_destroy (buffer->files);
+	nautilus_directory_unref (buffer->directory);
 
-	file = callback_data;
+	g_slice_free (MetadataWriteBuffer, buffer);
+}
 
-	error = NULL;
-	res = g_file_set_attributes_finish (G_FILE (source_object),
-					    result,
-					    NULL,
-					    &error);
-
-	if (res) {
-		g_file_query_info_async (G_FILE (source_object),
-					 NAUTILUS_FILE_DEFAULT_ATTRIBUTES,
-					 0,
-					 G_PRIORITY_DEFAULT,
-					 NULL,
-					 set_metadata_get_info_callback, file);
-	} else {
-		nautilus_file_unref (file);
-		g_error_free (error);
+static GFileInfo *
+get_pending_metadata_info (NautilusFile *file)
+{
+	MetadataWriteBuffer *buffer;
+	GFileInfo *info;
+
+	if (metadata_write_buffers == NULL) {
+		metadata_write_buffers = g_hash_table_new_full (NULL, NULL, NULL,
+								(GDestroyNotify) metadata_write_buffer_free);
+	}
+
+	buffer = g_hash_table_lookup (metadata_write_buffers, file->details->directory);
+	if (buffer == NULL) {
+		buffer = g_slice_new0 (MetadataWriteBuffer);
+		buffer->directory = nautilus_directory_ref (file->details->directory);
+		buffer->files = g_hash_table_new_full (NULL, NULL,
+						       (GDestroyNotify) nautilus_file_unref,
+						       g_object_unref);
+		g_hash_table_insert (metadata_write_buffers, buffer->directory, buffer);
+	}
+
+	if (buffer->flush_id == 0) {
+		buffer->flush_id = g_idle_add (flush_metadata_write_buffer, buffer);
+	}
+
+	info = g_hash_table_lookup (buffer->files, file);
+	if (info == NULL) {
+		info = g_file_info_new ();
+		g_hash_table_insert (buffer->files, nautilus_file_ref (file), info);
 	}
+
+	return info;
 }
 
 static void
@@ -140,10 +273,9 @@ vfs_file_set_metadata (NautilusFile           *file,
 		       const char             *value)
 {
 	GFileInfo *info;
-	GFile *location;
 	char *gio_key;
 
-	info = g_file_info_new ();
+	info = get_pending_metadata_info (file);
 	
 	gio_key = g_strconcat ("metadata::", key, NULL);
 	if (value != NULL) {
@@ -156,16 +288,9 @@ vfs_file_set_metadata (NautilusFile           *file,
 	}
 	g_free (gio_key);
 
-	location = nautilus_file_get_location (file);
-	g_file_set_attributes_async (location,
-				     info,
-				     0,
-				     G_PRIORITY_DEFAULT,
-				     NULL,
-				     set_metadata_callback,
-				     nautilus_file_ref (file));
-	g_object_unref (location);
-	g_object_unref (info);
+	if (nautilus_file_update_metadata_key (file, key, value, NULL)) {
+		nautilus_file_changed (file);
+	}
 }
 
 static void
@@ -173,26 +298,18 @@ vfs_file_set_metadata_as_list (NautilusFile           *file,
 			       const char             *key,
 			       char                  **value)
 {
-	GFile *location;
 	GFileInfo *info;
 	char *gio_key;
 
-	info = g_file_info_new ();
+	info = get_pending_metadata_info (file);
 
 	gio_key = g_strconcat ("metadata::", key, NULL);
 	g_file_info_set_attribute_stringv (info, gio_key, value);
 	g_free (gio_key);
 
-	location = nautilus_file_get_location (file);
-	g_file_set_attributes_async (location,
-				     info,
-				     0,
-				     G_PRIORITY_DEFAULT,
-				     NULL,
-				     set_metadata_callback,
-				     nautilus_file_ref (file));
-	g_object_unref (info);
-	g_object_unref (location);
+	if (nautilus_file_update_metadata_key (file, key, NULL, value)) {
+		nautilus_file_changed (file);
+	}
 }
 
 static gboolean